@@ -0,0 +1,101 @@
+#include "bounded-heap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+/**
+ * Checks the boundedheap against the slow way of choosing the best k of
+ * n elements, which is to sort all n of them and take the first k.  The
+ * elements are scored the way the search scores articles, and lots of
+ * them share a score, so ties are broken by id to make the best k the
+ * same no matter which way they're chosen.
+ */
+
+static const int kNumTrials = 2000;
+static const int kMaxElements = 300;
+static const int kMaxCapacity = 40;
+static const int kMaxScore = 20;           // small, so there are ties
+
+typedef struct {
+  int score;
+  int id;
+} scoredelem;
+
+// higher scores are better, and among equal scores, lower ids are
+static int CompareScoredElems(const void *elemAddr1, const void *elemAddr2)
+{
+  const scoredelem *elem1 = elemAddr1;
+  const scoredelem *elem2 = elemAddr2;
+  if (elem1->score != elem2->score) return elem1->score - elem2->score;
+  return elem2->id - elem1->id;
+}
+
+// best first, as qsort wants it
+static int CompareBestFirst(const void *elemAddr1, const void *elemAddr2)
+{
+  return CompareScoredElems(elemAddr2, elemAddr1);
+}
+
+// scores alone, so ties are left to the heap
+static int CompareScores(const void *elemAddr1, const void *elemAddr2)
+{
+  return ((const scoredelem *) elemAddr1)->score - ((const scoredelem *) elemAddr2)->score;
+}
+
+/**
+ * Function: TestBestK
+ * -------------------
+ * Offers random elements to heaps of random capacities, some larger
+ * than the number offered, and confirms that the sorted heap holds
+ * exactly the first k of the sorted elements, in the same order.  The
+ * same elements are offered again to a heap that only compares scores,
+ * whose kth element can be any of those tied for kth place, so only its
+ * scores are checked.
+ */
+
+static void TestBestK(void)
+{
+  scoredelem *elems = malloc(kMaxElements * sizeof(scoredelem));
+  assert(elems != NULL);
+  int numKept = 0;
+  for (int i = 0; i < kNumTrials; i++) {
+    int numElems = rand() % (kMaxElements + 1);
+    int capacity = 1 + rand() % kMaxCapacity;
+    boundedheap best, bestScores;
+    BoundedHeapNew(&best, sizeof(scoredelem), capacity, CompareScoredElems);
+    BoundedHeapNew(&bestScores, sizeof(scoredelem), capacity, CompareScores);
+    for (int j = 0; j < numElems; j++) {
+      elems[j].score = rand() % (kMaxScore + 1);
+      elems[j].id = j;
+      BoundedHeapOffer(&best, &elems[j]);
+      BoundedHeapOffer(&bestScores, &elems[j]);
+      assert(BoundedHeapCount(&best) == (j + 1 < capacity ? j + 1 : capacity));
+    }
+
+    qsort(elems, numElems, sizeof(scoredelem), CompareBestFirst);
+    BoundedHeapSort(&best);
+    BoundedHeapSort(&bestScores);
+    int expected = numElems < capacity ? numElems : capacity;
+    assert(BoundedHeapCount(&best) == expected && BoundedHeapCount(&bestScores) == expected);
+    for (int j = 0; j < expected; j++) {
+      const scoredelem *kept = BoundedHeapNth(&best, j);
+      assert(kept->score == elems[j].score && kept->id == elems[j].id);
+      kept = BoundedHeapNth(&bestScores, j);
+      assert(kept->score == elems[j].score);
+    }
+    numKept += expected;
+    BoundedHeapDispose(&best);
+    BoundedHeapDispose(&bestScores);
+  }
+
+  printf("In %d trials, both heaps kept the %d elements sorting would have, in the same order.\n",
+         kNumTrials, numKept);
+  free(elems);
+}
+
+int main(int ignored, char **alsoIgnored)
+{
+  srand(107);
+  TestBestK();
+  return 0;
+}
@@ -0,0 +1,91 @@
+#include "bounded-heap.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static void *ElemAddress(const boundedheap *h, int position)
+{
+  return h->elems + position * h->elemSize;
+}
+
+static void Swap(boundedheap *h, int position1, int position2)
+{
+  char tmp[h->elemSize];
+  memcpy(tmp, ElemAddress(h, position1), h->elemSize);
+  memcpy(ElemAddress(h, position1), ElemAddress(h, position2), h->elemSize);
+  memcpy(ElemAddress(h, position2), tmp, h->elemSize);
+}
+
+// the worst element rises to the top
+static bool IsWorse(const boundedheap *h, int position1, int position2)
+{
+  return h->comparefn(ElemAddress(h, position1), ElemAddress(h, position2)) < 0;
+}
+
+static void SiftUp(boundedheap *h, int position)
+{
+  while (position > 0 && IsWorse(h, position, (position - 1) / 2)) {
+    Swap(h, position, (position - 1) / 2);
+    position = (position - 1) / 2;
+  }
+}
+
+static void SiftDown(boundedheap *h, int position, int count)
+{
+  while (true) {
+    int worst = position;
+    int left = 2 * position + 1, right = left + 1;
+    if (left < count && IsWorse(h, left, worst)) worst = left;
+    if (right < count && IsWorse(h, right, worst)) worst = right;
+    if (worst == position) return;
+    Swap(h, position, worst);
+    position = worst;
+  }
+}
+
+void BoundedHeapNew(boundedheap *h, int elemSize, int capacity, BoundedHeapCompareFunction comparefn)
+{
+  assert(elemSize > 0 && capacity > 0 && comparefn != NULL);
+  h->elems = malloc(capacity * elemSize);
+  assert(h->elems != NULL);
+  h->elemSize = elemSize;
+  h->count = 0;
+  h->capacity = capacity;
+  h->comparefn = comparefn;
+}
+
+void BoundedHeapDispose(boundedheap *h)
+{
+  free(h->elems);
+}
+
+int BoundedHeapCount(const boundedheap *h)
+{
+  return h->count;
+}
+
+void BoundedHeapOffer(boundedheap *h, const void *elemAddr)
+{
+  if (h->count < h->capacity) {
+    memcpy(ElemAddress(h, h->count), elemAddr, h->elemSize);
+    SiftUp(h, h->count++);
+  } else if (h->comparefn(elemAddr, ElemAddress(h, 0)) > 0) {
+    memcpy(ElemAddress(h, 0), elemAddr, h->elemSize);
+    SiftDown(h, 0, h->count);
+  }
+}
+
+// repeatedly moves the worst remaining element to the end of the unsorted prefix
+void BoundedHeapSort(boundedheap *h)
+{
+  for (int unsorted = h->count - 1; unsorted > 0; unsorted--) {
+    Swap(h, 0, unsorted);
+    SiftDown(h, 0, unsorted);
+  }
+}
+
+void *BoundedHeapNth(const boundedheap *h, int position)
+{
+  assert(position >= 0 && position < h->count);
+  return ElemAddress(h, position);
+}
@@ -0,0 +1,91 @@
+/**
+ * File: bounded-heap.h
+ * --------------------
+ * Exports the boundedheap type, which keeps the best k of however
+ * many elements are offered to it.  It's a min-heap of at most k
+ * elements with the worst of the keepers on top, so each offer costs
+ * O(log k) and choosing the best k of n elements costs O(n log k),
+ * rather than the O(n log n) it takes to sort them all.
+ *
+ * Elements are copied in by value, just as they are with the vector.
+ */
+
+#ifndef __bounded_heap_
+#define __bounded_heap_
+
+#include "bool.h"
+
+/**
+ * Type: BoundedHeapCompareFunction
+ * --------------------------------
+ * Returns a positive number if the element at elemAddr1 is better than
+ * the one at elemAddr2, a negative number if it's worse, and zero if
+ * they're equally good.
+ */
+
+typedef int (*BoundedHeapCompareFunction)(const void *elemAddr1, const void *elemAddr2);
+
+typedef struct {
+  char *elems;
+  int elemSize;
+  int count;
+  int capacity;
+  BoundedHeapCompareFunction comparefn;
+} boundedheap;
+
+/**
+ * Function: BoundedHeapNew
+ * ------------------------
+ * Initializes the heap to keep the best capacity elements of elemSize
+ * bytes, as judged by comparefn.  Capacity must be positive.
+ */
+
+void BoundedHeapNew(boundedheap *h, int elemSize, int capacity, BoundedHeapCompareFunction comparefn);
+
+/**
+ * Function: BoundedHeapDispose
+ * ----------------------------
+ * Releases the memory held by the heap.
+ */
+
+void BoundedHeapDispose(boundedheap *h);
+
+/**
+ * Function: BoundedHeapCount
+ * --------------------------
+ * Returns the number of elements being kept, which is never more than
+ * the heap's capacity.
+ */
+
+int BoundedHeapCount(const boundedheap *h);
+
+/**
+ * Function: BoundedHeapOffer
+ * --------------------------
+ * Copies the element at elemAddr into the heap if there's room for it,
+ * or if it's better than the worst element being kept, which is then
+ * discarded.  Otherwise the heap is left alone.
+ */
+
+void BoundedHeapOffer(boundedheap *h, const void *elemAddr);
+
+/**
+ * Function: BoundedHeapSort
+ * -------------------------
+ * Arranges the kept elements from best to worst, so they can be
+ * read back with BoundedHeapNth.  Nothing more can be offered
+ * once the heap has been sorted.
+ */
+
+void BoundedHeapSort(boundedheap *h);
+
+/**
+ * Function: BoundedHeapNth
+ * ------------------------
+ * Returns the address of the element in the specified position of a
+ * sorted heap, where position 0 is the best.
+ */
+
+void *BoundedHeapNth(const boundedheap *h, int position);
+
+#endif
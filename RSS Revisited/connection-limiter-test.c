@@ -0,0 +1,196 @@
+#include "connection-limiter.h"
+#include "http-standin.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/**
+ * Exercises the connectionlimiter the way the crawler does: a crowd of
+ * threads, each repeatedly claiming a connection to one of a handful of
+ * servers, fetching a document over it, and giving it back.  The servers
+ * are played by an httpstandin, which counts the connections it actually
+ * sees open at once, so the limits are checked from the far end of the
+ * wire rather than by trusting the limiter's own bookkeeping.
+ */
+
+static const int kNumServers = 4;
+static const int kMaxConnections = 6;
+static const int kMaxPerServer = 2;
+static const int kNumFetchers = 16;
+static const int kFetchesPerFetcher = 25;
+static const int kResponseDelay = 10; // milliseconds
+
+typedef struct {
+  connectionlimiter *limiter;
+  httpstandin *standin;
+  unsigned int seed;
+  int numFetched;
+} fetcher;
+
+/**
+ * Function: Fetch
+ * ---------------
+ * Connects to the stand-in server at the specified address and port,
+ * asks it for a document, and reads the response to the end.  Returns
+ * true if and only if a complete, successful response came back.
+ */
+
+static bool Fetch(const char *address, int port, int fetchNumber)
+{
+  struct sockaddr_in server;
+  memset(&server, 0, sizeof(server));
+  server.sin_family = AF_INET;
+  server.sin_port = htons(port);
+  inet_pton(AF_INET, address, &server.sin_addr);
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == -1 || connect(fd, (struct sockaddr *) &server, sizeof(server)) == -1) {
+    if (fd != -1) close(fd);
+    return false;
+  }
+
+  char request[128];
+  int requestLength = sprintf(request, "GET /story-%d.html HTTP/1.0\r\nHost: %s\r\n\r\n", fetchNumber, address);
+  bool sent = write(fd, request, requestLength) == requestLength;
+
+  char response[1024];
+  int length = 0;
+  ssize_t received;
+  while ((received = read(fd, response + length, sizeof(response) - 1 - length)) > 0 ||
+         (received == -1 && errno == EINTR))
+    if (received > 0) length += received;
+  response[length] = '\0';
+  close(fd);
+  return sent && strncmp(response, "HTTP/1.0 200 OK", strlen("HTTP/1.0 200 OK")) == 0 &&
+    strstr(response, "</html>") != NULL;
+}
+
+/**
+ * Function: FetchDocuments
+ * ------------------------
+ * Thread routine that fetches kFetchesPerFetcher documents from servers
+ * chosen at random, holding a connection claimed from the limiter for
+ * the whole of each fetch, just as the crawler does.
+ */
+
+static void *FetchDocuments(void *arg)
+{
+  fetcher *f = arg;
+  for (int i = 0; i < kFetchesPerFetcher; i++) {
+    char address[16];
+    int port = HTTPStandInAddress(f->standin, rand_r(&f->seed) % kNumServers, address);
+    ConnectionLimiterAcquire(f->limiter, address);
+    if (Fetch(address, port, i)) f->numFetched++;
+    ConnectionLimiterRelease(f->limiter, address);
+  }
+  return NULL;
+}
+
+/**
+ * Function: TestLimits
+ * --------------------
+ * Unleashes kNumFetchers fetchers on the stand-in, and then confirms
+ * that every fetch succeeded, that no server ever saw more than
+ * kMaxPerServer connections at once, and that all of them together never
+ * saw more than kMaxConnections.  The limits are also confirmed to have
+ * been reached, since a test in which the fetchers never contended for
+ * connections wouldn't prove anything.
+ */
+
+static void TestLimits(void)
+{
+  httpstandin standin;
+  connectionlimiter limiter;
+  if (!HTTPStandInStart(&standin, kNumServers, kResponseDelay)) {
+    fprintf(stderr, "Couldn't start the stand-in servers: %s\n", strerror(errno));
+    exit(1);
+  }
+  ConnectionLimiterNew(&limiter, kMaxConnections, kMaxPerServer);
+
+  pthread_t threads[kNumFetchers];
+  fetcher fetchers[kNumFetchers];
+  for (int i = 0; i < kNumFetchers; i++) {
+    fetchers[i] = (fetcher) { &limiter, &standin, 107 + i, 0 };
+    pthread_create(&threads[i], NULL, FetchDocuments, &fetchers[i]);
+  }
+
+  int numFetched = 0;
+  for (int i = 0; i < kNumFetchers; i++) {
+    pthread_join(threads[i], NULL);
+    numFetched += fetchers[i].numFetched;
+  }
+  printf("Fetched %d of %d documents from %d servers.\n", numFetched, kNumFetchers * kFetchesPerFetcher, kNumServers);
+  assert(numFetched == kNumFetchers * kFetchesPerFetcher);
+
+  int highestPeak = 0;
+  for (int i = 0; i < kNumServers; i++) {
+    char address[16];
+    HTTPStandInAddress(&standin, i, address);
+    int peak = HTTPStandInPeakConnections(&standin, i);
+    printf("  %s saw at most %d connection%s at once (the limit is %d).\n", address, peak,
+           (peak == 1) ? "" : "s", kMaxPerServer);
+    assert(peak <= kMaxPerServer);
+    if (peak > highestPeak) highestPeak = peak;
+  }
+  int peakTotal = HTTPStandInPeakTotal(&standin);
+  printf("  All servers together saw at most %d at once (the limit is %d).\n", peakTotal, kMaxConnections);
+  assert(peakTotal <= kMaxConnections);
+  assert(highestPeak == kMaxPerServer);
+
+  ConnectionLimiterDispose(&limiter);
+  HTTPStandInStop(&standin);
+}
+
+/**
+ * Function: TestServerNamesIgnoreCase
+ * -----------------------------------
+ * Confirms that server names differing only in case share one server's
+ * allowance: once kMaxPerServer connections to "News.Example.COM" are
+ * claimed, a thread after "news.example.com" has to wait for one of them.
+ */
+
+static void *ClaimLowercaseName(void *arg)
+{
+  connectionlimiter *limiter = arg;
+  ConnectionLimiterAcquire(limiter, "news.example.com");
+  ConnectionLimiterRelease(limiter, "news.example.com");
+  return NULL;
+}
+
+static void TestServerNamesIgnoreCase(void)
+{
+  connectionlimiter limiter;
+  ConnectionLimiterNew(&limiter, kMaxConnections, kMaxPerServer);
+  for (int i = 0; i < kMaxPerServer; i++)
+    ConnectionLimiterAcquire(&limiter, "News.Example.COM");
+
+  pthread_t waiter;
+  pthread_create(&waiter, NULL, ClaimLowercaseName, &limiter);
+  usleep(100 * 1000);
+  pthread_mutex_lock(&limiter.lock);
+  int numActive = limiter.numActive;
+  pthread_mutex_unlock(&limiter.lock);
+  assert(numActive == kMaxPerServer); // the waiter is still waiting
+
+  ConnectionLimiterRelease(&limiter, "NEWS.example.com");
+  pthread_join(waiter, NULL);
+  for (int i = 1; i < kMaxPerServer; i++)
+    ConnectionLimiterRelease(&limiter, "news.EXAMPLE.com");
+  ConnectionLimiterDispose(&limiter);
+  printf("Server names that differ only in case share one allowance.\n");
+}
+
+int main(int ignored, char **alsoIgnored)
+{
+  TestLimits();
+  TestServerNamesIgnoreCase();
+  printf("All connection limits held.\n");
+  return 0;
+}
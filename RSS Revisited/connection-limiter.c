@@ -0,0 +1,86 @@
+#include "connection-limiter.h"
+#include "term-scanner.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+
+typedef struct {
+  const char *serverName;
+  int numActive;
+} serverSlots;
+
+// Server names are case-insensitive, just as words are.
+static int ServerSlotsHash(const void *elem, int numBuckets)
+{
+  const serverSlots *slots = elem;
+  return WordHash(slots->serverName) % numBuckets;
+}
+
+static int ServerSlotsCompare(const void *elem1, const void *elem2)
+{
+  const serverSlots *slots1 = elem1;
+  const serverSlots *slots2 = elem2;
+  return strcasecmp(slots1->serverName, slots2->serverName);
+}
+
+static void ServerSlotsFree(void *elem)
+{
+  serverSlots *slots = elem;
+  free((char *) slots->serverName);
+}
+
+static const int kNumServerBuckets = 101;
+void ConnectionLimiterNew(connectionlimiter *cl, int maxConnections, int maxPerServer)
+{
+  assert(maxConnections > 0 && maxPerServer > 0);
+  HashSetNew(&cl->servers, sizeof(serverSlots), kNumServerBuckets,
+	     ServerSlotsHash, ServerSlotsCompare, ServerSlotsFree);
+  cl->numActive = 0;
+  cl->maxConnections = maxConnections;
+  cl->maxPerServer = maxPerServer;
+  pthread_mutex_init(&cl->lock, NULL);
+  pthread_cond_init(&cl->slotReleased, NULL);
+}
+
+void ConnectionLimiterDispose(connectionlimiter *cl)
+{
+  assert(cl->numActive == 0);
+  pthread_cond_destroy(&cl->slotReleased);
+  pthread_mutex_destroy(&cl->lock);
+  HashSetDispose(&cl->servers);
+}
+
+void ConnectionLimiterAcquire(connectionlimiter *cl, const char *serverName)
+{
+  serverSlots key = { serverName, 0 };
+
+  pthread_mutex_lock(&cl->lock);
+  if (HashSetLookup(&cl->servers, &key) == NULL) {
+    serverSlots slots = { strdup(serverName), 0 };
+    HashSetEnter(&cl->servers, &slots);
+  }
+
+  // entering other servers while we wait can move our record around
+  // within its bucket, so it's looked up afresh every time we wake up
+  serverSlots *slots;
+  while ((slots = HashSetLookup(&cl->servers, &key))->numActive == cl->maxPerServer ||
+	 cl->numActive == cl->maxConnections)
+    pthread_cond_wait(&cl->slotReleased, &cl->lock);
+  cl->numActive++;
+  slots->numActive++;
+  pthread_mutex_unlock(&cl->lock);
+}
+
+void ConnectionLimiterRelease(connectionlimiter *cl, const char *serverName)
+{
+  serverSlots key = { serverName, 0 };
+
+  pthread_mutex_lock(&cl->lock);
+  serverSlots *slots = HashSetLookup(&cl->servers, &key);
+  assert(slots != NULL && slots->numActive > 0);
+  slots->numActive--;
+  cl->numActive--;
+  pthread_cond_broadcast(&cl->slotReleased); // waiters may be after different servers
+  pthread_mutex_unlock(&cl->lock);
+}
@@ -0,0 +1,65 @@
+/**
+ * File: connection-limiter.h
+ * --------------------------
+ * Exports the connectionlimiter type, which caps the number of
+ * connections open at any one time, both overall and to each
+ * individual server.  Many of the feeds we aggregate live on the same
+ * handful of servers, and the per-server cap keeps a burst of
+ * articles from one of them from monopolizing (or hammering) anything.
+ */
+
+#ifndef __connection_limiter_
+#define __connection_limiter_
+
+#include <pthread.h>
+#include "hashset.h"
+
+typedef struct {
+  hashset servers;          // serverSlots records, one per server ever contacted
+  int numActive;
+  int maxConnections;
+  int maxPerServer;
+  pthread_mutex_t lock;
+  pthread_cond_t slotReleased;
+} connectionlimiter;
+
+/**
+ * Function: ConnectionLimiterNew
+ * ------------------------------
+ * Initializes the limiter to allow at most maxConnections open
+ * connections in total, no more than maxPerServer of which may be
+ * to the same server.  Both limits must be positive.
+ */
+
+void ConnectionLimiterNew(connectionlimiter *cl, int maxConnections, int maxPerServer);
+
+/**
+ * Function: ConnectionLimiterDispose
+ * ----------------------------------
+ * Releases all resources held by the limiter.  No connections
+ * should be outstanding.
+ */
+
+void ConnectionLimiterDispose(connectionlimiter *cl);
+
+/**
+ * Function: ConnectionLimiterAcquire
+ * ----------------------------------
+ * Blocks until a connection to the named server can be opened without
+ * exceeding either limit, and then claims it.  Server names are compared
+ * case-insensitively.  Every call must be balanced by a call to
+ * ConnectionLimiterRelease with the same server name once the connection
+ * has been closed.
+ */
+
+void ConnectionLimiterAcquire(connectionlimiter *cl, const char *serverName);
+
+/**
+ * Function: ConnectionLimiterRelease
+ * ----------------------------------
+ * Gives back a connection previously claimed via ConnectionLimiterAcquire.
+ */
+
+void ConnectionLimiterRelease(connectionlimiter *cl, const char *serverName);
+
+#endif
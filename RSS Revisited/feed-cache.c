@@ -0,0 +1,216 @@
+#include "feed-cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+/**
+ * Saved caches are plain text: a header line holding the stamp, and then
+ * for each feed, a line holding its item count and URL, followed by one
+ * line per item holding its fingerprint in hex.
+ *
+ *     rss-feed-cache 225
+ *     2 http://rss.cnn.com/rss/cnn_topstories.rss
+ *     8f3c0b1e6a2d4c57
+ *     01d2e3f4a5b6c7d8
+ */
+
+#define kFeedCacheHeader "rss-feed-cache"
+
+typedef struct {
+  char *feedURL;
+  uint64_t *fingerprints;   // sorted
+  int count;
+} feedRecord;
+
+// The multiplier WordHash uses, but feed URLs are matched exactly, so unlike words
+// and server names, they're hashed without folding case: "/World.xml" and
+// "/world.xml" can be different feeds, and needn't share a bucket.
+static const signed long kHashMultiplier = -1664117991L;
+static int FeedRecordHash(const void *elem, int numBuckets)
+{
+  const feedRecord *record = elem;
+  unsigned long hashcode = 0;
+  for (const char *c = record->feedURL; *c != '\0'; c++)
+    hashcode = hashcode * kHashMultiplier + (unsigned char) *c;
+  return hashcode % numBuckets;
+}
+
+static int FeedRecordCompare(const void *elem1, const void *elem2)
+{
+  const feedRecord *record1 = elem1;
+  const feedRecord *record2 = elem2;
+  return strcmp(record1->feedURL, record2->feedURL);
+}
+
+static void FeedRecordFree(void *elem)
+{
+  feedRecord *record = elem;
+  free(record->feedURL);
+  free(record->fingerprints);
+}
+
+static int FingerprintCompare(const void *elem1, const void *elem2)
+{
+  uint64_t one = *(const uint64_t *) elem1;
+  uint64_t two = *(const uint64_t *) elem2;
+  return (one > two) - (one < two);
+}
+
+static const int kNumFeedBuckets = 101;
+void FeedCacheNew(feedcache *fc)
+{
+  HashSetNew(&fc->feeds, sizeof(feedRecord), kNumFeedBuckets, FeedRecordHash, FeedRecordCompare, FeedRecordFree);
+  pthread_mutex_init(&fc->lock, NULL);
+}
+
+void FeedCacheDispose(feedcache *fc)
+{
+  pthread_mutex_destroy(&fc->lock);
+  HashSetDispose(&fc->feeds);
+}
+
+static uint64_t *CopyFingerprints(const uint64_t fingerprints[], int count)
+{
+  if (count == 0) return NULL;
+  uint64_t *copy = malloc(count * sizeof(uint64_t));
+  assert(copy != NULL);
+  memcpy(copy, fingerprints, count * sizeof(uint64_t));
+  return copy;
+}
+
+// Hands the record's fingerprints over to the cache, which must be locked.
+static void EnterRecord(feedcache *fc, const char *feedURL, uint64_t *fingerprints, int count)
+{
+  if (count > 1) qsort(fingerprints, count, sizeof(uint64_t), FingerprintCompare);
+  feedRecord key = { (char *) feedURL };
+  feedRecord *existing = HashSetLookup(&fc->feeds, &key);
+  if (existing != NULL) {
+    free(existing->fingerprints);
+    existing->fingerprints = fingerprints;
+    existing->count = count;
+  } else {
+    feedRecord record = { strdup(feedURL), fingerprints, count };
+    HashSetEnter(&fc->feeds, &record);
+  }
+}
+
+void FeedCacheRemember(feedcache *fc, const char *feedURL, const uint64_t fingerprints[], int count)
+{
+  uint64_t *copy = CopyFingerprints(fingerprints, count);
+  pthread_mutex_lock(&fc->lock);
+  EnterRecord(fc, feedURL, copy, count);
+  pthread_mutex_unlock(&fc->lock);
+}
+
+void FeedCacheRecall(feedcache *fc, const char *feedURL, feeditems *items)
+{
+  feedRecord key = { (char *) feedURL };
+  pthread_mutex_lock(&fc->lock);
+  const feedRecord *record = HashSetLookup(&fc->feeds, &key);
+  items->count = (record == NULL) ? 0 : record->count;
+  items->fingerprints = (record == NULL) ? NULL : CopyFingerprints(record->fingerprints, record->count);
+  pthread_mutex_unlock(&fc->lock);
+}
+
+bool FeedItemsContain(const feeditems *items, uint64_t fingerprint)
+{
+  return items->count > 0 &&
+    bsearch(&fingerprint, items->fingerprints, items->count, sizeof(uint64_t), FingerprintCompare) != NULL;
+}
+
+void FeedItemsDispose(feeditems *items)
+{
+  free(items->fingerprints);
+}
+
+// Reads one line into buffer, minus its newline, returning false if there's no complete line to read.
+static bool ReadLine(FILE *infile, char buffer[], int size)
+{
+  if (fgets(buffer, size, infile) == NULL) return false;
+  int length = strlen(buffer);
+  if (length == 0 || buffer[length - 1] != '\n') return false;
+  buffer[length - 1] = '\0';
+  return true;
+}
+
+static bool ReadRecords(FILE *infile, hashset *records, int stamp)
+{
+  char line[4096];
+  int savedStamp, count, consumed;
+  if (!ReadLine(infile, line, sizeof(line)) ||
+      sscanf(line, kFeedCacheHeader " %d", &savedStamp) != 1 || savedStamp != stamp) return false;
+
+  while (ReadLine(infile, line, sizeof(line))) {
+    if (sscanf(line, "%d %n", &count, &consumed) != 1 || count < 0 || line[consumed] == '\0') return false;
+    feedRecord record = { line + consumed, NULL, count };
+    if (HashSetLookup(records, &record) != NULL) return false;
+    if (count > 0 && (record.fingerprints = malloc(count * sizeof(uint64_t))) == NULL) return false;
+    record.feedURL = strdup(record.feedURL);
+    HashSetEnter(records, &record); // entered first, so it's freed along with the rest on failure
+    for (int i = 0; i < count; i++) {
+      char hex[32];
+      if (!ReadLine(infile, hex, sizeof(hex)) || sscanf(hex, "%" SCNx64, &record.fingerprints[i]) != 1)
+        return false;
+    }
+  }
+
+  return feof(infile);
+}
+
+static void AdoptRecord(void *elem, void *auxData)
+{
+  feedRecord *record = elem;
+  EnterRecord(auxData, record->feedURL, record->fingerprints, record->count);
+  record->fingerprints = NULL; // they belong to the cache now
+}
+
+bool FeedCacheLoad(feedcache *fc, const char *filename, int stamp)
+{
+  FILE *infile = fopen(filename, "r");
+  if (infile == NULL) return false;
+
+  hashset records;
+  HashSetNew(&records, sizeof(feedRecord), kNumFeedBuckets, FeedRecordHash, FeedRecordCompare, FeedRecordFree);
+  bool loaded = ReadRecords(infile, &records, stamp);
+  fclose(infile);
+  if (loaded) {
+    pthread_mutex_lock(&fc->lock);
+    HashSetMap(&records, AdoptRecord, fc);
+    pthread_mutex_unlock(&fc->lock);
+  }
+  HashSetDispose(&records);
+  return loaded;
+}
+
+typedef struct {
+  FILE *outfile;
+  bool written;
+} saveState;
+
+static void WriteRecord(void *elem, void *auxData)
+{
+  const feedRecord *record = elem;
+  saveState *state = auxData;
+  if (fprintf(state->outfile, "%d %s\n", record->count, record->feedURL) < 0) state->written = false;
+  for (int i = 0; i < record->count; i++)
+    if (fprintf(state->outfile, "%016" PRIx64 "\n", record->fingerprints[i]) < 0) state->written = false;
+}
+
+bool FeedCacheSave(feedcache *fc, const char *filename, int stamp)
+{
+  char tempFilename[strlen(filename) + 16];
+  sprintf(tempFilename, "%s.partial", filename);
+  FILE *outfile = fopen(tempFilename, "w");
+  if (outfile == NULL) return false;
+
+  saveState state = { outfile, fprintf(outfile, kFeedCacheHeader " %d\n", stamp) >= 0 };
+  pthread_mutex_lock(&fc->lock);
+  HashSetMap(&fc->feeds, WriteRecord, &state);
+  pthread_mutex_unlock(&fc->lock);
+  if (fclose(outfile) != 0) state.written = false;
+  if (state.written && rename(tempFilename, filename) == 0) return true;
+  remove(tempFilename);
+  return false;
+}
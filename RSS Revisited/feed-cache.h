@@ -0,0 +1,117 @@
+/**
+ * File: feed-cache.h
+ * ------------------
+ * Exports the feedcache type, which remembers which items each feed
+ * listed the last time it was crawled, so a re-crawl can pass over
+ * them without so much as parsing their URLs.  Items are recorded as
+ * fingerprints of their guids (or of their links, for items without
+ * one), and the whole cache can be saved to disk and loaded back in,
+ * so the memory outlives a single run.
+ *
+ * Each feed's record is replaced wholesale every time the feed is
+ * crawled, so it only ever holds the items the feed currently lists,
+ * and the cache stays about as large as the feeds themselves.
+ */
+
+#ifndef __feed_cache_
+#define __feed_cache_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "bool.h"
+#include "hashset.h"
+
+typedef struct {
+  hashset feeds;            // feedRecords, one per feed URL
+  pthread_mutex_t lock;
+} feedcache;
+
+/**
+ * Type: feeditems
+ * ---------------
+ * A private copy of the items a feed listed when it was last crawled.
+ */
+
+typedef struct {
+  uint64_t *fingerprints;   // sorted
+  int count;
+} feeditems;
+
+/**
+ * Function: FeedCacheNew
+ * ----------------------
+ * Initializes the cache to remember nothing at all.
+ */
+
+void FeedCacheNew(feedcache *fc);
+
+/**
+ * Function: FeedCacheDispose
+ * --------------------------
+ * Releases all resources held by the cache.
+ */
+
+void FeedCacheDispose(feedcache *fc);
+
+/**
+ * Function: FeedCacheLoad
+ * -----------------------
+ * Adds every record saved in the named file to the cache, provided the
+ * file was saved with the same stamp as the one supplied.  The stamp
+ * lets clients tie the cache to whatever else it was saved alongside,
+ * so that a cache outliving its index is never trusted.  Returns true
+ * if and only if the file was read in its entirety, and leaves the
+ * cache unchanged otherwise.
+ */
+
+bool FeedCacheLoad(feedcache *fc, const char *filename, int stamp);
+
+/**
+ * Function: FeedCacheSave
+ * -----------------------
+ * Writes every record to the named file, along with the stamp.  The
+ * file is written under a temporary name and renamed into place, so
+ * an existing cache is never left half-overwritten.  Returns true if
+ * and only if the file was saved.
+ */
+
+bool FeedCacheSave(feedcache *fc, const char *filename, int stamp);
+
+/**
+ * Function: FeedCacheRecall
+ * -------------------------
+ * Initializes items to the items recorded for the feed with the
+ * specified URL, or to no items at all if the feed hasn't been
+ * recorded.  The copy must be disposed of with FeedItemsDispose.
+ */
+
+void FeedCacheRecall(feedcache *fc, const char *feedURL, feeditems *items);
+
+/**
+ * Function: FeedCacheRemember
+ * ---------------------------
+ * Records that the feed with the specified URL lists exactly the
+ * count items with the given fingerprints, replacing whatever was
+ * recorded for it before.  The fingerprints are copied.
+ */
+
+void FeedCacheRemember(feedcache *fc, const char *feedURL, const uint64_t fingerprints[], int count);
+
+/**
+ * Function: FeedItemsContain
+ * --------------------------
+ * Returns true if and only if the item with the specified fingerprint
+ * is among items.
+ */
+
+bool FeedItemsContain(const feeditems *items, uint64_t fingerprint);
+
+/**
+ * Function: FeedItemsDispose
+ * --------------------------
+ * Releases the memory held by a copy made by FeedCacheRecall.
+ */
+
+void FeedItemsDispose(feeditems *items);
+
+#endif
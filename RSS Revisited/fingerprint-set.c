@@ -0,0 +1,87 @@
+#include "fingerprint-set.h"
+#include <stdlib.h>
+#include <ctype.h>
+#include <assert.h>
+
+static const uint64_t kFingerprintPrime = 1099511628211ULL; // 64-bit FNV-1a
+uint64_t Fingerprint(uint64_t seed, const char *data, int len)
+{
+  uint64_t fingerprint = seed;
+  for (int i = 0; i < len; i++) {
+    fingerprint ^= (unsigned char) tolower((unsigned char) data[i]);
+    fingerprint *= kFingerprintPrime;
+  }
+  return fingerprint;
+}
+
+// 0 marks an empty slot, so the one fingerprint that collides with it is nudged over
+static uint64_t StoredForm(uint64_t fingerprint)
+{
+  return fingerprint == 0 ? 1 : fingerprint;
+}
+
+static int FindSlot(const uint64_t *slots, int numSlots, uint64_t stored)
+{
+  int position = (stored ^ (stored >> 32)) & (numSlots - 1);
+  while (slots[position] != 0 && slots[position] != stored)
+    position = (position + 1) & (numSlots - 1);
+  return position;
+}
+
+static void AllocateSlots(fingerprintset *fs, int numSlots)
+{
+  fs->slots = calloc(numSlots, sizeof(uint64_t));
+  assert(fs->slots != NULL);
+  fs->numSlots = numSlots;
+}
+
+static void Rehash(fingerprintset *fs)
+{
+  uint64_t *oldSlots = fs->slots;
+  int oldNumSlots = fs->numSlots;
+  AllocateSlots(fs, 2 * oldNumSlots);
+  for (int i = 0; i < oldNumSlots; i++)
+    if (oldSlots[i] != 0)
+      fs->slots[FindSlot(fs->slots, fs->numSlots, oldSlots[i])] = oldSlots[i];
+  free(oldSlots);
+}
+
+void FingerprintSetNew(fingerprintset *fs, int expectedCount)
+{
+  assert(expectedCount > 0);
+  int numSlots = 16;
+  while (numSlots < 2 * expectedCount) numSlots *= 2;
+  AllocateSlots(fs, numSlots);
+  fs->count = 0;
+  pthread_mutex_init(&fs->lock, NULL);
+}
+
+void FingerprintSetDispose(fingerprintset *fs)
+{
+  pthread_mutex_destroy(&fs->lock);
+  free(fs->slots);
+}
+
+bool FingerprintSetClaim(fingerprintset *fs, const uint64_t fingerprints[], int numFingerprints)
+{
+  pthread_mutex_lock(&fs->lock);
+  for (int i = 0; i < numFingerprints; i++) {
+    uint64_t stored = StoredForm(fingerprints[i]);
+    if (fs->slots[FindSlot(fs->slots, fs->numSlots, stored)] == stored) {
+      pthread_mutex_unlock(&fs->lock);
+      return false;
+    }
+  }
+
+  for (int i = 0; i < numFingerprints; i++) {
+    if (2 * (fs->count + 1) > fs->numSlots) Rehash(fs); // keep the table at most half full
+    uint64_t stored = StoredForm(fingerprints[i]);
+    int position = FindSlot(fs->slots, fs->numSlots, stored);
+    if (fs->slots[position] == 0) { // the same fingerprint may appear twice in one claim
+      fs->slots[position] = stored;
+      fs->count++;
+    }
+  }
+  pthread_mutex_unlock(&fs->lock);
+  return true;
+}
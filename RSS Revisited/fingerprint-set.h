@@ -0,0 +1,66 @@
+/**
+ * File: fingerprint-set.h
+ * -----------------------
+ * Exports the fingerprintset type, a thread-safe set of 64-bit
+ * fingerprints.  It's used to remember which articles we've already
+ * claimed for indexing without holding on to (or comparing) the
+ * strings themselves.  Two different strings can in principle share a
+ * fingerprint, but with 64 bits the odds are negligible for the few
+ * thousand articles we see in a run.
+ */
+
+#ifndef __fingerprint_set_
+#define __fingerprint_set_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "bool.h"
+
+typedef struct {
+  uint64_t *slots;          // open addressing; 0 marks an empty slot
+  int numSlots;             // always a power of two
+  int count;
+  pthread_mutex_t lock;
+} fingerprintset;
+
+/**
+ * Function: FingerprintSetNew
+ * ---------------------------
+ * Initializes the set to be empty.  The table grows as needed, so
+ * expectedCount is only a hint and must merely be positive.
+ */
+
+void FingerprintSetNew(fingerprintset *fs, int expectedCount);
+
+/**
+ * Function: FingerprintSetDispose
+ * -------------------------------
+ * Releases all resources held by the set.
+ */
+
+void FingerprintSetDispose(fingerprintset *fs);
+
+/**
+ * Function: FingerprintSetClaim
+ * -----------------------------
+ * Atomically adds each of the numFingerprints fingerprints to the set,
+ * unless one or more of them is already present, in which case the set
+ * is left untouched.  Returns true if the fingerprints were added, and
+ * false otherwise.
+ */
+
+bool FingerprintSetClaim(fingerprintset *fs, const uint64_t fingerprints[], int numFingerprints);
+
+/**
+ * Function: Fingerprint
+ * ---------------------
+ * Computes the 64-bit, case-insensitive fingerprint of the len bytes
+ * at data, continuing from the fingerprint seed.  Chaining calls lets
+ * clients fingerprint several strings as one; pass kFingerprintSeed
+ * to begin a new fingerprint.
+ */
+
+static const uint64_t kFingerprintSeed = 14695981039346656037ULL;
+uint64_t Fingerprint(uint64_t seed, const char *data, int len);
+
+#endif
@@ -0,0 +1,181 @@
+#include "http-standin.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static const int kListenBacklog = 64;
+static const int kMaxRequestLength = 4096;
+static const char kResponse[] =
+  "HTTP/1.0 200 OK\r\n"
+  "Content-Type: text/html\r\n"
+  "\r\n"
+  "<html><head><title>Stand-in</title></head><body><p>Nothing new today.</p></body></html>\n";
+
+typedef struct {
+  standinServer *server;
+  int fd;
+} standinConnection;
+
+// Reads until the blank line that ends the request's headers, since that's all any request has.
+static void ReadRequest(int fd)
+{
+  char request[kMaxRequestLength + 1];
+  int length = 0;
+  while (length < kMaxRequestLength) {
+    ssize_t received = read(fd, request + length, kMaxRequestLength - length);
+    if (received == -1 && errno == EINTR) continue;
+    if (received <= 0) return;
+    length += received;
+    request[length] = '\0';
+    if (strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL) return;
+  }
+}
+
+static void WriteResponse(int fd)
+{
+  const char *text = kResponse;
+  size_t length = strlen(kResponse);
+  while (length > 0) {
+    ssize_t written = write(fd, text, length);
+    if (written == -1 && errno == EINTR) continue;
+    if (written <= 0) return;
+    text += written;
+    length -= written;
+  }
+}
+
+// The connection stops counting as open before it's closed, so a client that
+// reads to the end of the response can never see it close and still be counted.
+static void *AnswerConnection(void *arg)
+{
+  standinConnection *conn = arg;
+  httpstandin *hs = conn->server->owner;
+  ReadRequest(conn->fd);
+  struct timespec delay = { hs->delay / 1000, (hs->delay % 1000) * 1000000L };
+  nanosleep(&delay, NULL);
+  WriteResponse(conn->fd);
+
+  pthread_mutex_lock(&hs->lock);
+  conn->server->numActive--;
+  if (--hs->numActive == 0) pthread_cond_broadcast(&hs->allClosed);
+  pthread_mutex_unlock(&hs->lock);
+  close(conn->fd);
+  free(conn);
+  return NULL;
+}
+
+static void *AcceptConnections(void *arg)
+{
+  standinServer *server = arg;
+  httpstandin *hs = server->owner;
+  while (true) {
+    int fd = accept(server->listener, NULL, NULL);
+    if (fd == -1 && errno == EINTR) continue;
+    if (fd == -1) return NULL; // HTTPStandInStop shut the listener down
+
+    pthread_mutex_lock(&hs->lock);
+    if (++server->numActive > server->peakActive) server->peakActive = server->numActive;
+    if (++hs->numActive > hs->peakActive) hs->peakActive = hs->numActive;
+    pthread_mutex_unlock(&hs->lock);
+
+    standinConnection *conn = malloc(sizeof(standinConnection));
+    assert(conn != NULL);
+    conn->server = server;
+    conn->fd = fd;
+    pthread_t answerer;
+    pthread_create(&answerer, NULL, AnswerConnection, conn);
+    pthread_detach(answerer);
+  }
+}
+
+static int OpenListener(int server, int *port)
+{
+  struct sockaddr_in address;
+  socklen_t addressLength = sizeof(address);
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK + server);
+  address.sin_port = 0; // any unused port will do
+
+  int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listener == -1) return -1;
+  if (bind(listener, (struct sockaddr *) &address, sizeof(address)) == -1 ||
+      listen(listener, kListenBacklog) == -1 ||
+      getsockname(listener, (struct sockaddr *) &address, &addressLength) == -1) {
+    close(listener);
+    return -1;
+  }
+  *port = ntohs(address.sin_port);
+  return listener;
+}
+
+bool HTTPStandInStart(httpstandin *hs, int numServers, int delay)
+{
+  assert(numServers > 0 && numServers <= kMaxStandInServers && delay >= 0);
+  hs->numServers = 0;
+  hs->delay = delay;
+  hs->numActive = hs->peakActive = 0;
+  pthread_mutex_init(&hs->lock, NULL);
+  pthread_cond_init(&hs->allClosed, NULL);
+
+  for (int i = 0; i < numServers; i++) {
+    standinServer *server = &hs->servers[i];
+    server->owner = hs;
+    server->numActive = server->peakActive = 0;
+    server->listener = OpenListener(i, &server->port);
+    if (server->listener == -1) {
+      HTTPStandInStop(hs);
+      return false;
+    }
+    pthread_create(&server->acceptor, NULL, AcceptConnections, server);
+    hs->numServers++;
+  }
+  return true;
+}
+
+int HTTPStandInAddress(const httpstandin *hs, int server, char address[])
+{
+  assert(server >= 0 && server < hs->numServers);
+  sprintf(address, "127.0.0.%d", 1 + server);
+  return hs->servers[server].port;
+}
+
+int HTTPStandInPeakConnections(httpstandin *hs, int server)
+{
+  assert(server >= 0 && server < hs->numServers);
+  pthread_mutex_lock(&hs->lock);
+  int peak = hs->servers[server].peakActive;
+  pthread_mutex_unlock(&hs->lock);
+  return peak;
+}
+
+int HTTPStandInPeakTotal(httpstandin *hs)
+{
+  pthread_mutex_lock(&hs->lock);
+  int peak = hs->peakActive;
+  pthread_mutex_unlock(&hs->lock);
+  return peak;
+}
+
+void HTTPStandInStop(httpstandin *hs)
+{
+  for (int i = 0; i < hs->numServers; i++) {
+    shutdown(hs->servers[i].listener, SHUT_RDWR); // which wakes the acceptor
+    pthread_join(hs->servers[i].acceptor, NULL);
+    close(hs->servers[i].listener);
+  }
+
+  pthread_mutex_lock(&hs->lock);
+  while (hs->numActive > 0)
+    pthread_cond_wait(&hs->allClosed, &hs->lock);
+  pthread_mutex_unlock(&hs->lock);
+  pthread_cond_destroy(&hs->allClosed);
+  pthread_mutex_destroy(&hs->lock);
+}
@@ -0,0 +1,91 @@
+/**
+ * File: http-standin.h
+ * --------------------
+ * Exports the httpstandin type, a tiny local web server that stands in
+ * for the news servers we crawl, so that code which opens connections
+ * can be exercised without the network.  It plays several servers at
+ * once, each listening on its own loopback address (127.0.0.1, 127.0.0.2,
+ * and so on, all of which reach this machine), and it records the most
+ * connections ever open to each of them at the same time.
+ *
+ * Every request, whatever its path, is answered after a short delay
+ * with a small HTTP/1.0 document, and then the connection is closed.
+ * The delay is what lets connections pile up, so that a client that
+ * opens too many at once gets caught doing it.
+ */
+
+#ifndef __http_standin_
+#define __http_standin_
+
+#include <pthread.h>
+#include "bool.h"
+
+#define kMaxStandInServers 8
+
+typedef struct {
+  struct httpstandin *owner;
+  int listener;
+  int port;
+  int numActive;
+  int peakActive;
+  pthread_t acceptor;
+} standinServer;
+
+/**
+ * Type: httpstandin
+ * -----------------
+ * As with the vector and the hashset, the fields are exposed only
+ * because there's no easy way to hide them in C.
+ */
+
+typedef struct httpstandin {
+  standinServer servers[kMaxStandInServers];
+  int numServers;
+  int delay;                 // milliseconds to wait before answering each request
+  int numActive;             // connections open to all servers combined
+  int peakActive;
+  pthread_mutex_t lock;
+  pthread_cond_t allClosed;
+} httpstandin;
+
+/**
+ * Function: HTTPStandInStart
+ * --------------------------
+ * Starts numServers servers (no more than kMaxStandInServers), each on
+ * an unused port of its own loopback address, answering every request
+ * after delay milliseconds.  Returns false, with nothing left to stop,
+ * if any of them couldn't be started.
+ */
+
+bool HTTPStandInStart(httpstandin *hs, int numServers, int delay);
+
+/**
+ * Function: HTTPStandInAddress
+ * ----------------------------
+ * Writes the dotted address of the specified server (numbered from 0)
+ * into address, which must have room for 16 characters, and returns
+ * the port it listens on.
+ */
+
+int HTTPStandInAddress(const httpstandin *hs, int server, char address[]);
+
+/**
+ * Functions: HTTPStandInPeakConnections, HTTPStandInPeakTotal
+ * -----------------------------------------------------------
+ * Return the most connections ever open at once to the specified
+ * server, or to all the servers combined.
+ */
+
+int HTTPStandInPeakConnections(httpstandin *hs, int server);
+int HTTPStandInPeakTotal(httpstandin *hs);
+
+/**
+ * Function: HTTPStandInStop
+ * -------------------------
+ * Stops accepting connections, waits for every open one to be
+ * answered and closed, and releases all resources held by the stand-in.
+ */
+
+void HTTPStandInStop(httpstandin *hs);
+
+#endif
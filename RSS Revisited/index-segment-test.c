@@ -0,0 +1,328 @@
+#include "index-segment.h"
+#include "term-dictionary.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <assert.h>
+#include <unistd.h>
+
+/**
+ * Writes a small index segment, confirms that everything put into it comes
+ * back out, and then damages it every way it can think of: every bit of
+ * the file is flipped in turn, and the file is cut short at every length,
+ * and it's made to hold postings and words no segment should.
+ * IndexSegmentOpen has to either reject each damaged segment or hand back
+ * one that can be read from end to end without straying outside the file.
+ * Reading through everything it accepts is the real test; run it under a
+ * memory checker to catch the reads that stray without crashing.
+ */
+
+static const int kFirstArticleIndex = 1000;
+static const int kNumArticles = 80;     // enough for the densest term to need a skip
+static const int kNumTerms = 8;
+static const int kNormalization = 3;
+
+/**
+ * Function: BuildPostings
+ * -----------------------
+ * Fills in the postings for the specified term, which appears in every
+ * (term + 1)th article.  Even terms record their positions and odd ones
+ * don't, and every third posting counts title and description occurrences
+ * as well as body ones, so every kind of posting turns up in the segment.
+ */
+
+static void BuildPostings(postinglist *pl, int term)
+{
+  PostingListNew(pl);
+  for (int i = 0; i < kNumArticles; i += term + 1) {
+    int fieldFreqs[kNumPostingFields] = { 1 + i % 4, 0, 0 };
+    if (i % 3 == 0) {
+      fieldFreqs[kTitleField] = 1;
+      fieldFreqs[kDescriptionField] = i % 2;
+    }
+    int positions[8], numPositions = fieldFreqs[kBodyField] + fieldFreqs[kTitleField] + fieldFreqs[kDescriptionField];
+    for (int j = 0; j < numPositions; j++) positions[j] = 3 * j + i % 7;
+    PostingListAppend(pl, kFirstArticleIndex + i, fieldFreqs, (term % 2 == 0) ? positions : NULL);
+  }
+}
+
+static void WriteSegment(FILE *outfile, postinglist postings[])
+{
+  indexsegmentbuilder builder;
+  IndexSegmentBuilderNew(&builder, kFirstArticleIndex, kNormalization);
+  for (int i = 0; i < kNumArticles; i++) {
+    char title[32], server[32], url[64];
+    sprintf(title, "Story %d", i);
+    sprintf(server, "news%d.example.com", i % 3);
+    sprintf(url, "http://%s/%d.html", server, i);
+    IndexSegmentBuilderAddArticle(&builder, title, server, url, i, 2 * i, 3 * i);
+  }
+  for (int term = 0; term < kNumTerms; term++) {
+    char word[16];
+    sprintf(word, "word%d", term);
+    IndexSegmentBuilderAddTerm(&builder, word, &postings[term]);
+  }
+  assert(IndexSegmentBuilderWrite(&builder, outfile));
+  assert(fflush(outfile) == 0);
+  IndexSegmentBuilderDispose(&builder);
+}
+
+/**
+ * Function: ExpectSamePostings
+ * ----------------------------
+ * Asserts that the two lists hold the same postings, positions and all.
+ */
+
+static void ExpectSamePostings(const postinglist *pl, const postinglist *expected)
+{
+  postingiterator it, expectedIt;
+  PostingIteratorNew(&it, pl);
+  PostingIteratorNew(&expectedIt, expected);
+  while (PostingIteratorNext(&expectedIt)) {
+    assert(PostingIteratorNext(&it));
+    assert(it.articleIndex == expectedIt.articleIndex);
+    assert(memcmp(it.fieldFreqs, expectedIt.fieldFreqs, sizeof(it.fieldFreqs)) == 0);
+    int positions[8], expectedPositions[8];
+    bool hasPositions = PostingIteratorPositions(&it, positions);
+    assert(hasPositions == PostingIteratorPositions(&expectedIt, expectedPositions));
+    assert(!hasPositions || memcmp(positions, expectedPositions, it.freq * sizeof(int)) == 0);
+  }
+  assert(!PostingIteratorNext(&it));
+}
+
+static void TestRoundTrip(const char *filename, postinglist postings[])
+{
+  indexsegment seg;
+  assert(IndexSegmentOpen(&seg, filename));
+  assert(seg.header->firstArticleIndex == kFirstArticleIndex);
+  assert(seg.header->numArticles == kNumArticles && seg.header->numTerms == kNumTerms);
+  assert(seg.header->normalization == kNormalization);
+
+  for (int i = 0; i < kNumArticles; i++) {
+    const segmentArticle *article = &seg.articles[i];
+    char url[64];
+    sprintf(url, "http://news%d.example.com/%d.html", i % 3, i);
+    assert(strcmp(IndexSegmentString(&seg, article->fullURL), url) == 0);
+    assert(strncmp(IndexSegmentString(&seg, article->title), "Story ", strlen("Story ")) == 0);
+    assert(atoi(IndexSegmentString(&seg, article->title) + strlen("Story ")) == i);
+    assert(article->urlFingerprint == i && article->titleFingerprint == 2 * i && article->contentSignature == 3 * i);
+  }
+
+  for (int term = 0; term < kNumTerms; term++) {
+    char word[16];
+    sprintf(word, "word%d", term);
+    assert(strcmp(IndexSegmentString(&seg, seg.terms[term].word), word) == 0);
+    postinglist view;
+    IndexSegmentPostings(&seg, term, &view);
+    ExpectSamePostings(&view, &postings[term]);
+  }
+
+  IndexSegmentClose(&seg);
+  printf("A segment of %d articles and %d words came back just as it was written.\n", kNumArticles, kNumTerms);
+}
+
+/**
+ * Function: ReadEverything
+ * ------------------------
+ * Reads every string and decodes every posting of an open segment, both
+ * straight through and by skipping, as a search would.  The total it
+ * returns means nothing; it's added to checksum only so none of the
+ * reading can be optimized away.
+ */
+
+static volatile long checksum;
+static long ReadEverything(const indexsegment *seg)
+{
+  long total = 0;
+  for (uint32_t i = 0; i < seg->header->numArticles; i++) {
+    total += strlen(IndexSegmentString(seg, seg->articles[i].title));
+    total += strlen(IndexSegmentString(seg, seg->articles[i].server));
+    total += strlen(IndexSegmentString(seg, seg->articles[i].fullURL));
+  }
+
+  for (uint32_t term = 0; term < seg->header->numTerms; term++) {
+    total += strlen(IndexSegmentString(seg, seg->terms[term].word));
+    postinglist view;
+    IndexSegmentPostings(seg, term, &view);
+    postingiterator it;
+    PostingIteratorNew(&it, &view);
+    while (PostingIteratorNext(&it)) {
+      total += it.articleIndex + it.freq;
+      if (it.positions == NULL) continue;
+      int *positions = malloc(it.freq * sizeof(int));
+      assert(positions != NULL);
+      PostingIteratorPositions(&it, positions);
+      total += positions[it.freq - 1];
+      free(positions);
+    }
+
+    PostingIteratorNew(&it, &view);
+    for (int target = 0; PostingIteratorAdvanceTo(&it, target); target = it.articleIndex + 37)
+      total += it.articleIndex;
+  }
+  return total;
+}
+
+/**
+ * Function: IsStructural
+ * ----------------------
+ * Returns true if and only if the byte at the specified offset belongs to
+ * one of the counts, sizes or extents that say where everything else in
+ * the segment is.  Damage to any of those has to be caught.  Damage
+ * anywhere else, to a fingerprint, say, or the text of a title, or even
+ * to an offset that happens to land on another string, can leave a
+ * segment that's still perfectly well-formed.
+ */
+
+static bool IsStructural(long offset, uint32_t numTerms)
+{
+  if (offset >= offsetof(indexSegmentHeader, numArticles) &&
+      offset < offsetof(indexSegmentHeader, normalization)) return true;
+
+  long termsStart = sizeof(indexSegmentHeader) + kNumArticles * sizeof(segmentArticle);
+  if (offset < termsStart || offset >= termsStart + numTerms * sizeof(segmentTerm)) return false;
+  long field = (offset - termsStart) % sizeof(segmentTerm);
+  if (field >= offsetof(segmentTerm, firstSkip) && field < offsetof(segmentTerm, numSkips))
+    return false; // most terms have no skips, and so never look at where they'd start
+  return field >= offsetof(segmentTerm, count) && field < offsetof(segmentTerm, unused);
+}
+
+/**
+ * Function: TestCorruption
+ * ------------------------
+ * Flips every bit of the segment, one at a time, and confirms that each
+ * damaged segment is either rejected or safe to read, and that it's
+ * rejected whenever the damage is to its structure.
+ */
+
+static void TestCorruption(FILE *file, const char *filename, long size)
+{
+  int numRejected = 0, numAccepted = 0;
+  for (long offset = 0; offset < size; offset++) {
+    unsigned char original;
+    assert(pread(fileno(file), &original, 1, offset) == 1);
+    for (int bit = 0; bit < 8; bit++) {
+      unsigned char damaged = original ^ (1 << bit);
+      assert(pwrite(fileno(file), &damaged, 1, offset) == 1);
+      indexsegment seg;
+      if (IndexSegmentOpen(&seg, filename)) {
+        assert(!IsStructural(offset, kNumTerms));
+        checksum += ReadEverything(&seg);
+        IndexSegmentClose(&seg);
+        numAccepted++;
+      } else {
+        numRejected++;
+      }
+    }
+    assert(pwrite(fileno(file), &original, 1, offset) == 1);
+  }
+
+  printf("Of %d segments with a bit flipped, %d were rejected and the other %d read safely.\n",
+         numRejected + numAccepted, numRejected, numAccepted);
+}
+
+/**
+ * Function: TestEarlyPostings
+ * ---------------------------
+ * Moves the segment's first article id up by one, so that every term's
+ * first posting is for an article before the segment's first, and
+ * confirms the segment is rejected.  Each last posting is still in range,
+ * so only the first postings give it away.
+ */
+
+static void TestEarlyPostings(FILE *file, const char *filename)
+{
+  indexSegmentHeader header, damaged;
+  assert(pread(fileno(file), &header, sizeof(header), 0) == sizeof(header));
+  damaged = header;
+  damaged.firstArticleIndex++;
+  assert(pwrite(fileno(file), &damaged, sizeof(damaged), 0) == sizeof(damaged));
+  indexsegment seg;
+  assert(!IndexSegmentOpen(&seg, filename));
+  assert(pwrite(fileno(file), &header, sizeof(header), 0) == sizeof(header));
+  printf("A segment whose postings begin before its first article was rejected.\n");
+}
+
+static void TestTruncation(FILE *file, const char *filename, long size)
+{
+  indexsegment seg;
+  assert(ftruncate(fileno(file), size + 1) == 0);
+  assert(!IndexSegmentOpen(&seg, filename)); // a byte too many
+  for (long length = size - 1; length >= 0; length--) {
+    assert(ftruncate(fileno(file), length) == 0);
+    assert(!IndexSegmentOpen(&seg, filename));
+  }
+  printf("Every one of the %ld shortened segments was rejected.\n", size);
+}
+
+/**
+ * Function: TestLongWords
+ * -----------------------
+ * Rewrites the file as a one-article segment whose one word is as long as
+ * the term dictionary allows, and then one character longer, and confirms
+ * that only the first is accepted.
+ */
+
+static void TestLongWords(FILE *file, const char *filename)
+{
+  postinglist postings;
+  int fieldFreqs[kNumPostingFields] = { 1, 0, 0 };
+  PostingListNew(&postings);
+  PostingListAppend(&postings, kFirstArticleIndex, fieldFreqs, NULL);
+
+  for (int length = kMaxDictionaryTermLength; length <= kMaxDictionaryTermLength + 1; length++) {
+    char word[length + 1];
+    memset(word, 'w', length);
+    word[length] = '\0';
+    assert(ftruncate(fileno(file), 0) == 0);
+    rewind(file);
+    indexsegmentbuilder builder;
+    IndexSegmentBuilderNew(&builder, kFirstArticleIndex, kNormalization);
+    IndexSegmentBuilderAddArticle(&builder, "Story", "news.example.com", "http://news.example.com/", 1, 2, 3);
+    IndexSegmentBuilderAddTerm(&builder, word, &postings);
+    assert(IndexSegmentBuilderWrite(&builder, file));
+    assert(fflush(file) == 0);
+    IndexSegmentBuilderDispose(&builder);
+
+    indexsegment seg;
+    bool accepted = IndexSegmentOpen(&seg, filename);
+    assert(accepted == (length <= kMaxDictionaryTermLength));
+    if (accepted) IndexSegmentClose(&seg);
+  }
+
+  PostingListDispose(&postings);
+  printf("A word of %d characters was accepted, and one of %d rejected.\n",
+         kMaxDictionaryTermLength, kMaxDictionaryTermLength + 1);
+}
+
+int main(int ignored, char **alsoIgnored)
+{
+  char filename[] = "/tmp/index-segment-test-XXXXXX";
+  int fd = mkstemp(filename);
+  if (fd == -1) {
+    perror("Couldn't create a scratch segment");
+    return 1;
+  }
+  FILE *file = fdopen(fd, "w+");
+  assert(file != NULL);
+
+  postinglist postings[kNumTerms];
+  for (int term = 0; term < kNumTerms; term++)
+    BuildPostings(&postings[term], term);
+  WriteSegment(file, postings);
+  long size = ftell(file);
+
+  TestRoundTrip(filename, postings);
+  TestCorruption(file, filename, size);
+  TestEarlyPostings(file, filename);
+  TestTruncation(file, filename, size);
+  TestLongWords(file, filename);
+
+  for (int term = 0; term < kNumTerms; term++)
+    PostingListDispose(&postings[term]);
+  fclose(file);
+  unlink(filename);
+  printf("Every damaged segment was caught or read safely.\n");
+  return 0;
+}
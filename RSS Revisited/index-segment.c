@@ -0,0 +1,227 @@
+#include "index-segment.h"
+#include "term-dictionary.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static bool StringIsValid(const indexsegment *seg, uint32_t offset)
+{
+  return offset < seg->header->stringsSize;
+}
+
+// Every word goes into the dictionary of the snapshot that loads it, which only takes words so long.
+static bool WordIsValid(const indexsegment *seg, uint32_t offset)
+{
+  return StringIsValid(seg, offset) &&
+    strnlen(seg->strings + offset, kMaxDictionaryTermLength + 1) <= kMaxDictionaryTermLength;
+}
+
+static bool LayOutSections(indexsegment *seg)
+{
+  if (seg->size < sizeof(indexSegmentHeader)) return false;
+  const indexSegmentHeader *header = seg->base;
+  if (memcmp(header->magic, kIndexSegmentMagic, sizeof(header->magic)) != 0) return false;
+
+  uint64_t expectedSize = sizeof(indexSegmentHeader) +
+    (uint64_t) header->numArticles * sizeof(segmentArticle) +
+    (uint64_t) header->numTerms * sizeof(segmentTerm) +
+    (uint64_t) header->numSkips * sizeof(postingskip) +
+    header->postingsSize + header->stringsSize;
+  if (expectedSize != seg->size) return false;
+
+  seg->header = header;
+  seg->articles = (const segmentArticle *) (header + 1);
+  seg->terms = (const segmentTerm *) (seg->articles + header->numArticles);
+  seg->skips = (const postingskip *) (seg->terms + header->numTerms);
+  seg->postings = (const unsigned char *) (seg->skips + header->numSkips);
+  seg->strings = (const char *) (seg->postings + header->postingsSize);
+  if (header->stringsSize == 0 || seg->strings[header->stringsSize - 1] != '\0') return false;
+
+  for (uint32_t i = 0; i < header->numArticles; i++) {
+    const segmentArticle *article = &seg->articles[i];
+    if (!StringIsValid(seg, article->title) || !StringIsValid(seg, article->server) ||
+        !StringIsValid(seg, article->fullURL)) return false;
+  }
+
+  uint64_t endArticleIndex = (uint64_t) header->firstArticleIndex + header->numArticles;
+  if (endArticleIndex > INT_MAX) return false;
+  for (uint32_t i = 0; i < header->numTerms; i++) {
+    const segmentTerm *term = &seg->terms[i];
+    if (!WordIsValid(seg, term->word) || term->count == 0) return false;
+    if (term->lastArticleIndex < header->firstArticleIndex || term->lastArticleIndex >= endArticleIndex)
+      return false;
+    if ((uint64_t) term->firstSkip + term->numSkips > header->numSkips) return false;
+    if ((uint64_t) term->postingsOffset + term->postingsSize > header->postingsSize) return false;
+    if (term->count > INT_MAX || term->postingsSize > INT_MAX || term->numSkips > INT_MAX) return false;
+
+    postinglist postings; // every posting is decoded once here, so later reads can trust them
+    postingiterator it;
+    IndexSegmentPostings(seg, i, &postings);
+    if (!PostingListIsWellFormed(&postings)) return false;
+    PostingIteratorNew(&it, &postings); // well-formed postings increase, so only the first can come too early
+    if (!PostingIteratorNext(&it) || it.articleIndex < header->firstArticleIndex) return false;
+  }
+
+  return true;
+}
+
+bool IndexSegmentOpen(indexsegment *seg, const char *filename)
+{
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) return false;
+
+  struct stat info;
+  if (fstat(fd, &info) == -1 || info.st_size == 0) {
+    close(fd);
+    return false;
+  }
+
+  seg->size = info.st_size;
+  seg->base = mmap(NULL, seg->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // the mapping survives the close
+  if (seg->base == MAP_FAILED) return false;
+
+  if (!LayOutSections(seg)) {
+    munmap(seg->base, seg->size);
+    return false;
+  }
+
+  return true;
+}
+
+void IndexSegmentClose(indexsegment *seg)
+{
+  munmap(seg->base, seg->size);
+}
+
+const char *IndexSegmentString(const indexsegment *seg, uint32_t offset)
+{
+  assert(StringIsValid(seg, offset));
+  return seg->strings + offset;
+}
+
+void IndexSegmentPostings(const indexsegment *seg, int termIndex, postinglist *postings)
+{
+  assert(termIndex >= 0 && termIndex < seg->header->numTerms);
+  const segmentTerm *term = &seg->terms[termIndex];
+  PostingListView(postings, seg->postings + term->postingsOffset, term->postingsSize, term->count,
+                  term->lastArticleIndex, seg->skips + term->firstSkip, term->numSkips);
+}
+
+/**
+ * Every section of a segment under construction grows the way a vector does,
+ * doubling whenever it runs out of room.
+ */
+
+static const int kInitialAllocation = 64;
+static void *Reserve(void *elems, int *allocated, int needed, int elemSize)
+{
+  if (needed <= *allocated) return elems;
+  while (*allocated < needed)
+    *allocated = (*allocated == 0) ? kInitialAllocation : 2 * *allocated;
+  elems = realloc(elems, (size_t) *allocated * elemSize);
+  assert(elems != NULL);
+  return elems;
+}
+
+static uint32_t AddString(indexsegmentbuilder *builder, const char *str)
+{
+  int length = strlen(str) + 1;
+  builder->strings = Reserve(builder->strings, &builder->allocatedStrings,
+                             builder->stringsSize + length, sizeof(char));
+  memcpy(builder->strings + builder->stringsSize, str, length);
+  builder->stringsSize += length;
+  return builder->stringsSize - length;
+}
+
+void IndexSegmentBuilderNew(indexsegmentbuilder *builder, int firstArticleIndex, int normalization)
+{
+  memset(builder, 0, sizeof(indexsegmentbuilder));
+  builder->firstArticleIndex = firstArticleIndex;
+  builder->normalization = normalization;
+}
+
+void IndexSegmentBuilderDispose(indexsegmentbuilder *builder)
+{
+  free(builder->articles);
+  free(builder->terms);
+  free(builder->skips);
+  free(builder->postings);
+  free(builder->strings);
+}
+
+void IndexSegmentBuilderAddArticle(indexsegmentbuilder *builder, const char *title, const char *server,
+                                   const char *fullURL, uint64_t urlFingerprint, uint64_t titleFingerprint,
+                                   uint64_t contentSignature)
+{
+  builder->articles = Reserve(builder->articles, &builder->allocatedArticles,
+                              builder->numArticles + 1, sizeof(segmentArticle));
+  segmentArticle *article = &builder->articles[builder->numArticles++];
+  article->urlFingerprint = urlFingerprint;
+  article->titleFingerprint = titleFingerprint;
+  article->contentSignature = contentSignature;
+  article->title = AddString(builder, title);
+  article->server = AddString(builder, server);
+  article->fullURL = AddString(builder, fullURL);
+  article->unused = 0;
+}
+
+void IndexSegmentBuilderAddTerm(indexsegmentbuilder *builder, const char *word, const postinglist *postings)
+{
+  assert(!postings->isView && postings->count > 0);
+  assert(postings->lastArticleIndex < builder->firstArticleIndex + builder->numArticles);
+
+  builder->terms = Reserve(builder->terms, &builder->allocatedTerms,
+                           builder->numTerms + 1, sizeof(segmentTerm));
+  builder->skips = Reserve(builder->skips, &builder->allocatedSkips,
+                           builder->numSkips + postings->numSkips, sizeof(postingskip));
+  builder->postings = Reserve(builder->postings, &builder->allocatedPostings,
+                              builder->postingsSize + postings->numBytes, sizeof(unsigned char));
+
+  segmentTerm *term = &builder->terms[builder->numTerms++];
+  term->word = AddString(builder, word);
+  term->count = postings->count;
+  term->lastArticleIndex = postings->lastArticleIndex;
+  term->firstSkip = builder->numSkips;
+  term->numSkips = postings->numSkips;
+  term->postingsOffset = builder->postingsSize;
+  term->postingsSize = postings->numBytes;
+  term->unused = 0;
+
+  if (postings->numSkips > 0) // short lists have no skips at all, and maybe no array for them
+    memcpy(builder->skips + builder->numSkips, postings->skips, postings->numSkips * sizeof(postingskip));
+  builder->numSkips += postings->numSkips;
+  memcpy(builder->postings + builder->postingsSize, postings->bytes, postings->numBytes);
+  builder->postingsSize += postings->numBytes;
+}
+
+// An empty section may never have been allocated, so it isn't handed to fwrite at all.
+static bool WriteSection(const void *elems, int elemSize, int numElems, FILE *outfile)
+{
+  return numElems == 0 || fwrite(elems, elemSize, numElems, outfile) == numElems;
+}
+
+bool IndexSegmentBuilderWrite(const indexsegmentbuilder *builder, FILE *outfile)
+{
+  indexSegmentHeader header;
+  memcpy(header.magic, kIndexSegmentMagic, sizeof(header.magic));
+  header.firstArticleIndex = builder->firstArticleIndex;
+  header.numArticles = builder->numArticles;
+  header.numTerms = builder->numTerms;
+  header.numSkips = builder->numSkips;
+  header.postingsSize = builder->postingsSize;
+  header.stringsSize = builder->stringsSize;
+  header.normalization = builder->normalization;
+
+  return WriteSection(&header, sizeof(header), 1, outfile) &&
+    WriteSection(builder->articles, sizeof(segmentArticle), builder->numArticles, outfile) &&
+    WriteSection(builder->terms, sizeof(segmentTerm), builder->numTerms, outfile) &&
+    WriteSection(builder->skips, sizeof(postingskip), builder->numSkips, outfile) &&
+    WriteSection(builder->postings, 1, builder->postingsSize, outfile) &&
+    WriteSection(builder->strings, 1, builder->stringsSize, outfile);
+}
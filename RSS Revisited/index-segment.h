@@ -0,0 +1,195 @@
+/**
+ * File: index-segment.h
+ * ---------------------
+ * Defines the on-disk form of a slice of the inverted index, along
+ * with the functions needed to write one and to read one in place.
+ * Each run of rss-news-search saves the articles it indexed as a new
+ * segment, and the next run maps every saved segment back in at startup
+ * rather than downloading and scanning those articles all over again.
+ *
+ * A segment covers the numArticles articles whose ids run from
+ * firstArticleIndex up, and for every word in any of them, the postings
+ * for just those articles.  The postings are stored exactly as a
+ * postinglist encodes them in memory, so a segment's lists can be read
+ * through a view without ever being decoded or copied.  The file is laid
+ * out as follows:
+ *
+ *     header    indexSegmentHeader
+ *     articles  [numArticles]  segmentArticle
+ *     terms     [numTerms]     segmentTerm
+ *     skips     [numSkips]     postingskip, every term's skips back to back
+ *     postings  [postingsSize] every term's encoded postings back to back
+ *     strings   [stringsSize]  the null-terminated titles, servers, URLs and words
+ *
+ * Like thesaurus images, segments are meant to be written and read on the
+ * same kind of machine.
+ */
+
+#ifndef __index_segment_
+#define __index_segment_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "bool.h"
+#include "posting-list.h"
+
+#define kIndexSegmentMagic "RSG4"
+
+typedef struct {
+  char magic[4];
+  uint32_t firstArticleIndex;
+  uint32_t numArticles;
+  uint32_t numTerms;
+  uint32_t numSkips;
+  uint32_t postingsSize;
+  uint32_t stringsSize;
+  uint32_t normalization;    // the normalizationoptions its words were indexed under
+} indexSegmentHeader;
+
+typedef struct {
+  uint64_t urlFingerprint;   // as claimed in the fingerprintset of seen articles
+  uint64_t titleFingerprint;
+  uint64_t contentSignature; // its simhash, or 0 if it's too short to have one
+  uint32_t title;            // offsets into strings
+  uint32_t server;
+  uint32_t fullURL;
+  uint32_t unused;
+} segmentArticle;
+
+typedef struct {
+  uint32_t word;             // offset into strings
+  uint32_t count;
+  uint32_t lastArticleIndex;
+  uint32_t firstSkip;        // index into skips
+  uint32_t numSkips;
+  uint32_t postingsOffset;   // into postings
+  uint32_t postingsSize;
+  uint32_t unused;
+} segmentTerm;
+
+/**
+ * Type: indexsegment
+ * ------------------
+ * A read-only view of a segment mapped in from disk.
+ */
+
+typedef struct {
+  void *base;
+  size_t size;
+  const indexSegmentHeader *header;
+  const segmentArticle *articles;
+  const segmentTerm *terms;
+  const postingskip *skips;
+  const unsigned char *postings;
+  const char *strings;
+} indexsegment;
+
+/**
+ * Function: IndexSegmentOpen
+ * --------------------------
+ * Maps the named segment into memory.  Returns true if and only if
+ * the file could be opened, mapped, and confirmed to be a well-formed
+ * segment.  Nothing needs to be closed if false is returned.
+ */
+
+bool IndexSegmentOpen(indexsegment *seg, const char *filename);
+
+/**
+ * Function: IndexSegmentClose
+ * ---------------------------
+ * Unmaps the segment.  Any views of its postings become invalid.
+ */
+
+void IndexSegmentClose(indexsegment *seg);
+
+/**
+ * Function: IndexSegmentString
+ * ----------------------------
+ * Returns the string at the given offset into the segment's strings,
+ * as recorded in a segmentArticle or segmentTerm.
+ */
+
+const char *IndexSegmentString(const indexsegment *seg, uint32_t offset);
+
+/**
+ * Function: IndexSegmentPostings
+ * ------------------------------
+ * Initializes postings as a view of the postings of the specified term.
+ */
+
+void IndexSegmentPostings(const indexsegment *seg, int termIndex, postinglist *postings);
+
+/**
+ * Type: indexsegmentbuilder
+ * -------------------------
+ * Accumulates the articles and terms of a new segment, which is only
+ * laid out once it's written.
+ */
+
+typedef struct {
+  uint32_t firstArticleIndex;
+  uint32_t normalization;
+  int numArticles, allocatedArticles;
+  segmentArticle *articles;
+  int numTerms, allocatedTerms;
+  segmentTerm *terms;
+  int numSkips, allocatedSkips;
+  postingskip *skips;
+  int postingsSize, allocatedPostings;
+  unsigned char *postings;
+  int stringsSize, allocatedStrings;
+  char *strings;
+} indexsegmentbuilder;
+
+/**
+ * Function: IndexSegmentBuilderNew
+ * --------------------------------
+ * Initializes a builder for a segment whose first article has the
+ * specified id, and whose words were normalized under the specified
+ * normalizationoptions.  A segment can only be searched by a program
+ * that normalizes its queries the same way.
+ */
+
+void IndexSegmentBuilderNew(indexsegmentbuilder *builder, int firstArticleIndex, int normalization);
+
+/**
+ * Function: IndexSegmentBuilderDispose
+ * ------------------------------------
+ * Releases everything the builder has accumulated.
+ */
+
+void IndexSegmentBuilderDispose(indexsegmentbuilder *builder);
+
+/**
+ * Function: IndexSegmentBuilderAddArticle
+ * ---------------------------------------
+ * Appends an article to the segment.  Articles must be added in id order,
+ * starting with the segment's first article id.
+ */
+
+void IndexSegmentBuilderAddArticle(indexsegmentbuilder *builder, const char *title, const char *server,
+                                   const char *fullURL, uint64_t urlFingerprint, uint64_t titleFingerprint,
+                                   uint64_t contentSignature);
+
+/**
+ * Function: IndexSegmentBuilderAddTerm
+ * ------------------------------------
+ * Adds a word and its postings to the segment.  Every posting must be
+ * for one of the segment's articles, and the list must have been built
+ * from scratch with PostingListAppend rather than viewed.  The postings
+ * are copied, so the list can be disposed of right away.
+ */
+
+void IndexSegmentBuilderAddTerm(indexsegmentbuilder *builder, const char *word, const postinglist *postings);
+
+/**
+ * Function: IndexSegmentBuilderWrite
+ * ----------------------------------
+ * Writes the segment to outfile, and returns true if and only if every
+ * byte was written.
+ */
+
+bool IndexSegmentBuilderWrite(const indexsegmentbuilder *builder, FILE *outfile);
+
+#endif
@@ -0,0 +1,377 @@
+#include "posting-list.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/**
+ * Checks the postinglist against the most naive representation of the same
+ * postings there is: for every article, the word's frequency in each field,
+ * with all zeros meaning the article isn't in the list.  Random lists of
+ * every density are built both ways, then merged, intersected and advanced
+ * through, and every posting that comes out of the real thing is compared
+ * with the one the naive version says should.  Dense lists span many skip
+ * blocks and sparse ones only a few, so both the skipping and the decoding
+ * paths of PostingIteratorAdvanceTo get exercised.
+ *
+ * Lists that record positions are checked the same way, with the naive
+ * version also holding each posting's positions, or none at all.
+ */
+
+static const int kNumArticles = 20000;
+static const int kNumTrials = 200;
+static const int kMaxLists = 5;
+static const int kMaxPositions = 8;        // per posting, in lists that record them
+
+typedef int fieldfreqs[kNumPostingFields];
+
+/**
+ * Function: BuildList
+ * -------------------
+ * Chooses, at random, roughly one article in every density to hold the
+ * word, along with its frequency in each field, and records them both in
+ * freqs and in a new postinglist.  Most postings have only a body frequency,
+ * as most do in practice, but some carry title and description ones as well.
+ */
+
+static void BuildList(postinglist *pl, fieldfreqs freqs[], int density)
+{
+  PostingListNew(pl);
+  memset(freqs, 0, kNumArticles * sizeof(fieldfreqs));
+  for (int article = 0; article < kNumArticles; article++) {
+    if (rand() % density != 0) continue;
+    freqs[article][kBodyField] = rand() % 6;
+    if (rand() % 4 == 0) freqs[article][kTitleField] = rand() % 3;
+    if (rand() % 4 == 0) freqs[article][kDescriptionField] = 1 + rand() % 300;
+    if (freqs[article][kBodyField] + freqs[article][kTitleField] + freqs[article][kDescriptionField] == 0)
+      freqs[article][kBodyField] = 1;
+    PostingListAppend(pl, article, freqs[article], NULL);
+  }
+}
+
+static int ChooseDensity(void)
+{
+  switch (rand() % 4) {
+    case 0: return 1 + rand() % 3;
+    case 1: return 1 + rand() % 50;
+    case 2: return 1 + rand() % 1000;
+    default: return kNumArticles * 2; // usually empty
+  }
+}
+
+static bool IsPosting(const fieldfreqs freqs)
+{
+  return freqs[kBodyField] + freqs[kTitleField] + freqs[kDescriptionField] > 0;
+}
+
+/**
+ * Function: ExpectPostings
+ * ------------------------
+ * Asserts that iterating over the list yields exactly the postings recorded
+ * in expected, in article order, and that the list knows how many there are.
+ */
+
+static void ExpectPostings(const postinglist *pl, fieldfreqs expected[])
+{
+  postingiterator it;
+  PostingIteratorNew(&it, pl);
+  int count = 0;
+  for (int article = 0; article < kNumArticles; article++) {
+    if (!IsPosting(expected[article])) continue;
+    assert(PostingIteratorNext(&it));
+    assert(it.articleIndex == article);
+    int freq = 0;
+    for (int field = 0; field < kNumPostingFields; field++) {
+      assert(it.fieldFreqs[field] == expected[article][field]);
+      freq += expected[article][field];
+    }
+    assert(it.freq == freq);
+    count++;
+  }
+  assert(!PostingIteratorNext(&it));
+  assert(PostingListCount(pl) == count);
+}
+
+static void TestMerge(fieldfreqs *freqs[])
+{
+  postinglist first, second, merged;
+  BuildList(&first, freqs[0], ChooseDensity());
+  BuildList(&second, freqs[1], ChooseDensity());
+  PostingListMerge(&merged, &first, &second);
+
+  for (int article = 0; article < kNumArticles; article++)
+    for (int field = 0; field < kNumPostingFields; field++)
+      freqs[2][article][field] = freqs[0][article][field] + freqs[1][article][field];
+  ExpectPostings(&merged, freqs[2]);
+  ExpectPostings(&first, freqs[0]); // neither source is changed
+  ExpectPostings(&second, freqs[1]);
+
+  PostingListDispose(&first);
+  PostingListDispose(&second);
+  PostingListDispose(&merged);
+}
+
+static void TestIntersect(fieldfreqs *freqs[], fieldfreqs expected[])
+{
+  int numRequired = rand() % 4, numExcluded = rand() % 3;
+  postinglist lists[kMaxLists], result;
+  const postinglist *required[kMaxLists], *excluded[kMaxLists];
+  for (int i = 0; i < numRequired + numExcluded; i++) {
+    BuildList(&lists[i], freqs[i], ChooseDensity());
+    if (i < numRequired) required[i] = &lists[i];
+    else excluded[i - numRequired] = &lists[i];
+  }
+  PostingListIntersect(&result, required, numRequired, excluded, numExcluded);
+
+  memset(expected, 0, kNumArticles * sizeof(fieldfreqs));
+  for (int article = 0; article < kNumArticles && numRequired > 0; article++) {
+    bool matches = true;
+    for (int i = 0; i < numRequired + numExcluded; i++)
+      if (IsPosting(freqs[i][article]) != (i < numRequired)) matches = false;
+    if (!matches) continue;
+    for (int i = 0; i < numRequired; i++)
+      for (int field = 0; field < kNumPostingFields; field++)
+        expected[article][field] += freqs[i][article][field];
+  }
+  ExpectPostings(&result, expected);
+
+  for (int i = 0; i < numRequired + numExcluded; i++)
+    PostingListDispose(&lists[i]);
+  PostingListDispose(&result);
+}
+
+/**
+ * Function: ExpectAdvances
+ * ------------------------
+ * Advances an iterator over pl to a series of random, nondecreasing
+ * targets, some of them repeated and some past the end of the list, and
+ * asserts that it lands on the first article in freqs at or beyond each.
+ */
+
+static void ExpectAdvances(const postinglist *pl, fieldfreqs freqs[])
+{
+  postingiterator it;
+  PostingIteratorNew(&it, pl);
+  int target = 0;
+  while (true) {
+    int expected = -1;
+    for (int article = target; article < kNumArticles; article++)
+      if (IsPosting(freqs[article])) {
+        expected = article;
+        break;
+      }
+    bool found = PostingIteratorAdvanceTo(&it, target);
+    if (expected == -1) {
+      assert(!found);
+      return;
+    }
+    assert(found && it.articleIndex == expected);
+    for (int field = 0; field < kNumPostingFields; field++)
+      assert(it.fieldFreqs[field] == freqs[expected][field]);
+
+    switch (rand() % 4) {
+      case 0: target = expected; break; // mustn't move
+      case 1: target = expected + 1; break;
+      case 2: target = expected + rand() % 100; break;
+      default: target = expected + rand() % (kNumArticles / 4); break;
+    }
+  }
+}
+
+static void TestAdvanceTo(fieldfreqs *freqs[])
+{
+  postinglist pl, view;
+  BuildList(&pl, freqs[0], ChooseDensity());
+  ExpectAdvances(&pl, freqs[0]);
+
+  PostingListView(&view, pl.bytes, pl.numBytes, pl.count, pl.lastArticleIndex, pl.skips, pl.numSkips);
+  assert(PostingListIsWellFormed(&view));
+  ExpectAdvances(&view, freqs[0]);
+
+  PostingListDispose(&view);
+  PostingListDispose(&pl);
+}
+
+/**
+ * Type: positionedpostings
+ * ------------------------
+ * The naive form of a list whose postings may record positions: the
+ * frequencies of each article, as above, and, if hasPositions says it
+ * has any, its positions, kMaxPositions to an article.
+ */
+
+typedef struct {
+  fieldfreqs *freqs;
+  bool *hasPositions;
+  int *positions;
+} positionedpostings;
+
+static void PositionedPostingsNew(positionedpostings *pp)
+{
+  pp->freqs = malloc(kNumArticles * sizeof(fieldfreqs));
+  pp->hasPositions = malloc(kNumArticles * sizeof(bool));
+  pp->positions = malloc(kNumArticles * kMaxPositions * sizeof(int));
+  assert(pp->freqs != NULL && pp->hasPositions != NULL && pp->positions != NULL);
+}
+
+static void PositionedPostingsDispose(positionedpostings *pp)
+{
+  free(pp->freqs);
+  free(pp->hasPositions);
+  free(pp->positions);
+}
+
+/**
+ * Function: BuildPositionedList
+ * -----------------------------
+ * Like BuildList, except that if withPositions is true, every posting
+ * records a position for each occurrence.  Positions are drawn from a
+ * narrow range, so the same article in two lists will often have some
+ * position recorded in both, which merging has to notice.
+ */
+
+static void BuildPositionedList(postinglist *pl, positionedpostings *pp, int density, bool withPositions)
+{
+  PostingListNew(pl);
+  memset(pp->freqs, 0, kNumArticles * sizeof(fieldfreqs));
+  memset(pp->hasPositions, 0, kNumArticles * sizeof(bool));
+  for (int article = 0; article < kNumArticles; article++) {
+    if (rand() % density != 0) continue;
+    int numOccurrences = 1 + rand() % (kMaxPositions / 2);
+    int *positions = &pp->positions[article * kMaxPositions];
+    for (int i = 0; i < numOccurrences; i++) {
+      pp->freqs[article][(rand() % 3 == 0) ? kTitleField : kBodyField]++;
+      positions[i] = ((i == 0) ? -1 : positions[i - 1]) + 1 + rand() % 4;
+    }
+    pp->hasPositions[article] = withPositions;
+    PostingListAppend(pl, article, pp->freqs[article], withPositions ? positions : NULL);
+  }
+}
+
+static void ExpectPositionedPostings(const postinglist *pl, const positionedpostings *expected)
+{
+  ExpectPostings(pl, expected->freqs);
+  postingiterator it;
+  PostingIteratorNew(&it, pl);
+  while (PostingIteratorNext(&it)) {
+    int positions[kMaxPositions];
+    assert(PostingIteratorPositions(&it, positions) == expected->hasPositions[it.articleIndex]);
+    if (expected->hasPositions[it.articleIndex])
+      assert(memcmp(positions, &expected->positions[it.articleIndex * kMaxPositions], it.freq * sizeof(int)) == 0);
+  }
+}
+
+/**
+ * Function: MergePositions
+ * ------------------------
+ * Works out naively what merging the postings of one article from first
+ * and second should produce: the union of their positions if both have
+ * positions and no position is recorded by both, and no positions at all
+ * otherwise, since the frequencies would no longer match them.
+ */
+
+static void MergePositions(positionedpostings *merged, const positionedpostings *first,
+                           const positionedpostings *second, int article)
+{
+  const positionedpostings *sources[] = { first, second };
+  int numSources = 0, numOccurrences = 0;
+  merged->hasPositions[article] = true;
+  for (int i = 0; i < 2; i++) {
+    if (!IsPosting(sources[i]->freqs[article])) continue;
+    numSources++;
+    if (!sources[i]->hasPositions[article]) merged->hasPositions[article] = false;
+    for (int field = 0; field < kNumPostingFields; field++)
+      numOccurrences += sources[i]->freqs[article][field];
+  }
+  if (numSources == 0 || !merged->hasPositions[article]) {
+    merged->hasPositions[article] = false;
+    return;
+  }
+
+  int numRecordable = kMaxPositions * 4 + 1; // no position is any larger than this
+  bool isRecorded[numRecordable];
+  memset(isRecorded, 0, sizeof(isRecorded));
+  for (int i = 0; i < 2; i++) {
+    if (!IsPosting(sources[i]->freqs[article])) continue;
+    int freq = sources[i]->freqs[article][kBodyField] + sources[i]->freqs[article][kTitleField];
+    for (int j = 0; j < freq; j++) {
+      int position = sources[i]->positions[article * kMaxPositions + j];
+      if (isRecorded[position]) merged->hasPositions[article] = false;
+      isRecorded[position] = true;
+    }
+  }
+  int *positions = &merged->positions[article * kMaxPositions], numPositions = 0;
+  for (int position = 0; position < numRecordable && numPositions < numOccurrences; position++)
+    if (isRecorded[position]) positions[numPositions++] = position;
+}
+
+/**
+ * Function: TestPositions
+ * -----------------------
+ * Builds two lists with positions and one without, and confirms that the
+ * positions come back as they went in, from the lists themselves, from
+ * copies made by PostingListAppendFrom, and from views, and that merging
+ * any two of the lists unites or drops the positions as it should.
+ */
+
+static void TestPositions(positionedpostings pps[])
+{
+  postinglist lists[3];
+  for (int i = 0; i < 3; i++) {
+    BuildPositionedList(&lists[i], &pps[i], ChooseDensity(), i < 2);
+    ExpectPositionedPostings(&lists[i], &pps[i]);
+  }
+
+  postinglist copy, view;
+  postingiterator it;
+  PostingListNew(&copy);
+  PostingIteratorNew(&it, &lists[0]);
+  while (PostingIteratorNext(&it)) PostingListAppendFrom(&copy, &it);
+  ExpectPositionedPostings(&copy, &pps[0]);
+  PostingListView(&view, copy.bytes, copy.numBytes, copy.count, copy.lastArticleIndex, copy.skips, copy.numSkips);
+  assert(PostingListIsWellFormed(&view));
+  ExpectPositionedPostings(&view, &pps[0]);
+  PostingListDispose(&copy);
+
+  for (int second = 1; second < 3; second++) {
+    postinglist merged;
+    PostingListMerge(&merged, &lists[0], &lists[second]);
+    for (int article = 0; article < kNumArticles; article++) {
+      for (int field = 0; field < kNumPostingFields; field++)
+        pps[3].freqs[article][field] = pps[0].freqs[article][field] + pps[second].freqs[article][field];
+      MergePositions(&pps[3], &pps[0], &pps[second], article);
+    }
+    ExpectPositionedPostings(&merged, &pps[3]);
+    PostingListDispose(&merged);
+  }
+
+  for (int i = 0; i < 3; i++) PostingListDispose(&lists[i]);
+}
+
+int main(int ignored, char **alsoIgnored)
+{
+  fieldfreqs *freqs[kMaxLists], *expected = malloc(kNumArticles * sizeof(fieldfreqs));
+  assert(expected != NULL);
+  for (int i = 0; i < kMaxLists; i++) {
+    freqs[i] = malloc(kNumArticles * sizeof(fieldfreqs));
+    assert(freqs[i] != NULL);
+  }
+
+  positionedpostings pps[4];
+  for (int i = 0; i < 4; i++) PositionedPostingsNew(&pps[i]);
+
+  srand(107);
+  for (int trial = 0; trial < kNumTrials; trial++) {
+    TestMerge(freqs);
+    TestIntersect(freqs, expected);
+    TestAdvanceTo(freqs);
+    TestPositions(pps);
+  }
+  printf("Merged, intersected and advanced through %d sets of random lists, "
+         "and every posting matched, positions and all.\n", kNumTrials);
+
+  for (int i = 0; i < kMaxLists; i++) free(freqs[i]);
+  for (int i = 0; i < 4; i++) PositionedPostingsDispose(&pps[i]);
+  free(expected);
+  return 0;
+}
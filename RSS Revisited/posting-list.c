@@ -0,0 +1,437 @@
+#include "posting-list.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+static const int kInitialAllocation = 16;
+static const int kMaxVarintBytes = 5; // enough for any 32-bit value
+static const int kMaxPostingBytes = (1 + kNumPostingFields) * kMaxVarintBytes;
+static const int kPostingsPerSkip = 64;
+
+void PostingListNew(postinglist *pl)
+{
+  pl->bytes = NULL;
+  pl->numBytes = 0;
+  pl->allocatedBytes = 0;
+  pl->count = 0;
+  pl->lastArticleIndex = -1;
+  pl->skips = NULL;
+  pl->numSkips = 0;
+  pl->allocatedSkips = 0;
+  pl->isView = false;
+}
+
+void PostingListView(postinglist *pl, const unsigned char *bytes, int numBytes, int count,
+                     int lastArticleIndex, const postingskip *skips, int numSkips)
+{
+  pl->bytes = (unsigned char *) bytes; // never written through, since views can't be appended to
+  pl->numBytes = numBytes;
+  pl->allocatedBytes = numBytes;
+  pl->count = count;
+  pl->lastArticleIndex = lastArticleIndex;
+  pl->skips = (postingskip *) skips;
+  pl->numSkips = numSkips;
+  pl->allocatedSkips = numSkips;
+  pl->isView = true;
+}
+
+void PostingListCopy(postinglist *copy, const postinglist *pl)
+{
+  *copy = *pl;
+  if (pl->isView) return;
+
+  copy->bytes = NULL;
+  copy->allocatedBytes = pl->numBytes;
+  if (pl->numBytes > 0) {
+    copy->bytes = malloc(pl->numBytes);
+    assert(copy->bytes != NULL);
+    memcpy(copy->bytes, pl->bytes, pl->numBytes);
+  }
+
+  copy->skips = NULL;
+  copy->allocatedSkips = pl->numSkips;
+  if (pl->numSkips > 0) {
+    copy->skips = malloc(pl->numSkips * sizeof(postingskip));
+    assert(copy->skips != NULL);
+    memcpy(copy->skips, pl->skips, pl->numSkips * sizeof(postingskip));
+  }
+}
+
+void PostingListDispose(postinglist *pl)
+{
+  if (pl->isView) return;
+  free(pl->skips);
+  free(pl->bytes);
+}
+
+int PostingListCount(const postinglist *pl)
+{
+  return pl->count;
+}
+
+static void WriteVarint(postinglist *pl, unsigned int value)
+{
+  while (value >= 0x80) {
+    pl->bytes[pl->numBytes++] = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  pl->bytes[pl->numBytes++] = value;
+}
+
+static unsigned int ReadVarint(const unsigned char **cursor)
+{
+  unsigned int value = 0;
+  int shift = 0;
+  unsigned char byte;
+  do {
+    byte = *(*cursor)++;
+    value |= (unsigned int) (byte & 0x7f) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  return value;
+}
+
+// like ReadVarint, but refuses to read past end or to overflow
+static bool ReadCheckedVarint(const unsigned char **cursor, const unsigned char *end, unsigned int *value)
+{
+  *value = 0;
+  for (int shift = 0; shift < 7 * kMaxVarintBytes; shift += 7) {
+    if (*cursor == end) return false;
+    unsigned char byte = *(*cursor)++;
+    *value |= (unsigned int) (byte & 0x7f) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+// The head of a posting packs the body frequency together with two flag bits.
+static const unsigned int kHasOtherFields = 1;
+static const unsigned int kHasPositions = 2;
+static const int kHeadFlagBits = 2;
+
+static int VarintLength(unsigned int value)
+{
+  int length = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    length++;
+  }
+  return length;
+}
+
+// Checks a posting's position block, which must decode to exactly count increasing positions.
+static bool PositionsAreWellFormed(const unsigned char *cursor, const unsigned char *end, long count)
+{
+  long position = -1;
+  for (long i = 0; i < count; i++) {
+    unsigned int gap;
+    if (!ReadCheckedVarint(&cursor, end, &gap)) return false;
+    position += (long) gap + 1;
+    if (position > INT_MAX) return false;
+  }
+  return cursor == end;
+}
+
+bool PostingListIsWellFormed(const postinglist *pl)
+{
+  const unsigned char *cursor = pl->bytes, *end = pl->bytes + pl->numBytes;
+  long articleIndex = -1;
+  int count = 0, numSkips = 0;
+  while (cursor < end) {
+    if (count > 0 && count % kPostingsPerSkip == 0) {
+      if (numSkips == pl->numSkips || pl->skips[numSkips].lastArticleIndex != articleIndex ||
+          pl->skips[numSkips].offset != cursor - pl->bytes) return false;
+      numSkips++;
+    }
+
+    unsigned int gap, head, freq, positionsSize;
+    if (!ReadCheckedVarint(&cursor, end, &gap) || !ReadCheckedVarint(&cursor, end, &head)) return false;
+    long total = head >> kHeadFlagBits;
+    if (head & kHasOtherFields) {
+      for (int field = kBodyField + 1; field < kNumPostingFields; field++) {
+        if (!ReadCheckedVarint(&cursor, end, &freq)) return false;
+        total += freq;
+      }
+    }
+    articleIndex += (long) gap + 1;
+    if (articleIndex > INT_MAX || total == 0 || total > INT_MAX) return false;
+    if (head & kHasPositions) {
+      if (!ReadCheckedVarint(&cursor, end, &positionsSize) || positionsSize > end - cursor) return false;
+      if (!PositionsAreWellFormed(cursor, cursor + positionsSize, total)) return false;
+      cursor += positionsSize;
+    }
+    count++;
+  }
+
+  return count == pl->count && numSkips == pl->numSkips && articleIndex == pl->lastArticleIndex;
+}
+
+/**
+ * Begins a posting, recording a skip first if one's due, and makes sure there's
+ * room for the posting's head and fields along with extraBytes more.
+ */
+
+static void StartPosting(postinglist *pl, int articleIndex, int extraBytes)
+{
+  assert(!pl->isView);
+  assert(articleIndex > pl->lastArticleIndex);
+  if (pl->count > 0 && pl->count % kPostingsPerSkip == 0) {
+    if (pl->numSkips == pl->allocatedSkips) {
+      pl->allocatedSkips = pl->allocatedSkips == 0 ? kInitialAllocation : 2 * pl->allocatedSkips;
+      pl->skips = realloc(pl->skips, pl->allocatedSkips * sizeof(postingskip));
+      assert(pl->skips != NULL);
+    }
+    postingskip skip = { pl->lastArticleIndex, pl->numBytes };
+    pl->skips[pl->numSkips++] = skip;
+  }
+
+  if (pl->numBytes + kMaxPostingBytes + extraBytes > pl->allocatedBytes) {
+    if (pl->allocatedBytes == 0) pl->allocatedBytes = kInitialAllocation;
+    while (pl->numBytes + kMaxPostingBytes + extraBytes > pl->allocatedBytes) pl->allocatedBytes *= 2;
+    pl->bytes = realloc(pl->bytes, pl->allocatedBytes);
+    assert(pl->bytes != NULL);
+  }
+}
+
+// Writes everything up to the position block, then counts the posting as appended.
+static void WritePosting(postinglist *pl, int articleIndex, const int fieldFreqs[], bool hasPositions)
+{
+  unsigned int flags = hasPositions ? kHasPositions : 0;
+  int total = fieldFreqs[kBodyField];
+  for (int field = kBodyField + 1; field < kNumPostingFields; field++) {
+    assert(fieldFreqs[field] >= 0);
+    if (fieldFreqs[field] > 0) flags |= kHasOtherFields;
+    total += fieldFreqs[field];
+  }
+  assert(fieldFreqs[kBodyField] >= 0 && fieldFreqs[kBodyField] <= (INT_MAX >> kHeadFlagBits) && total > 0);
+
+  WriteVarint(pl, articleIndex - pl->lastArticleIndex - 1); // gaps start at zero
+  WriteVarint(pl, ((unsigned int) fieldFreqs[kBodyField] << kHeadFlagBits) | flags);
+  if (flags & kHasOtherFields)
+    for (int field = kBodyField + 1; field < kNumPostingFields; field++)
+      WriteVarint(pl, fieldFreqs[field]);
+  pl->lastArticleIndex = articleIndex;
+  pl->count++;
+}
+
+// Positions are written as gaps too, each from the one before, or from -1 for the first.
+void PostingListAppend(postinglist *pl, int articleIndex, const int fieldFreqs[], const int positions[])
+{
+  int total = 0, positionsSize = 0;
+  for (int field = 0; field < kNumPostingFields; field++) total += fieldFreqs[field];
+  for (int i = 0; positions != NULL && i < total; i++) {
+    assert(positions[i] > ((i == 0) ? -1 : positions[i - 1]));
+    positionsSize += VarintLength(positions[i] - ((i == 0) ? -1 : positions[i - 1]) - 1);
+  }
+
+  StartPosting(pl, articleIndex, (positions == NULL) ? 0 : kMaxVarintBytes + positionsSize);
+  WritePosting(pl, articleIndex, fieldFreqs, positions != NULL);
+  if (positions == NULL) return;
+  WriteVarint(pl, positionsSize);
+  for (int i = 0; i < total; i++)
+    WriteVarint(pl, positions[i] - ((i == 0) ? -1 : positions[i - 1]) - 1);
+}
+
+void PostingListAppendFrom(postinglist *pl, const postingiterator *it)
+{
+  StartPosting(pl, it->articleIndex, (it->positions == NULL) ? 0 : kMaxVarintBytes + it->positionsSize);
+  WritePosting(pl, it->articleIndex, it->fieldFreqs, it->positions != NULL);
+  if (it->positions == NULL) return;
+  WriteVarint(pl, it->positionsSize);
+  memcpy(pl->bytes + pl->numBytes, it->positions, it->positionsSize);
+  pl->numBytes += it->positionsSize;
+}
+
+static void AddFieldFreqs(int sums[], const int fieldFreqs[])
+{
+  for (int field = 0; field < kNumPostingFields; field++) sums[field] += fieldFreqs[field];
+}
+
+// Combines two postings for the same article, keeping positions only if both have them.
+static void AppendCombined(postinglist *pl, const postingiterator *it1, const postingiterator *it2)
+{
+  int fieldFreqs[kNumPostingFields] = {0};
+  AddFieldFreqs(fieldFreqs, it1->fieldFreqs);
+  AddFieldFreqs(fieldFreqs, it2->fieldFreqs);
+  if (it1->positions == NULL || it2->positions == NULL) {
+    PostingListAppend(pl, it1->articleIndex, fieldFreqs, NULL);
+    return;
+  }
+
+  int *positions1 = malloc((it1->freq + it2->freq) * sizeof(int) * 2);
+  assert(positions1 != NULL);
+  int *positions2 = positions1 + it1->freq, *merged = positions2 + it2->freq;
+  PostingIteratorPositions(it1, positions1);
+  PostingIteratorPositions(it2, positions2);
+  int i = 0, j = 0, n = 0;
+  while (i < it1->freq || j < it2->freq) {
+    if (j == it2->freq || (i < it1->freq && positions1[i] < positions2[j])) merged[n++] = positions1[i++];
+    else if (i == it1->freq || positions2[j] < positions1[i]) merged[n++] = positions2[j++];
+    else { // the same occurrence, recorded twice
+      merged[n++] = positions1[i++];
+      j++;
+    }
+  }
+  if (n == it1->freq + it2->freq) PostingListAppend(pl, it1->articleIndex, fieldFreqs, merged);
+  else PostingListAppend(pl, it1->articleIndex, fieldFreqs, NULL); // the counts no longer line up
+  free(positions1);
+}
+
+void PostingListMerge(postinglist *merged, const postinglist *first, const postinglist *second)
+{
+  postingiterator it1, it2;
+  PostingIteratorNew(&it1, first);
+  PostingIteratorNew(&it2, second);
+  bool more1 = PostingIteratorNext(&it1);
+  bool more2 = PostingIteratorNext(&it2);
+
+  PostingListNew(merged);
+  while (more1 || more2) {
+    if (more1 && more2 && it1.articleIndex == it2.articleIndex) {
+      AppendCombined(merged, &it1, &it2);
+      more1 = PostingIteratorNext(&it1);
+      more2 = PostingIteratorNext(&it2);
+    } else if (more1 && (!more2 || it1.articleIndex < it2.articleIndex)) {
+      PostingListAppendFrom(merged, &it1);
+      more1 = PostingIteratorNext(&it1);
+    } else {
+      PostingListAppendFrom(merged, &it2);
+      more2 = PostingIteratorNext(&it2);
+    }
+  }
+}
+
+static int ShorterListFirst(const void *elem1, const void *elem2)
+{
+  const postinglist *pl1 = *(const postinglist **) elem1;
+  const postinglist *pl2 = *(const postinglist **) elem2;
+  return pl1->count - pl2->count;
+}
+
+static bool IsExcluded(postingiterator excluded[], int numExcluded, int articleIndex)
+{
+  for (int i = 0; i < numExcluded; i++)
+    if (PostingIteratorAdvanceTo(&excluded[i], articleIndex) && excluded[i].articleIndex == articleIndex)
+      return true;
+  return false;
+}
+
+void PostingListIntersect(postinglist *result, const postinglist *required[], int numRequired,
+                          const postinglist *excluded[], int numExcluded)
+{
+  PostingListNew(result);
+  if (numRequired == 0) return;
+
+  const postinglist *lists[numRequired];
+  memcpy(lists, required, sizeof(lists));
+  qsort(lists, numRequired, sizeof(lists[0]), ShorterListFirst);
+
+  postingiterator requiredIts[numRequired], excludedIts[numExcluded + 1];
+  for (int i = 0; i < numRequired; i++) PostingIteratorNew(&requiredIts[i], lists[i]);
+  for (int i = 0; i < numExcluded; i++) PostingIteratorNew(&excludedIts[i], excluded[i]);
+
+  // the shortest list proposes a candidate, and each longer list either confirms
+  // it or leapfrogs it with a larger one, which the shortest list then chases
+  int target = 0;
+  while (PostingIteratorAdvanceTo(&requiredIts[0], target)) {
+    target = requiredIts[0].articleIndex;
+    int i;
+    for (i = 1; i < numRequired; i++) {
+      if (!PostingIteratorAdvanceTo(&requiredIts[i], target)) return;
+      if (requiredIts[i].articleIndex != target) break;
+    }
+
+    if (i < numRequired) {
+      target = requiredIts[i].articleIndex;
+      continue;
+    }
+
+    if (!IsExcluded(excludedIts, numExcluded, target)) {
+      int fieldFreqs[kNumPostingFields] = {0};
+      for (i = 0; i < numRequired; i++) AddFieldFreqs(fieldFreqs, requiredIts[i].fieldFreqs);
+      PostingListAppend(result, target, fieldFreqs, NULL);
+    }
+    target++;
+  }
+}
+
+void PostingIteratorNew(postingiterator *it, const postinglist *pl)
+{
+  it->pl = pl;
+  it->nextSkip = 0;
+  it->cursor = pl->bytes;
+  it->end = pl->bytes + pl->numBytes;
+  it->articleIndex = -1;
+  it->freq = 0;
+  memset(it->fieldFreqs, 0, sizeof(it->fieldFreqs));
+  it->positions = NULL;
+  it->positionsSize = 0;
+}
+
+bool PostingIteratorNext(postingiterator *it)
+{
+  if (it->cursor == it->end) return false;
+  it->articleIndex += ReadVarint(&it->cursor) + 1;
+  unsigned int head = ReadVarint(&it->cursor);
+  it->fieldFreqs[kBodyField] = it->freq = head >> kHeadFlagBits;
+  for (int field = kBodyField + 1; field < kNumPostingFields; field++) {
+    it->fieldFreqs[field] = (head & kHasOtherFields) ? ReadVarint(&it->cursor) : 0;
+    it->freq += it->fieldFreqs[field];
+  }
+
+  it->positions = NULL; // skipped over, and only decoded if PostingIteratorPositions asks
+  it->positionsSize = 0;
+  if (head & kHasPositions) {
+    it->positionsSize = ReadVarint(&it->cursor);
+    it->positions = it->cursor;
+    it->cursor += it->positionsSize;
+  }
+  return true;
+}
+
+bool PostingIteratorPositions(const postingiterator *it, int positions[])
+{
+  if (it->positions == NULL) return false;
+  const unsigned char *cursor = it->positions;
+  int position = -1;
+  for (int i = 0; i < it->freq; i++) {
+    position += ReadVarint(&cursor) + 1;
+    positions[i] = position;
+  }
+  return true;
+}
+
+bool PostingIteratorAdvanceTo(postingiterator *it, int target)
+{
+  if (it->articleIndex >= target) return true;
+
+  const postingskip *skips = it->pl->skips;
+  int numSkips = it->pl->numSkips;
+  int offset = it->cursor - it->pl->bytes;
+  while (it->nextSkip < numSkips && skips[it->nextSkip].offset <= offset) it->nextSkip++;
+
+  // gallop to bracket the last skip that begins short of target, then binary search for it
+  int low = it->nextSkip;
+  if (low < numSkips && skips[low].lastArticleIndex < target) {
+    int step = 1;
+    while (low + step < numSkips && skips[low + step].lastArticleIndex < target) {
+      low += step;
+      step *= 2;
+    }
+    int high = (low + step < numSkips ? low + step : numSkips) - 1;
+    while (low < high) {
+      int mid = (low + high + 1) / 2;
+      if (skips[mid].lastArticleIndex < target) low = mid;
+      else high = mid - 1;
+    }
+
+    it->cursor = it->pl->bytes + skips[low].offset;
+    it->articleIndex = skips[low].lastArticleIndex;
+    it->nextSkip = low + 1;
+  }
+
+  while (it->articleIndex < target)
+    if (!PostingIteratorNext(it)) return false;
+  return true;
+}
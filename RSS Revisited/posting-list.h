@@ -0,0 +1,224 @@
+/**
+ * File: posting-list.h
+ * --------------------
+ * Exports the postinglist type, a compact record of the articles a word
+ * appears in and how often it appears in each part of each.  Postings must
+ * be appended in increasing article order, which lets each one be stored as
+ * the gap from its predecessor.  Gaps and frequencies are both small, so each
+ * is written as a variable-length integer, seven bits to the byte.  Most
+ * words turn up only in an article's body, and a posting like that is stored
+ * as just its gap and its body frequency, with a spare bit flagging the
+ * postings that go on to record their title and description frequencies, so
+ * a typical posting still fits in two or three bytes rather than eight.
+ *
+ * A posting can also record the position of every occurrence, which is what
+ * phrase and proximity queries need.  Positions are written gap-coded after
+ * the frequencies, preceded by their length in bytes, so iterators that don't
+ * care about positions can hop right over them.  A second flag bit says
+ * whether a posting has them, so lists built with and without positions can
+ * be merged freely.
+ *
+ * Postings are read back in order through a postingiterator.  Every
+ * kPostingsPerSkip postings, the list also records where the next block
+ * starts, so an iterator can leap over whole blocks when it's asked to
+ * advance to a given article, as it is when intersecting lists.
+ */
+
+#ifndef __posting_list_
+#define __posting_list_
+
+#include "bool.h"
+
+/**
+ * Type: postingfield
+ * ------------------
+ * The parts of an article a word's occurrences are counted in separately.
+ * The title and description are those the article's feed lists for it.
+ */
+
+typedef enum {
+  kBodyField,
+  kTitleField,
+  kDescriptionField,
+  kNumPostingFields
+} postingfield;
+
+typedef struct {
+  int lastArticleIndex;     // of the posting just before the block
+  int offset;               // of the block's first byte
+} postingskip;
+
+typedef struct {
+  unsigned char *bytes;
+  int numBytes;
+  int allocatedBytes;
+  int count;                // number of postings
+  int lastArticleIndex;     // -1 until the first posting is appended
+  postingskip *skips;
+  int numSkips;
+  int allocatedSkips;
+  bool isView;              // true if bytes and skips belong to someone else
+} postinglist;
+
+typedef struct {
+  const postinglist *pl;
+  int nextSkip;             // first skip that might still lie ahead of cursor
+  const unsigned char *cursor;
+  const unsigned char *end;
+  int articleIndex;         // the posting most recently decoded by PostingIteratorNext
+  int freq;                 // total of fieldFreqs
+  int fieldFreqs[kNumPostingFields];
+  const unsigned char *positions; // the posting's encoded positions, or NULL if it has none
+  int positionsSize;
+} postingiterator;
+
+/**
+ * Function: PostingListNew
+ * ------------------------
+ * Initializes the list to be empty.
+ */
+
+void PostingListNew(postinglist *pl);
+
+/**
+ * Function: PostingListView
+ * -------------------------
+ * Initializes the list to read postings already encoded elsewhere, as
+ * they are in a saved index segment.  The bytes and skips are the
+ * contents of some other list's fields of the same names, and must
+ * outlive the view.  Views can be read, iterated and merged like any
+ * other list, but they can't be appended to.
+ */
+
+void PostingListView(postinglist *pl, const unsigned char *bytes, int numBytes, int count,
+                     int lastArticleIndex, const postingskip *skips, int numSkips);
+
+/**
+ * Function: PostingListCopy
+ * -------------------------
+ * Initializes copy to hold the same postings as pl.  A copy of a view
+ * is just another view of the same memory; any other list is copied
+ * outright, so the two can be disposed of independently.
+ */
+
+void PostingListCopy(postinglist *copy, const postinglist *pl);
+
+/**
+ * Function: PostingListIsWellFormed
+ * ---------------------------------
+ * Returns true if and only if the list's bytes decode to exactly count
+ * postings in increasing article order, ending with lastArticleIndex,
+ * and every skip lands on the block boundary it claims to.  Meant for
+ * vetting views of postings read from disk before trusting them.
+ */
+
+bool PostingListIsWellFormed(const postinglist *pl);
+
+/**
+ * Function: PostingListDispose
+ * ----------------------------
+ * Releases the memory held by the list.  Disposing of a view releases
+ * nothing, since a view holds no memory of its own.
+ */
+
+void PostingListDispose(postinglist *pl);
+
+/**
+ * Function: PostingListCount
+ * --------------------------
+ * Returns the number of postings in the list.
+ */
+
+int PostingListCount(const postinglist *pl);
+
+/**
+ * Function: PostingListAppend
+ * ---------------------------
+ * Records that the word occurs fieldFreqs[field] times in each field of
+ * the article with the given index.  If positions is non-NULL, it holds
+ * the position of every one of those occurrences, in increasing order.
+ * An assert is raised unless articleIndex is larger than that of every
+ * posting already in the list, no frequency is negative, at least one is
+ * positive, and the positions, if any, strictly increase.
+ */
+
+void PostingListAppend(postinglist *pl, int articleIndex, const int fieldFreqs[], const int positions[]);
+
+/**
+ * Function: PostingListAppendFrom
+ * -------------------------------
+ * Appends a copy of the posting the iterator last decoded, positions and
+ * all, without decoding them.  The usual ordering rules apply.
+ */
+
+void PostingListAppendFrom(postinglist *pl, const postingiterator *it);
+
+/**
+ * Function: PostingListMerge
+ * --------------------------
+ * Initializes merged to hold every posting in either first or second,
+ * in article order.  An article appearing in both gets a single posting
+ * whose frequencies are the sums of the two, field by field, and whose
+ * positions are the union of the two, provided both have them.  Neither
+ * source list is changed.
+ */
+
+void PostingListMerge(postinglist *merged, const postinglist *first, const postinglist *second);
+
+/**
+ * Function: PostingListIntersect
+ * ------------------------------
+ * Initializes result to hold a posting for each article that appears in
+ * every one of the numRequired required lists and in none of the
+ * numExcluded excluded ones.  Each frequency is the sum of the article's
+ * frequencies in that field across the required lists, and no posting
+ * records positions.  Lists are intersected
+ * shortest first, and the longer ones are only ever probed by
+ * PostingIteratorAdvanceTo, so the cost is governed by the shortest
+ * list rather than the longest.  If numRequired is zero, result is empty.
+ */
+
+void PostingListIntersect(postinglist *result, const postinglist *required[], int numRequired,
+                          const postinglist *excluded[], int numExcluded);
+
+/**
+ * Function: PostingIteratorNew
+ * ----------------------------
+ * Positions the iterator before the first posting in the list.  The
+ * list mustn't change while the iterator is in use.
+ */
+
+void PostingIteratorNew(postingiterator *it, const postinglist *pl);
+
+/**
+ * Function: PostingIteratorNext
+ * -----------------------------
+ * Decodes the next posting into the iterator's articleIndex, freq and
+ * fieldFreqs fields and returns true, or returns false if there are no more.
+ */
+
+bool PostingIteratorNext(postingiterator *it);
+
+/**
+ * Function: PostingIteratorPositions
+ * ----------------------------------
+ * Decodes the positions of the posting the iterator last decoded into
+ * positions, which must have room for freq of them, and returns true, or
+ * returns false if the posting records no positions.
+ */
+
+bool PostingIteratorPositions(const postingiterator *it, int positions[]);
+
+/**
+ * Function: PostingIteratorAdvanceTo
+ * ----------------------------------
+ * Moves the iterator forward to the first posting whose article index
+ * is at least target and returns true, or returns false if there is no
+ * such posting.  The iterator doesn't move if it's already there.  Skips
+ * are searched by galloping, so the cost is logarithmic in the distance
+ * travelled plus at most one block's worth of decoding.
+ */
+
+bool PostingIteratorAdvanceTo(postingiterator *it, int target);
+
+#endif
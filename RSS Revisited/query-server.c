@@ -0,0 +1,253 @@
+#define _GNU_SOURCE // for accept4
+#include "query-server.h"
+#include "thread-pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/**
+ * Every connection is registered with EPOLLONESHOT, so once it's reported
+ * readable, no one else hears about it until whoever is responsible for it
+ * rearms it.  The event loop reads whatever has arrived, and if that
+ * completes a request, it hands the whole connection to a worker, which
+ * answers every complete request in the buffer before rearming it.  So at
+ * most one thread ever touches a connection at a time, no locks are needed,
+ * and pipelined requests are answered in order.  Connections are only ever
+ * freed by the event loop, which keeps them on a list so any still open at
+ * shutdown can be closed.
+ *
+ * Connections are non-blocking, so a spurious wakeup can't stall the event
+ * loop in a read or a write, and a client that stops reading its replies costs a worker
+ * no more than kSendTimeout milliseconds before it's hung up on.
+ */
+
+static const int kMaxRequestLength = 4096;
+static const int kMaxEvents = 64;
+static const int kListenBacklog = 128;
+static const int kRequestQueueCapacity = 256;
+static const int kSendTimeout = 5000;
+
+typedef struct connection {
+  int fd;
+  int length;                 // bytes of buffer in use
+  struct connection *prev, *next;
+  char buffer[];              // kMaxRequestLength bytes
+} connection;
+
+typedef struct {
+  int epollfd;
+  QueryServerHandler handler;
+  void *auxData;
+  connection *connections;    // every open connection; touched only by the event loop
+} serverState;
+
+typedef struct {
+  serverState *server;
+  connection *conn;
+} requestTask;
+
+// epoll hands back a pointer for every event; these two stand for the non-connections
+static char listenerTag, signalTag;
+
+static bool WriteFully(int fd, const char *text, size_t length)
+{
+  while (length > 0) {
+    ssize_t written = write(fd, text, length);
+    if (written == -1 && errno == EINTR) continue;
+    if (written == -1 && errno == EAGAIN) {
+      struct pollfd writable = { .fd = fd, .events = POLLOUT };
+      int ready = poll(&writable, 1, kSendTimeout);
+      if (ready == 1 || (ready == -1 && errno == EINTR)) continue;
+      return false;
+    }
+    if (written <= 0) return false;
+    text += written;
+    length -= written;
+  }
+  return true;
+}
+
+// A request that fills the whole buffer without ending can never be answered, so the
+// client is told so and hung up on; the event loop sees the hang-up and cleans up.
+// The event loop rejects requests too, and must never wait on a client, so the notice
+// gets just one write: a client without room for even that isn't reading anyway.
+static void RejectRequest(connection *conn)
+{
+  static const char kTooLong[] = "error: request too long\n\n";
+  send(conn->fd, kTooLong, strlen(kTooLong), MSG_DONTWAIT);
+  shutdown(conn->fd, SHUT_RDWR);
+}
+
+// The release here and the acquire in ReadRequests make sure whatever the last
+// owner did to the connection is visible to the next, which epoll alone doesn't promise.
+static void Arm(serverState *server, connection *conn)
+{
+  int fd = conn->fd; // conn may be freed the moment it's rearmed
+  struct epoll_event event = { .events = EPOLLIN | EPOLLONESHOT, .data.ptr = conn };
+  __atomic_store_n(&conn->length, conn->length, __ATOMIC_RELEASE);
+  epoll_ctl(server->epollfd, EPOLL_CTL_MOD, fd, &event);
+}
+
+static void AnswerRequests(void *taskAddr, void *auxData)
+{
+  requestTask *task = taskAddr;
+  connection *conn = task->conn;
+  char *newline;
+  while ((newline = memchr(conn->buffer, '\n', conn->length)) != NULL) {
+    *newline = '\0';
+    if (newline > conn->buffer && newline[-1] == '\r') newline[-1] = '\0';
+
+    char *reply;
+    size_t replyLength;
+    FILE *replyStream = open_memstream(&reply, &replyLength);
+    task->server->handler(conn->buffer, replyStream, task->server->auxData);
+    fputc('\n', replyStream);
+    fclose(replyStream);
+    bool written = WriteFully(conn->fd, reply, replyLength);
+    free(reply);
+
+    int consumed = newline + 1 - conn->buffer;
+    memmove(conn->buffer, newline + 1, conn->length - consumed);
+    conn->length -= consumed;
+    if (!written) {
+      shutdown(conn->fd, SHUT_RDWR); // the event loop will see the hang-up and clean up
+      break;
+    }
+  }
+
+  if (conn->length == kMaxRequestLength) RejectRequest(conn);
+  Arm(task->server, conn);
+}
+
+static void CloseConnection(serverState *server, connection *conn)
+{
+  if (conn->prev != NULL) conn->prev->next = conn->next;
+  else server->connections = conn->next;
+  if (conn->next != NULL) conn->next->prev = conn->prev;
+  close(conn->fd); // which also removes it from the epoll set
+  free(conn);
+}
+
+static void AcceptConnections(serverState *server, int listener)
+{
+  int fd;
+  while ((fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+    connection *conn = malloc(sizeof(connection) + kMaxRequestLength);
+    assert(conn != NULL);
+    conn->fd = fd;
+    conn->length = 0;
+    conn->prev = NULL;
+    conn->next = server->connections;
+    if (conn->next != NULL) conn->next->prev = conn;
+    server->connections = conn;
+
+    struct epoll_event event = { .events = EPOLLIN | EPOLLONESHOT, .data.ptr = conn };
+    epoll_ctl(server->epollfd, EPOLL_CTL_ADD, fd, &event);
+  }
+}
+
+static void ReadRequests(serverState *server, threadpool *workers, connection *conn)
+{
+  __atomic_load_n(&conn->length, __ATOMIC_ACQUIRE);
+  ssize_t received = read(conn->fd, conn->buffer + conn->length, kMaxRequestLength - conn->length);
+  if (received == -1 && (errno == EINTR || errno == EAGAIN)) {
+    Arm(server, conn);
+    return;
+  }
+  if (received <= 0) {
+    CloseConnection(server, conn);
+    return;
+  }
+
+  conn->length += received;
+  if (memchr(conn->buffer, '\n', conn->length) != NULL) {
+    requestTask task = { server, conn };
+    ThreadPoolSchedule(workers, &task);
+  } else if (conn->length == kMaxRequestLength) {
+    RejectRequest(conn);
+    CloseConnection(server, conn);
+  } else {
+    Arm(server, conn);
+  }
+}
+
+static int OpenListener(const char *socketPath)
+{
+  struct sockaddr_un address;
+  if (strlen(socketPath) >= sizeof(address.sun_path)) return -1;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, socketPath);
+
+  int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listener == -1) return -1;
+  unlink(socketPath);
+  if (bind(listener, (struct sockaddr *) &address, sizeof(address)) == -1 ||
+      listen(listener, kListenBacklog) == -1) {
+    close(listener);
+    return -1;
+  }
+  return listener;
+}
+
+bool QueryServerRun(const char *socketPath, int numWorkers, QueryServerHandler handler, void *auxData)
+{
+  // SIGINT and SIGTERM are fielded by the event loop rather than killing the process,
+  // and SIGPIPE is ignored so a client hanging up mid-reply is just a failed write
+  sigset_t shutdownSignals;
+  sigemptyset(&shutdownSignals);
+  sigaddset(&shutdownSignals, SIGINT);
+  sigaddset(&shutdownSignals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &shutdownSignals, NULL); // the workers inherit this
+  signal(SIGPIPE, SIG_IGN);
+
+  int listener = OpenListener(socketPath);
+  int sigfd = signalfd(-1, &shutdownSignals, SFD_CLOEXEC);
+  int epollfd = epoll_create1(EPOLL_CLOEXEC);
+  if (listener == -1 || sigfd == -1 || epollfd == -1) {
+    if (listener != -1) close(listener);
+    if (sigfd != -1) close(sigfd);
+    if (epollfd != -1) close(epollfd);
+    pthread_sigmask(SIG_UNBLOCK, &shutdownSignals, NULL);
+    return false;
+  }
+
+  serverState server = { epollfd, handler, auxData, NULL };
+  struct epoll_event event = { .events = EPOLLIN, .data.ptr = &listenerTag };
+  epoll_ctl(epollfd, EPOLL_CTL_ADD, listener, &event);
+  event.data.ptr = &signalTag;
+  epoll_ctl(epollfd, EPOLL_CTL_ADD, sigfd, &event);
+
+  // should the queue fill, the event loop just waits for a worker, and workers never wait on it
+  threadpool workers;
+  ThreadPoolNew(&workers, numWorkers, kRequestQueueCapacity, sizeof(requestTask), AnswerRequests, NULL);
+
+  bool shuttingDown = false;
+  struct epoll_event events[kMaxEvents];
+  while (!shuttingDown) {
+    int numEvents = epoll_wait(epollfd, events, kMaxEvents, -1);
+    for (int i = 0; i < numEvents; i++) {
+      if (events[i].data.ptr == &listenerTag) AcceptConnections(&server, listener);
+      else if (events[i].data.ptr == &signalTag) shuttingDown = true;
+      else ReadRequests(&server, &workers, events[i].data.ptr);
+    }
+  }
+
+  ThreadPoolDispose(&workers);
+  while (server.connections != NULL)
+    CloseConnection(&server, server.connections);
+  close(epollfd);
+  close(sigfd);
+  close(listener);
+  unlink(socketPath);
+  pthread_sigmask(SIG_UNBLOCK, &shutdownSignals, NULL);
+  return true;
+}
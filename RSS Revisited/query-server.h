@@ -0,0 +1,47 @@
+/**
+ * File: query-server.h
+ * --------------------
+ * Exports a small server that answers line-oriented requests arriving
+ * over a Unix-domain stream socket.  A single thread watches the
+ * listening socket and every connection with epoll, and each complete
+ * request is handed to a pool of worker threads to be answered, so
+ * one slow query never holds up the requests of other clients.
+ *
+ * The protocol is as simple as can be: a client sends one request per
+ * line, and the server answers each with zero or more non-empty lines
+ * of text followed by an empty line.  A client may send several
+ * requests without waiting, and the answers come back in order.
+ */
+
+#ifndef __query_server_
+#define __query_server_
+
+#include <stdio.h>
+#include "bool.h"
+
+/**
+ * Type: QueryServerHandler
+ * ------------------------
+ * The function called (on one of the workers) to answer each request.
+ * The request has had its line ending removed.  The handler writes its
+ * answer to reply, which mustn't contain any empty lines; the server
+ * supplies the terminating empty line itself.  Handlers may be called
+ * concurrently, so they must only ever read any data they share.
+ */
+
+typedef void (*QueryServerHandler)(const char *request, FILE *reply, void *auxData);
+
+/**
+ * Function: QueryServerRun
+ * ------------------------
+ * Creates a socket bound to socketPath (replacing any stale socket
+ * file left there) and answers requests on it with numWorkers threads
+ * until the process receives SIGINT or SIGTERM, at which point all
+ * outstanding requests are answered, every connection is closed, the
+ * socket file is removed, and true is returned.  Returns false without
+ * serving anything if the socket can't be set up.
+ */
+
+bool QueryServerRun(const char *socketPath, int numWorkers, QueryServerHandler handler, void *auxData);
+
+#endif
@@ -3,6 +3,12 @@
 #include <assert.h>
 #include <string.h>
 #include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <fnmatch.h>
 #include <expat.h>
 #include <pthread.h> 
 #include <semaphore.h> 
@@ -13,93 +19,352 @@
 #include "html-utils.h"
 #include "vector.h"
 #include "hashset.h"
+#include "term-scanner.h"
+#include "thread-pool.h"
+#include "connection-limiter.h"
+#include "fingerprint-set.h"
+#include "posting-list.h"
+#include "bounded-heap.h"
+#include "index-segment.h"
+#include "query-server.h"
+#include "snapshot-cell.h"
+#include "feed-cache.h"
+#include "text-builder.h"
+#include "term-dictionary.h"
+#include "term-normalizer.h"
+#include "simhash.h"
+
+/**
+ * Queries never read the index the crawl is building.  They read an immutable
+ * snapshot of it, published once each crawl is done, so that periodic re-crawls
+ * can run while queries continue.  A snapshot's articles are shallow copies of
+ * those in previouslySeenArticles, whose strings outlive every snapshot.
+ */
 
 typedef struct {
-  hashset stopWords;
   hashset indices;
+  termdictionary terms;       // every word in indices, in sorted order, as of when the snapshot was published
+  vector articles;            // rssNewsArticle, every one indexed when the snapshot was taken
+  hashset *stopWords;
+  const termnormalizer *normalizer;
+} rssIndexSnapshot;
+
+typedef struct {
+  hashset stopWords;
+  termnormalizer normalizer;  // folds and stems words as they're indexed, and again as they're queried
   vector previouslySeenArticles;
+  fingerprintset seenArticles; // URL and server+title fingerprints of every article claimed so far
+  simhashindex nearDuplicates; // content signatures of every article indexed, guarded by lock
+  feedcache feedItems;        // the items each feed listed when it was last crawled
+  sem_t lock;                 // binary lock guarding previouslySeenArticles and nearDuplicates
+  hashset *shards;            // private indices, one per article worker, merged into pending at the end
+  threadpool feedWorkers;     // downloads and parses feeds, handing their items to articleWorkers
+  threadpool articleWorkers;  // downloads and indexes the articles discovered in each feed
+  connectionlimiter connections;
+  vector segments;            // indexsegments loaded at startup, mapped in; index entries may view their postings
+  int numSavedSegments;
+  int numSavedArticles;       // the articles with smaller ids have all been saved
+  rssIndexSnapshot *pending;  // what the current crawl is indexing into, until it's published
+  snapshotcell published;     // the rssIndexSnapshot every query reads
+  bool feedOnly;              // index just the titles and descriptions in the feeds, downloading no articles
+  bool recordPositions;       // record where every term occurs, so phrases can be matched
 } rssDatabase;
 
 typedef struct {
-  char title[2048];
-  char url[2048];
-  char *activeField; // field that should be populated... 
+  rssDatabase *db;
+  const char *feedsFileName;
+  const char *indexName;
+  int interval;               // in seconds, or 0 to crawl just the once
+  bool crawlFirst;            // crawl as soon as the thread starts, rather than an interval later
+  bool stopRequested;
+  pthread_mutex_t lock;
+  pthread_cond_t stopRequestedChanged;
+  pthread_t thread;
+} rssRefresher;
+
+typedef struct {
+  const char *feedsFileName;
+  const char *welcomeTextURL;
+  const char *stopWordsURL;
+  const char *indexName;
+  const char *socketPath;     // NULL means prompt for queries
+  int refreshInterval;        // seconds between re-crawls, or 0 for none
+  bool feedOnly;
+  bool recordPositions;
+  int normalization;          // normalizationoptions
+} rssOptions;
+
+typedef struct {
+  textbuilder title;
+  textbuilder description;
+  textbuilder url;
+  textbuilder guid;
+  textbuilder *activeField; // field that should be populated... 
 } rssFeedEntry;
 
 typedef struct {
   rssDatabase *db;
   rssFeedEntry entry;
+  feeditems knownItems;       // those the feed listed the last time it was crawled
+  vector itemFingerprints;    // uint64_t, one for every item it lists this time
+  int numKnownItems;          // how many of this time's items were listed last time too
 } rssFeedState;
 
 typedef struct {
   const char *title;
   const char *server;
   const char *fullURL;
+  uint64_t urlFingerprint;   // as claimed in seenArticles, so they can be claimed again after a reload
+  uint64_t titleFingerprint; // 0 if the article has no title
+  uint64_t contentSignature; // 0 if the article's too short to have one
 } rssNewsArticle;
 
 typedef struct {
-  const char *meaningfulWord;
-  vector relevantArticles;
+  char *word;
+  postinglist postings;
+  int numEntries;             // index entries sharing them, across every snapshot; changed atomically
+} rssSharedPostings;
+
+typedef struct {
+  const char *meaningfulWord; // normalized; these first two fields line up with hashedword
+  unsigned long hashcode;
+  postinglist relevantArticles; // in increasing article order
+  rssSharedPostings *shared;  // owns the word and postings once they're published, or NULL if the entry does
 } rssIndexEntry;
 
 typedef struct {
   int articleIndex;
   int freq;
-} rssRelevantArticleEntry;
+  double score;
+} rssScoredArticle;
+
+typedef struct {
+  const char *word; // dynamically allocated; these first two fields line up with hashedword
+  unsigned long hashcode;
+  int fieldFreqs[kNumPostingFields];
+  vector positions;           // int, where each occurrence was found, if positions are being recorded
+} rssTermCount;
+
+typedef struct {
+  hashset *indices;
+  int articleIndex;
+  bool recordPositions;
+} rssPostingDestination;
 
 typedef struct {
   rssDatabase *db;
-  const char *articleTitle;
-  const char *articleURL;
-} threadArgs;
+  char *feedURL; // dynamically allocated, and freed once the feed is parsed
+} feedTask;
 
-sem_t semaphore; // Semaphore to limit concurrent connections
+typedef struct {
+  rssDatabase *db;
+  char *articleTitle; // all dynamically allocated, and freed once the article is parsed
+  char *articleDescription;
+  char *articleURL;
+} articleTask;
 
+static bool ParseOptions(rssOptions *options, int argc, char **argv);
+static const char *OptionValue(const char *arg, const char *name);
 static void Welcome(const char *welcomeTextURL);
 static void LoadStopWords(hashset *stopWords, const char *stopWordsURL);
+static void LoadSavedIndex(rssDatabase *db, const char *indexName);
+static void LoadSegment(rssDatabase *db, const indexsegment *seg);
+static void SaveIndex(rssDatabase *db, const char *indexName);
+static void SaveSegment(rssDatabase *db, const char *indexName);
+static void AddNewPostingsToSegment(void *elem, void *auxData);
+static void SegmentFree(void *elem);
 static void BuildIndices(rssDatabase *db, const char *feedsFileName);
-static void ProcessFeed(rssDatabase *db, const char *remoteDocumentName);
-static void PullAllNewsItems(rssDatabase *db, urlconnection *urlconn);
+static rssIndexSnapshot *NewSnapshot(rssDatabase *db, rssIndexSnapshot *base);
+static void CopyIndexEntry(void *elem, void *auxData);
+static void ReleaseSharedPostings(rssSharedPostings *shared);
+static void PublishSnapshot(rssDatabase *db);
+static void ShareIndexEntry(void *elem, void *auxData);
+static void CollectWord(void *elem, void *auxData);
+static int StringCompare(const void *elem1, const void *elem2);
+static void SnapshotFree(void *snapshot);
+static void StartRefreshing(rssRefresher *refresher, rssDatabase *db, const char *feedsFileName,
+                            const char *indexName, int interval, bool crawlFirst);
+static void *RefreshPeriodically(void *arg);
+static void RefreshIndex(rssDatabase *db, const char *feedsFileName, const char *indexName);
+static void StopRefreshing(rssRefresher *refresher);
+static void ScheduleFeeds(rssDatabase *db, const char *feedsFileURL);
+static void DownloadAndParseFeed(void *taskAddr, void *auxData);
+static void ProcessFeed(rssDatabase *db, const char *feedURL, const char *remoteDocumentName);
+static void PullAllNewsItems(rssDatabase *db, const char *feedURL, urlconnection *urlconn);
 
 static void ProcessStartTag(void *userData, const char *name, const char **atts);
 static void ProcessEndTag(void *userData, const char *name);
 static void ProcessTextData(void *userData, const char *text, int len);
+static uint64_t ItemFingerprint(const rssFeedEntry *entry);
 
-static void ParseArticle(rssDatabase *db, const char *articleTitle, const char *articleURL);
-static void* ThreadedParseArticle(void *args); // Added for threaded article parsing
-static void ScanArticle(streamtokenizer *st, int articleID, hashset *indices, hashset *stopWords);
-static bool WordIsWorthIndexing(const char *word, hashset *stopWords);
-static void AddWordToIndices(hashset *indices, const char *word, int articleIndex);
+static void ParseArticle(rssDatabase *db, const char *articleTitle, const char *articleDescription,
+                         const char *articleURL);
+static void FetchArticle(rssDatabase *db, const char *articleTitle, const char *articleDescription, url *u);
+static int RegisterArticle(rssDatabase *db, const char *articleTitle, const url *u, uint64_t contentSignature);
+static uint64_t URLFingerprint(const url *u);
+static uint64_t TitleFingerprint(const url *u, const char *articleTitle);
+static void DownloadAndParseArticle(void *taskAddr, void *auxData);
+static void IndexArticle(rssDatabase *db, const url *u, FILE *body, const char *title, const char *description);
+static void ScanFeedText(rssDatabase *db, const char *text, postingfield field, hashset *termCounts,
+                         simhash *signature);
+static void ScanArticle(rssDatabase *db, FILE *infile, postingfield field, hashset *termCounts,
+                        simhash *signature);
+static void MergeShards(rssDatabase *db, int numShards);
+static void MergeIndexEntry(void *elem, void *auxData);
+static uint64_t ShingleHash(const uint64_t shingle[], int numScanned);
+static void CountTerm(hashset *termCounts, const scannedterm *term, postingfield field, int position);
+static void AddTermToIndices(void *elem, void *auxData);
+static void DiscardTermCount(void *elem, void *auxData);
 static void QueryIndices(rssDatabase *db);
-static void ProcessResponse(rssDatabase *db, const char *word);
-static void ListTopArticles(rssIndexEntry *index, vector *previouslySeenArticles);
-static bool WordIsWellFormed(const char *word);
-static int StringHash(const void *s, int numBuckets);
-static int StringCompare(const void *elem1, const void *elem2);
+static void ServeQueries(rssDatabase *db, const char *socketPath);
+static void AnswerQuery(const char *request, FILE *reply, void *auxData);
+static void PrintField(FILE *outfile, const char *text);
+static void DisposeDatabase(rssDatabase *db);
+static void ProcessResponse(rssDatabase *db, const char *response);
+static void ProcessWord(rssIndexSnapshot *snapshot, const char *response);
+static void ProcessPattern(rssIndexSnapshot *snapshot, const char *response);
+static void ProcessQuery(rssIndexSnapshot *snapshot, const char *response);
+static int MaxQueryWords(const char *query);
+static int EvaluateQuery(rssIndexSnapshot *snapshot, const char *query, postinglist *matches,
+                         const postinglist *terms[], postinglist computed[], int *numComputed, bool reportStopWords);
+static char *NextQueryToken(char **remaining);
+static bool MatchPhrase(rssIndexSnapshot *snapshot, char *phrase, postinglist *matches, bool reportStopWords);
+static bool IsPattern(const char *word);
+static void SplitPattern(const termnormalizer *normalizer, const char *pattern, char foldedPattern[], char prefix[]);
+static bool NextPatternMatch(termiterator *it, const char *foldedPattern);
+static rssIndexEntry *MatchedEntry(rssIndexSnapshot *snapshot, const termiterator *it);
+static int MatchPattern(rssIndexSnapshot *snapshot, const char *pattern, postinglist *matches, bool reportTruncation);
+static void ListCompletions(rssIndexSnapshot *snapshot, const char *pattern);
+static int CountPhraseOccurrences(int *positions[], const int numPositions[], int numWords, int slop,
+                                  int fieldFreqs[]);
+static rssIndexEntry *LookUpWord(rssIndexSnapshot *snapshot, const char *word, bool *isStopWord);
+static void RankArticles(const postinglist *matches, const postinglist *terms[], int numTerms,
+                         int numIndexed, boundedheap *topArticles);
+static double WeightedFrequency(const int fieldFreqs[]);
+static void ListTopArticles(const postinglist *matches, const postinglist *terms[], int numTerms,
+                            vector *articles);
+static bool WordIsWellFormed(rssIndexSnapshot *snapshot, const char *word);
 static void StringFree(void *elem);
 
+static void NewsArticleClone(rssNewsArticle *article, const char *title,
+                             const char *server, const char *fullURL);
+static void NewsArticleFree(void *elem);
+
+static int IndexEntryHash(const void *elem, int numBuckets);
+static int IndexEntryCompare(const void *elem1, const void *elem2);
+static void IndexEntryFree(void *elem);
+
+static int ScoredArticleCompare(const void *elem1, const void *elem2);
+
 int main(int argc, char **argv) {
-    const char *feedsFileName = (argc == 1) ? "rss-feeds.txt" : argv[1];
-    const char *welcomeTextURL = (argc < 3) ? "http://cs107.stanford.edu/readings/welcome.txt" : argv[2];
-    const char *stopWordsURL = (argc < 4) ? "http://cs107.stanford.edu/readings/stop-words.txt" : argv[3];
+    rssOptions options;
+    if (!ParseOptions(&options, argc, argv)) {
+      fprintf(stderr, "Usage: %s [<feeds> [<welcome> [<stop-words> [<index>]]]] [--socket=<path>] [--refresh=<seconds>]\n"
+              "       [--feed-only] [--no-positions] [--normalize=stem|fold|lowercase]\n", argv[0]);
+      return 1;
+    }
 
     rssDatabase db;
-    HashSetNew(&db.stopWords, sizeof(char *), 1009, StringHash, StringCompare, StringFree);
-    HashSetNew(&db.indices, sizeof(rssIndexEntry), 10007, StringHash, StringCompare, StringFree);
-    VectorNew(&db.previouslySeenArticles, sizeof(char *), StringFree);
+    HashSetNew(&db.stopWords, sizeof(hashedword), 1009, HashedWordHash, HashedWordCompare, HashedWordFree);
+    TermNormalizerNew(&db.normalizer, options.normalization);
+    VectorNew(&db.previouslySeenArticles, sizeof(rssNewsArticle), NewsArticleFree, 0);
+    FingerprintSetNew(&db.seenArticles, 1024);
+    SimHashIndexNew(&db.nearDuplicates);
+    FeedCacheNew(&db.feedItems);
+    VectorNew(&db.segments, sizeof(indexsegment), SegmentFree, 0);
+    sem_init(&db.lock, 0, 1);
+    SnapshotCellNew(&db.published, NewSnapshot(&db, NULL), SnapshotFree);
+    db.pending = NewSnapshot(&db, NULL);
+    db.feedOnly = options.feedOnly;
+    db.recordPositions = options.recordPositions;
 
-    Welcome(welcomeTextURL);
-    LoadStopWords(&db.stopWords, stopWordsURL);
-    BuildIndices(&db, feedsFileName);
-    QueryIndices(&db);
+    Welcome(options.welcomeTextURL);
+    LoadStopWords(&db.stopWords, options.stopWordsURL);
+    LoadSavedIndex(&db, options.indexName);
+    bool crawlInBackground = db.numSavedArticles > 0; // queries needn't wait on the crawl to begin
+    if (!crawlInBackground) {
+      BuildIndices(&db, options.feedsFileName);
+      SaveIndex(&db, options.indexName);
+    }
+    PublishSnapshot(&db);
 
-    HashSetDispose(&db.stopWords);
-    HashSetDispose(&db.indices);
-    VectorDispose(&db.previouslySeenArticles);
+    rssRefresher refresher;
+    bool refreshing = crawlInBackground || options.refreshInterval > 0;
+    if (refreshing)
+      StartRefreshing(&refresher, &db, options.feedsFileName, options.indexName, options.refreshInterval,
+                      crawlInBackground);
+    if (options.socketPath == NULL) QueryIndices(&db);
+    else ServeQueries(&db, options.socketPath);
+    if (refreshing) StopRefreshing(&refresher);
 
+    DisposeDatabase(&db);
     return 0;
 }
 
+/**
+ * The feeds file, welcome text, stop words and index name are given in that
+ * order, as they always have been, and any left off take their defaults.
+ * Everything else is a named option, given anywhere on the command line:
+ *
+ *     --socket=<path>       serve queries on the Unix domain socket, rather than prompting for them
+ *     --refresh=<seconds>   re-crawl the feeds that often, while queries continue
+ *     --feed-only           index the titles and descriptions in the feeds, downloading no articles
+ *     --no-positions        don't record where words occur, for a smaller index without phrases
+ *     --normalize=<mode>    "stem" words (the default), just "fold" their accents and case, or
+ *                           just "lowercase" them
+ *
+ * Returns false if the command line can't be made sense of.
+ */
+
+static bool ParseOptions(rssOptions *options, int argc, char **argv) {
+  const char **positional[] = { &options->feedsFileName, &options->welcomeTextURL, &options->stopWordsURL,
+                                &options->indexName };
+  int numPositional = 0;
+  options->feedsFileName = "rss-feeds.txt";
+  options->welcomeTextURL = "http://cs107.stanford.edu/readings/welcome.txt";
+  options->stopWordsURL = "http://cs107.stanford.edu/readings/stop-words.txt";
+  options->indexName = "rss-news-search.index";
+  options->socketPath = NULL;
+  options->refreshInterval = 0;
+  options->feedOnly = false;
+  options->recordPositions = true;
+  options->normalization = kFoldAccents | kStemWords;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i], *value;
+    char *end;
+    if (strncmp(arg, "--", 2) != 0) {
+      if (numPositional == sizeof(positional) / sizeof(positional[0])) return false;
+      *positional[numPositional++] = arg;
+    } else if ((value = OptionValue(arg, "--socket")) != NULL) {
+      if (*value == '\0') return false;
+      options->socketPath = value;
+    } else if ((value = OptionValue(arg, "--refresh")) != NULL) {
+      long interval = strtol(value, &end, 10);
+      if (!isdigit((unsigned char) *value) || *end != '\0' || interval > INT_MAX) return false;
+      options->refreshInterval = interval;
+    } else if ((value = OptionValue(arg, "--normalize")) != NULL) {
+      if (strcmp(value, "stem") == 0) options->normalization = kFoldAccents | kStemWords;
+      else if (strcmp(value, "fold") == 0) options->normalization = kFoldAccents;
+      else if (strcmp(value, "lowercase") == 0) options->normalization = 0;
+      else return false;
+    } else if (strcmp(arg, "--feed-only") == 0) {
+      options->feedOnly = true;
+    } else if (strcmp(arg, "--no-positions") == 0) {
+      options->recordPositions = false;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns what follows "<name>=" if arg is of that form, and NULL otherwise.
+static const char *OptionValue(const char *arg, const char *name) {
+  int length = strlen(name);
+  return (strncmp(arg, name, length) == 0 && arg[length] == '=') ? arg + length + 1 : NULL;
+}
+
 static void Welcome(const char *welcomeTextURL) {
   url u;
   urlconnection urlconn;
@@ -136,10 +401,10 @@ static void LoadStopWords(hashset *stopWords, const char *stopWordsURL) {
   } else {
     streamtokenizer st;
     char buffer[4096];
-    HashSetNew(stopWords, sizeof(char *), 1009, StringHash, StringCompare, StringFree);
     STNew(&st, urlconn.dataStream, "\r\n", true);
     while (STNextToken(&st, buffer, sizeof(buffer))) {
-      char *stopWord = strdup(buffer);
+      for (char *c = buffer; *c != '\0'; c++) *c = tolower((unsigned char) *c);
+      hashedword stopWord = { strdup(buffer), WordHash(buffer) };
       HashSetEnter(stopWords, &stopWord);
     }
     STDispose(&st);
@@ -149,59 +414,326 @@ static void LoadStopWords(hashset *stopWords, const char *stopWordsURL) {
   URLDispose(&u);
 }
 
+/**
+ * The index is saved as a series of segments named <indexName>.0, <indexName>.1,
+ * and so on, each holding just the articles indexed by one run.  At startup, every
+ * segment is mapped in, its articles are re-registered (fingerprints included, so
+ * they aren't downloaded again), and its posting lists are adopted as views of the
+ * mapped file, with no copying unless the same word turns up in several segments.
+ * After the crawl, whatever's new is saved as the next segment.  Segments are
+ * written under a temporary name and renamed into place, so a crash mid-save
+ * leaves the earlier segments intact.
+ *
+ * The items each feed listed are saved alongside, in <indexName>.feeds, so the
+ * next crawl can skip every item it's already seen before it so much as parses
+ * the link.  The cache is stamped with the number of articles saved when it was,
+ * and it's only written once every article is in a segment, so it can never vouch
+ * for an article the segments don't hold.  (An item whose article couldn't be
+ * downloaded is skipped too, for as long as its feed keeps listing it.)
+ */
+
+static void LoadSavedIndex(rssDatabase *db, const char *indexName) {
+  char filename[strlen(indexName) + 16];
+  while (true) {
+    indexsegment seg;
+    sprintf(filename, "%s.%d", indexName, VectorLength(&db->segments));
+    if (!IndexSegmentOpen(&seg, filename)) break;
+    if (seg.header->firstArticleIndex != VectorLength(&db->previouslySeenArticles)) {
+      printf("[Ignoring \"%s\" and beyond: it doesn't pick up where the earlier segments left off.]\n", filename);
+      IndexSegmentClose(&seg);
+      break;
+    }
+    if (seg.header->normalization != db->normalizer.options) {
+      printf("[Ignoring \"%s\" and beyond: its words weren't normalized the way queries will be.]\n", filename);
+      IndexSegmentClose(&seg);
+      break;
+    }
+    LoadSegment(db, &seg);
+    VectorAppend(&db->segments, &seg);
+  }
+
+  db->numSavedSegments = VectorLength(&db->segments);
+  db->numSavedArticles = VectorLength(&db->previouslySeenArticles);
+  sprintf(filename, "%s.feeds", indexName);
+  FeedCacheLoad(&db->feedItems, filename, db->numSavedArticles); // it's fine if there's none
+  if (db->numSavedArticles > 0)
+    printf("Loaded %d previously indexed article%s from %d saved segment%s.\n\n", db->numSavedArticles,
+           (db->numSavedArticles == 1) ? "" : "s", VectorLength(&db->segments),
+           (VectorLength(&db->segments) == 1) ? "" : "s");
+}
+
+static void LoadSegment(rssDatabase *db, const indexsegment *seg) {
+  for (int i = 0; i < seg->header->numArticles; i++) {
+    const segmentArticle *savedArticle = &seg->articles[i];
+    rssNewsArticle newsArticle;
+    NewsArticleClone(&newsArticle, IndexSegmentString(seg, savedArticle->title),
+                     IndexSegmentString(seg, savedArticle->server), IndexSegmentString(seg, savedArticle->fullURL));
+    newsArticle.urlFingerprint = savedArticle->urlFingerprint;
+    newsArticle.titleFingerprint = savedArticle->titleFingerprint;
+    newsArticle.contentSignature = savedArticle->contentSignature;
+    if (newsArticle.contentSignature != 0)
+      SimHashIndexAdd(&db->nearDuplicates, newsArticle.contentSignature, VectorLength(&db->previouslySeenArticles));
+    VectorAppend(&db->previouslySeenArticles, &newsArticle);
+    uint64_t fingerprints[] = { newsArticle.urlFingerprint, newsArticle.titleFingerprint };
+    FingerprintSetClaim(&db->seenArticles, fingerprints, (newsArticle.titleFingerprint == 0) ? 1 : 2);
+  }
+
+  for (int i = 0; i < seg->header->numTerms; i++) {
+    const char *word = IndexSegmentString(seg, seg->terms[i].word);
+    rssIndexEntry indexEntry = { strdup(word), WordHash(word) };
+    IndexSegmentPostings(seg, i, &indexEntry.relevantArticles);
+    MergeIndexEntry(&indexEntry, &db->pending->indices); // adopts the view, or merges it into a copy
+  }
+}
+
+static void SaveIndex(rssDatabase *db, const char *indexName) {
+  SaveSegment(db, indexName);
+  if (db->numSavedArticles < VectorLength(&db->previouslySeenArticles)) return;
+
+  char filename[strlen(indexName) + 16];
+  sprintf(filename, "%s.feeds", indexName);
+  if (!FeedCacheSave(&db->feedItems, filename, db->numSavedArticles))
+    printf("Unable to save the feed cache to \"%s\".\n\n", filename);
+}
+
+static void SaveSegment(rssDatabase *db, const char *indexName) {
+  int numArticles = VectorLength(&db->previouslySeenArticles);
+  if (numArticles == db->numSavedArticles) return;
+
+  indexsegmentbuilder builder;
+  IndexSegmentBuilderNew(&builder, db->numSavedArticles, db->normalizer.options);
+  for (int i = db->numSavedArticles; i < numArticles; i++) {
+    const rssNewsArticle *article = VectorNth(&db->previouslySeenArticles, i);
+    IndexSegmentBuilderAddArticle(&builder, article->title, article->server, article->fullURL,
+                                  article->urlFingerprint, article->titleFingerprint, article->contentSignature);
+  }
+  HashSetMap(&db->pending->indices, AddNewPostingsToSegment, &builder);
+
+  char filename[strlen(indexName) + 16], tempFilename[strlen(indexName) + 32];
+  sprintf(filename, "%s.%d", indexName, db->numSavedSegments);
+  sprintf(tempFilename, "%s.partial", filename);
+  FILE *outfile = fopen(tempFilename, "wb");
+  bool saved = (outfile != NULL) && IndexSegmentBuilderWrite(&builder, outfile);
+  if (outfile != NULL && fclose(outfile) != 0) saved = false;
+  if (saved && rename(tempFilename, filename) == 0) {
+    printf("Saved %d newly indexed article%s to \"%s\".\n\n", numArticles - db->numSavedArticles,
+           (numArticles - db->numSavedArticles == 1) ? "" : "s", filename);
+    db->numSavedSegments++;
+    db->numSavedArticles = numArticles;
+  } else { // everything since the last save is retried along with the next one
+    printf("Unable to save the newly indexed articles to \"%s\".\n\n", filename);
+    remove(tempFilename);
+  }
+  IndexSegmentBuilderDispose(&builder);
+}
+
+static void AddNewPostingsToSegment(void *elem, void *auxData) {
+  rssIndexEntry *entry = elem;
+  indexsegmentbuilder *builder = auxData;
+  postinglist newPostings;
+  postingiterator it;
+
+  PostingListNew(&newPostings);
+  PostingIteratorNew(&it, &entry->relevantArticles);
+  if (PostingIteratorAdvanceTo(&it, builder->firstArticleIndex)) {
+    do {
+      PostingListAppendFrom(&newPostings, &it);
+    } while (PostingIteratorNext(&it));
+  }
+
+  if (PostingListCount(&newPostings) > 0)
+    IndexSegmentBuilderAddTerm(builder, entry->meaningfulWord, &newPostings);
+  PostingListDispose(&newPostings);
+}
+
+static void SegmentFree(void *elem) {
+  IndexSegmentClose(elem);
+}
+
+/**
+ * Feeds and articles are each handed to a fixed pool of workers through a
+ * bounded queue.  Several feeds are downloaded and parsed at once, and every
+ * item they turn up goes straight into the article queue, so indexing time is
+ * governed by the slowest feed rather than the sum of all of them.  Producers
+ * simply block whenever they get a full queue's worth ahead of the workers.
+ *
+ * Independently of the number of workers, no more than kMaxOpenConnections
+ * connections are ever open at once, and no more than kMaxConnectionsPerServer
+ * of those go to the same server.  A feed worker holds its connection while it
+ * waits on a full article queue, so there must be fewer feed workers than
+ * either limit; otherwise they could claim every slot the article workers
+ * need to drain the queue.
+ *
+ * Each article worker indexes into a private shard, so downloading and scanning
+ * never contend for anything; the only shared state is the list of articles,
+ * and that's locked just long enough to claim an article id.
+ *
+ * ThreadPoolDispose doesn't return until every queued task is done, and the feed
+ * workers are disposed of first, so every article has been scheduled (and then
+ * indexed) by the time the shards are merged into db->pending.
+ */
+
+static const int kNumFeedWorkers = 3;
+static const int kFeedQueueCapacity = 32;
+static const int kNumArticleWorkers = 12;
+static const int kArticleQueueCapacity = 64;
+static const int kMaxOpenConnections = 12;
+static const int kMaxConnectionsPerServer = 4;
+static const int kNumShardBuckets = 1009;
 static void BuildIndices(rssDatabase *db, const char *feedsFileName) {
+  assert(kNumFeedWorkers < kMaxConnectionsPerServer && kNumFeedWorkers < kMaxOpenConnections);
+  db->shards = malloc(kNumArticleWorkers * sizeof(hashset));
+  assert(db->shards != NULL);
+  for (int i = 0; i < kNumArticleWorkers; i++) // shards hand their entries over, so they free nothing
+    HashSetNew(&db->shards[i], sizeof(rssIndexEntry), kNumShardBuckets, IndexEntryHash, IndexEntryCompare, NULL);
+  ConnectionLimiterNew(&db->connections, kMaxOpenConnections, kMaxConnectionsPerServer);
+  ThreadPoolNew(&db->articleWorkers, kNumArticleWorkers, kArticleQueueCapacity,
+                sizeof(articleTask), DownloadAndParseArticle, NULL);
+  ThreadPoolNew(&db->feedWorkers, kNumFeedWorkers, kFeedQueueCapacity,
+                sizeof(feedTask), DownloadAndParseFeed, NULL);
+
+  ScheduleFeeds(db, feedsFileName);
+
+  ThreadPoolDispose(&db->feedWorkers);
+  ThreadPoolDispose(&db->articleWorkers);
+  ConnectionLimiterDispose(&db->connections);
+  MergeShards(db, kNumArticleWorkers);
+}
+
+// Each line of the feeds file looks like "BBC World News: http://newsrss.bbc.co.uk/...".
+static void ScheduleFeeds(rssDatabase *db, const char *feedsFileURL) {
   url u;
   urlconnection urlconn;
-  
-  URLNewAbsolute(&u, feedsFileName);
+
+  URLNewAbsolute(&u, feedsFileURL);
   URLConnectionNew(&urlconn, &u);
-  PullAllNewsItems(db, &urlconn);
-  
+
+  if (urlconn.responseCode / 100 == 3) {
+    ScheduleFeeds(db, urlconn.newUrl);
+  } else {
+    streamtokenizer st;
+    char remoteDocumentURL[2048];
+    STNew(&st, urlconn.dataStream, "\r\n", true);
+    while (STSkipUntil(&st, ":") != EOF) {
+      STSkipOver(&st, ": ");
+      if (!STNextToken(&st, remoteDocumentURL, sizeof(remoteDocumentURL))) break;
+      feedTask task = { db, strdup(remoteDocumentURL) };
+      ThreadPoolSchedule(&db->feedWorkers, &task);
+    }
+    STDispose(&st);
+  }
+
   URLConnectionDispose(&urlconn);
   URLDispose(&u);
 }
 
-// Function to process the RSS feed
-static void ProcessFeed(rssDatabase *db, const char *remoteDocumentName) {
-    // Declare a variable to hold the URL connection
-    urlconnection urlconn;
-    // Initialize the URL connection with the remote document name
-    URLConnectionNew(&urlconn, remoteDocumentName);
-    // Pull all news items from the URL connection and store them in the database
-    PullAllNewsItems(db, &urlconn);
-    // Dispose of the URL connection
-    URLConnectionDispose(&urlconn);
+static void DownloadAndParseFeed(void *taskAddr, void *auxData) {
+  feedTask *task = taskAddr;
+  ProcessFeed(task->db, task->feedURL, task->feedURL);
+  free(task->feedURL);
 }
 
-static void PullAllNewsItems(rssDatabase *db, urlconnection *urlconn) {
+// Feeds are cached under the URLs in the feeds file, wherever those happen to redirect.
+static void ProcessFeed(rssDatabase *db, const char *feedURL, const char *remoteDocumentName) {
+  url u;
+  urlconnection urlconn;
+  char *redirectURL = NULL;
+
+  URLNewAbsolute(&u, remoteDocumentName);
+  ConnectionLimiterAcquire(&db->connections, u.serverName);
+  URLConnectionNew(&urlconn, &u);
+  switch (urlconn.responseCode) {
+    case 0: printf("Unable to connect to \"%s\".  Ignoring...\n", u.serverName); break;
+    case 200: PullAllNewsItems(db, feedURL, &urlconn); break;
+    case 301:
+    case 302: redirectURL = strdup(urlconn.newUrl); break;
+    default: 
+      printf("Connection to \"%s\" was established, but unable to retrieve \"%s\". [response code: %d, response message:\"%s\"]\n",
+             u.serverName, u.fileName, urlconn.responseCode, urlconn.responseMessage);
+      break;
+  }
+
+  URLConnectionDispose(&urlconn);
+  ConnectionLimiterRelease(&db->connections, u.serverName);
+  URLDispose(&u);
+
+  if (redirectURL != NULL) {
+    ProcessFeed(db, feedURL, redirectURL);
+    free(redirectURL);
+  }
+}
+
+/**
+ * The feed is read in large blocks straight into the parser's own buffer, so
+ * each byte is copied just once on its way in, and the parser never sees the
+ * document chopped into lines.  A feed that turns out to be malformed is read
+ * no further, though every item completed before the error has already been
+ * scheduled.
+ */
+
+static const int kFeedBlockSize = 1 << 16;
+static const int kMaxFeedFieldLength = 8192; // far longer than any real title, link or guid, and most descriptions
+static void PullAllNewsItems(rssDatabase *db, const char *feedURL, urlconnection *urlconn) {
   rssFeedState state = {db}; // passed through the parser by address as auxiliary data.
-  streamtokenizer st;
-  char buffer[2048];
+  rssFeedEntry *entry = &state.entry;
+  TextBuilderNew(&entry->title, kMaxFeedFieldLength);
+  TextBuilderNew(&entry->description, kMaxFeedFieldLength);
+  TextBuilderNew(&entry->url, kMaxFeedFieldLength);
+  TextBuilderNew(&entry->guid, kMaxFeedFieldLength);
+
+  FeedCacheRecall(&db->feedItems, feedURL, &state.knownItems);
+  VectorNew(&state.itemFingerprints, sizeof(uint64_t), NULL, 0);
 
   XML_Parser rssFeedParser = XML_ParserCreate(NULL);
   XML_SetUserData(rssFeedParser, &state);
   XML_SetElementHandler(rssFeedParser, ProcessStartTag, ProcessEndTag);
   XML_SetCharacterDataHandler(rssFeedParser, ProcessTextData);
 
-  STNew(&st, urlconn->dataStream, "\n", false);
-  while (STNextToken(&st, buffer, sizeof(buffer))) {
-    XML_Parse(rssFeedParser, buffer, strlen(buffer), false);
+  bool done = false;
+  while (!done) {
+    void *block = XML_GetBuffer(rssFeedParser, kFeedBlockSize);
+    assert(block != NULL);
+    int numBytes = fread(block, 1, kFeedBlockSize, urlconn->dataStream);
+    done = numBytes < kFeedBlockSize; // fread comes up short only at the end of the stream
+    if (XML_ParseBuffer(rssFeedParser, numBytes, done) == XML_STATUS_ERROR) {
+      printf("[Stopped reading \"%s\" at line %lu: %s.]\n", feedURL,
+             (unsigned long) XML_GetCurrentLineNumber(rssFeedParser),
+             XML_ErrorString(XML_GetErrorCode(rssFeedParser)));
+      break;
+    }
   }
-  STDispose(&st);
-  
-  XML_Parse(rssFeedParser, "", 0, true); // instructs the xml parser that we're done parsing..
   XML_ParserFree(rssFeedParser);
+
+  int numItems = VectorLength(&state.itemFingerprints);
+  FeedCacheRemember(&db->feedItems, feedURL, (numItems == 0) ? NULL : VectorNth(&state.itemFingerprints, 0), numItems);
+  if (state.numKnownItems > 0)
+    printf("[Skipped %d of the %d items in \"%s\": they were there last time too.]\n",
+           state.numKnownItems, numItems, feedURL);
+  VectorDispose(&state.itemFingerprints);
+  FeedItemsDispose(&state.knownItems);
+  TextBuilderDispose(&entry->title);
+  TextBuilderDispose(&entry->description);
+  TextBuilderDispose(&entry->url);
+  TextBuilderDispose(&entry->guid);
 }
 
 static void ProcessStartTag(void *userData, const char *name, const char **atts) {
   rssFeedState *state = userData;
   rssFeedEntry *entry = &state->entry;
   if (strcasecmp(name, "item") == 0) {
-    memset(entry, 0, sizeof(rssFeedEntry));
+    TextBuilderClear(&entry->title);
+    TextBuilderClear(&entry->description);
+    TextBuilderClear(&entry->url);
+    TextBuilderClear(&entry->guid);
+    entry->activeField = NULL;
   } else if (strcasecmp(name, "title") == 0) {
-    entry->activeField = entry->title;
+    entry->activeField = &entry->title;
+  } else if (strcasecmp(name, "description") == 0) {
+    entry->activeField = &entry->description;
   } else if (strcasecmp(name, "link") == 0) {
-    entry->activeField = entry->url;
+    entry->activeField = &entry->url;
+  } else if (strcasecmp(name, "guid") == 0) {
+    entry->activeField = &entry->guid;
   }
 }
 
@@ -210,223 +742,1080 @@ static void ProcessEndTag(void *userData, const char *name) {
   rssFeedEntry *entry = &state->entry;
   entry->activeField = NULL;
   if (strcasecmp(name, "item") == 0) {
-    articleTask *task = malloc(sizeof(articleTask));
-    task->db = state->db;
-    strcpy(task->articleTitle, entry->title);
-    strcpy(task->articleURL, entry->url);
-
-    pthread_t thread;
-    pthread_create(&thread, NULL, DownloadAndParseArticle, task);
-    pthread_detach(thread);
+    uint64_t fingerprint = ItemFingerprint(entry);
+    VectorAppend(&state->itemFingerprints, &fingerprint);
+    if (FeedItemsContain(&state->knownItems, fingerprint)) {
+      state->numKnownItems++;
+      return;
+    }
+    articleTask task = { state->db, strdup(TextBuilderText(&entry->title)),
+                         strdup(TextBuilderText(&entry->description)), strdup(TextBuilderText(&entry->url)) };
+    ThreadPoolSchedule(&state->db->articleWorkers, &task);
   }
 }
 
+// An item is known by its guid, or failing that its link.  The few with neither are known by
+// their title and description, rather than all being taken for the same item.
+static uint64_t ItemFingerprint(const rssFeedEntry *entry) {
+  if (entry->guid.length > 0) return Fingerprint(kFingerprintSeed, TextBuilderText(&entry->guid), entry->guid.length);
+  if (entry->url.length > 0) return Fingerprint(kFingerprintSeed, TextBuilderText(&entry->url), entry->url.length);
+  uint64_t fingerprint = Fingerprint(kFingerprintSeed, TextBuilderText(&entry->title), entry->title.length + 1);
+  return Fingerprint(fingerprint, TextBuilderText(&entry->description), entry->description.length);
+}
+
 static void ProcessTextData(void *userData, const char *text, int len) {
   rssFeedState *state = userData;
   rssFeedEntry *entry = &state->entry;
-  if (entry->activeField == NULL) return;
-  char buffer[len + 1];
-  memcpy(buffer, text, len);
-  buffer[len] = '\0';
-  strncat(entry->activeField, buffer, 2048);
+  if (entry->activeField != NULL) TextBuilderAppend(entry->activeField, text, len);
+}
+
+static void DownloadAndParseArticle(void *taskAddr, void *auxData) {
+  articleTask *task = taskAddr;
+  ParseArticle(task->db, task->articleTitle, task->articleDescription, task->articleURL);
+  free(task->articleTitle);
+  free(task->articleDescription);
+  free(task->articleURL);
 }
 
-static void ParseArticle(rssDatabase *db, const char *articleTitle, const char *articleURL) {
-  sem_wait(&semaphore);
-  sem_wait(&mutex);
+/**
+ * An article is a duplicate if we've already claimed its URL, or an article
+ * with the same title on the same server (the same story often appears in
+ * several of a site's feeds under different links).  Both fingerprints are
+ * claimed in one step before we ever connect, so two workers racing on the
+ * same story can't both index it.  An article that fails to download stays
+ * claimed, and isn't retried should it turn up again in another feed.
+ * A copy of a story under another URL and title gets past both checks,
+ * but is caught once it's been read, by RegisterArticle.  An untitled
+ * article has only its URL to go on, since all of a server's untitled
+ * articles would otherwise be taken for one another.
+ *
+ * In feed-only mode, nothing's downloaded at all: the article is indexed
+ * under the title and description its feed gives it, and nothing more.
+ */
 
+static void ParseArticle(rssDatabase *db, const char *articleTitle, const char *articleDescription,
+                         const char *articleURL) {
   url u;
-  urlconnection urlconn;
-  streamtokenizer st;
-  int articleID;
-  
   URLNewAbsolute(&u, articleURL);
-  rssNewsArticle newsArticle = { articleTitle, u.serverName, u.fullName };
-  if (VectorSearch(&db->previouslySeenArticles, &newsArticle, NewsArticleCompare, 0, false) >= 0) {
+  uint64_t fingerprints[] = { URLFingerprint(&u), TitleFingerprint(&u, articleTitle) };
+  if (!FingerprintSetClaim(&db->seenArticles, fingerprints, (fingerprints[1] == 0) ? 1 : 2)) {
     printf("[Ignoring \"%s\": we've seen it before.]\n", articleTitle);
-    URLDispose(&u);
-    sem_post(&mutex);
-    sem_post(&semaphore);
-    return;
+  } else if (db->feedOnly) {
+    IndexArticle(db, &u, NULL, articleTitle, articleDescription);
+  } else {
+    FetchArticle(db, articleTitle, articleDescription, &u);
   }
+  URLDispose(&u);
+}
 
-  // function for threaded article parsing
-  // Define the function for threaded article parsing
-  static void* ThreadedParseArticle(void *args) { 
-    // Cast the input argument to threadArgs type
-    threadArgs *tArgs = (threadArgs *) args;
-    // Extract the database pointer from thread arguments
-    rssDatabase *db = tArgs->db;
-    // Extract the article title from thread arguments
-    const char *articleTitle = tArgs->articleTitle;
-    // Extract the article URL from thread arguments
-    const char *articleURL = tArgs->articleURL;
-
-    // Parse the article using the provided database, title, and URL
-    ParseArticle(db, articleTitle, articleURL);
-
-    // Free the allocated memory for thread arguments
-    free(tArgs); 
-    // Release the semaphore
-    sem_post(&semaphore); 
-    // Return NULL to indicate the end of the thread
-    return NULL;
-  }
+static void FetchArticle(rssDatabase *db, const char *articleTitle, const char *articleDescription, url *u) {
+  urlconnection urlconn;
+  char *redirectURL = NULL;
   
-  URLConnectionNew(&urlconn, &u);
+  ConnectionLimiterAcquire(&db->connections, u->serverName);
+  URLConnectionNew(&urlconn, u);
   switch (urlconn.responseCode) {
-    case 0: printf("Unable to connect to \"%s\". Domain name or IP address is nonexistent.\n", articleURL); break;
+    case 0: printf("Unable to connect to \"%s\". Domain name or IP address is nonexistent.\n", u->fullName); break;
     case 200: 
-      printf("[%s] Indexing \"%s\"\n", u.serverName, articleTitle);
-      NewsArticleClone(&newsArticle, articleTitle, u.serverName, u.fullName);
-      VectorAppend(&db->previouslySeenArticles, &newsArticle);
-      articleID = VectorLength(&db->previouslySeenArticles) - 1;
-      STNew(&st, urlconn.dataStream, " \t\n\r\b!@$%^*()_+={[}]|\\'\":;/?.>,<~`", false);
-      ScanArticle(&st, articleID, &db->indices, &db->stopWords);
-      STDispose(&st);
+      IndexArticle(db, u, urlconn.dataStream, articleTitle, articleDescription);
       break;
     case 301:
     case 302: 
-      ParseArticle(db, articleTitle, urlconn.newUrl); 
+      redirectURL = strdup(urlconn.newUrl); // followed once the connection is released
       break;
     default: 
-      printf("Unable to pull \"%s\" from \"%s\". [Response code: %d] Punting...\n", articleTitle, u.serverName, urlconn.responseCode);
+      printf("Unable to pull \"%s\" from \"%s\". [Response code: %d] Punting...\n", articleTitle, u->serverName, urlconn.responseCode);
       break;
   }
 
   URLConnectionDispose(&urlconn);
-  URLDispose(&u);
-  
-  sem_post(&mutex);
-  sem_post(&semaphore);
+  ConnectionLimiterRelease(&db->connections, u->serverName);
+  if (redirectURL == NULL) return;
+
+  // the title's already ours, but some other link may have led to the same place
+  url redirect;
+  URLNewAbsolute(&redirect, redirectURL);
+  uint64_t fingerprint = URLFingerprint(&redirect);
+  if (FingerprintSetClaim(&db->seenArticles, &fingerprint, 1)) {
+    FetchArticle(db, articleTitle, articleDescription, &redirect);
+  } else {
+    printf("[Ignoring \"%s\": we've seen it before.]\n", articleTitle);
+  }
+  URLDispose(&redirect);
+  free(redirectURL);
 }
 
-static void ScanArticle(streamtokenizer *st, int articleID, hashset *indices, hashset *stopWords) {
-  char word[1024];
+/**
+ * Adds the article to previouslySeenArticles, and returns the id it's indexed under,
+ * unless its content signature is within kMaxNearDuplicateDistance bits of one already
+ * there.  Then it's a near-duplicate (typically the same syndicated story, listed by
+ * another site under its own URL and title), so it's dropped, and -1 is returned.
+ * The check and the addition happen under one lock, so of two workers holding copies
+ * of the same story, just one indexes it.
+ */
 
-  while (STNextToken(st, word, sizeof(word))) {
-    if (strcasecmp(word, "<") == 0) {
-      SkipIrrelevantContent(st);
-    } else {
-      RemoveEscapeCharacters(word);
-      if (WordIsWorthIndexing(word, stopWords))
-        AddWordToIndices(indices, word, articleID);
-    }
+static int RegisterArticle(rssDatabase *db, const char *articleTitle, const url *u, uint64_t contentSignature) {
+  rssNewsArticle newsArticle;
+  NewsArticleClone(&newsArticle, articleTitle, u->serverName, u->fullName);
+  newsArticle.urlFingerprint = URLFingerprint(u);
+  newsArticle.titleFingerprint = TitleFingerprint(u, articleTitle);
+  newsArticle.contentSignature = contentSignature;
+
+  int articleID = -1;
+  const char *originalTitle = NULL; // strings in previouslySeenArticles outlive the lock
+  sem_wait(&db->lock);
+  int originalID = (contentSignature == 0) ? -1 : SimHashIndexFind(&db->nearDuplicates, contentSignature);
+  if (originalID >= 0) {
+    originalTitle = ((rssNewsArticle *) VectorNth(&db->previouslySeenArticles, originalID))->title;
+  } else {
+    VectorAppend(&db->previouslySeenArticles, &newsArticle);
+    articleID = VectorLength(&db->previouslySeenArticles) - 1;
+    if (contentSignature != 0) SimHashIndexAdd(&db->nearDuplicates, contentSignature, articleID);
   }
+  sem_post(&db->lock);
+
+  if (articleID >= 0) {
+    printf("[%s] Indexing \"%s\"\n", u->serverName, articleTitle);
+  } else {
+    printf("[Ignoring \"%s\": it's nearly the same as \"%s\".]\n", articleTitle, originalTitle);
+    NewsArticleFree(&newsArticle);
+  }
+  return articleID;
 }
 
-static bool WordIsWorthIndexing(const char *word, hashset *stopWords) {
-  return WordIsWellFormed(word) && HashSetLookup(stopWords, &word) == NULL;
+static const char kTitleFingerprintDomain[] = "title";
+
+// Server names are case-insensitive and fragments never reach the server, so
+// neither distinguishes one article from another.  (Fingerprints ignore case
+// altogether, just as the old string comparisons did.)
+static uint64_t URLFingerprint(const url *u) {
+  uint64_t fingerprint = Fingerprint(kFingerprintSeed, u->serverName, strlen(u->serverName) + 1);
+  return Fingerprint(fingerprint, u->fileName, strcspn(u->fileName, "#"));
 }
 
-static void AddWordToIndices(hashset *indices, const char *word, int articleIndex) {
-  rssIndexEntry indexEntry = { word }; // partial initialization
-  rssIndexEntry *existingIndexEntry = HashSetLookup(indices, &indexEntry);
+// Titles are compared without any surrounding whitespace, which feeds are inconsistent about.
+// They're fingerprinted from a seed of their own, so no title can ever pass for a URL on the
+// same server, and a title that's nothing but whitespace has no fingerprint at all: 0 is returned.
+static uint64_t TitleFingerprint(const url *u, const char *articleTitle) {
+  while (isspace((unsigned char) *articleTitle)) articleTitle++;
+  int length = strlen(articleTitle);
+  while (length > 0 && isspace((unsigned char) articleTitle[length - 1])) length--;
+  if (length == 0) return 0;
+  uint64_t fingerprint = Fingerprint(kFingerprintSeed, kTitleFingerprintDomain, sizeof(kTitleFingerprintDomain));
+  fingerprint = Fingerprint(fingerprint, u->serverName, strlen(u->serverName) + 1);
+  return Fingerprint(fingerprint, articleTitle, length);
+}
+
+static const char *const kTextDelimiters = " \t\n\r\b!@$%^*()_+={[}]|\\'\":;/?.>,<~`";
+
+/**
+ * An article's terms are counted field by field, in a small hashset private to
+ * the article: the body, if there is one, and then the title and description
+ * its feed lists, which come along with the item and cost no download.  Only
+ * once all three have been read does each distinct term contribute its one
+ * posting, recording its count in each field, to the worker's shard.
+ *
+ * Unless the index is to do without them, the posting records the position
+ * of every occurrence too.  Each field's positions start at the field's number
+ * times 2^kFieldPositionShift, so a phrase can never span two fields, and the
+ * field an occurrence is in can be read off its position.  Anything past the
+ * first 2^kFieldPositionShift terms of a field isn't indexed at all.
+ *
+ * As the body is scanned, every run of kShingleLength consecutive terms is
+ * added to the article's simhash, and only once the signature's complete is
+ * the article registered, so that a near-duplicate of one already indexed can
+ * be dropped before any of its terms are.  Runs of terms, unlike terms alone,
+ * are rarely shared by articles that merely cover the same news, and feeds
+ * retitle the stories they syndicate, so neither the title nor the description
+ * counts towards the signature, unless there's no body to go on.  An article
+ * with fewer than kMinSignatureShingles runs gets no signature at all, since
+ * there's too little of it to tell whether it's a duplicate.
+ */
+
+static const int kFieldPositionShift = 24;
+static const int kShingleLength = 3;
+static const uint64_t kShingleHashMultiplier = 1099511628211ULL;
+static const int kMinSignatureShingles = 16;
+
+static const int kNumArticleTermBuckets = 251;
+static void IndexArticle(rssDatabase *db, const url *u, FILE *body, const char *title, const char *description) {
+  hashset termCounts;
+  simhash signature;
+  HashSetNew(&termCounts, sizeof(rssTermCount), kNumArticleTermBuckets, HashedWordHash, HashedWordCompare, NULL);
+  SimHashNew(&signature);
+  if (body != NULL) ScanArticle(db, body, kBodyField, &termCounts, &signature);
+  ScanFeedText(db, title, kTitleField, &termCounts, NULL);
+  ScanFeedText(db, description, kDescriptionField, &termCounts, (body == NULL) ? &signature : NULL);
+
+  uint64_t contentSignature = (signature.numFeatures < kMinSignatureShingles) ? 0 : SimHashValue(&signature);
+  int articleID = RegisterArticle(db, title, u, contentSignature);
+  if (articleID >= 0) {
+    rssPostingDestination destination = { &db->shards[ThreadPoolWorkerIndex(&db->articleWorkers)], articleID,
+                                           db->recordPositions };
+    HashSetMap(&termCounts, AddTermToIndices, &destination); // hands off or frees every word
+  } else {
+    HashSetMap(&termCounts, DiscardTermCount, &db->recordPositions);
+  }
+  HashSetDispose(&termCounts);
+}
+
+// Descriptions often hold escaped HTML, which expat has unescaped into markup the termscanner skips.
+static void ScanFeedText(rssDatabase *db, const char *text, postingfield field, hashset *termCounts,
+                         simhash *signature) {
+  if (*text == '\0') return; // some fmemopens refuse empty buffers
+  FILE *infile = fmemopen((char *) text, strlen(text), "r");
+  if (infile == NULL) return;
+  ScanArticle(db, infile, field, termCounts, signature);
+  fclose(infile);
+}
+
+// The termscanner skips tags, decodes escapes, folds, validates, hashes and drops stop
+// words as it reads each byte, and then stems, so every term it hands back is ready to
+// count.  Stop words have no position of their own, so a phrase skips right over them.
+// If signature is non-NULL, every shingle (run of kShingleLength terms) is added to it,
+// identified by the hash codes of its terms.
+static void ScanArticle(rssDatabase *db, FILE *infile, postingfield field, hashset *termCounts,
+                        simhash *signature) {
+  termscanner ts;
+  scannedterm term;
+  int position = field << kFieldPositionShift, end = (field + 1) << kFieldPositionShift;
+  uint64_t shingle[kShingleLength];
+  int numScanned = 0;
+
+  TSNew(&ts, infile, kTextDelimiters, &db->stopWords, &db->normalizer);
+  while (position < end && TSNextTerm(&ts, &term)) {
+    CountTerm(termCounts, &term, field, db->recordPositions ? position++ : -1);
+    if (signature == NULL) continue;
+    shingle[numScanned++ % kShingleLength] = term.hashcode;
+    if (numScanned >= kShingleLength) SimHashAdd(signature, ShingleHash(shingle, numScanned));
+  }
+  TSDispose(&ts);
+}
+
+// Combines the hash codes of the last kShingleLength terms, the latest of which is the
+// (numScanned - 1)th, in the order they were scanned.
+static uint64_t ShingleHash(const uint64_t shingle[], int numScanned) {
+  uint64_t hashcode = 0;
+  for (int i = 0; i < kShingleLength; i++)
+    hashcode = hashcode * kShingleHashMultiplier + shingle[(numScanned + i) % kShingleLength];
+  return hashcode;
+}
+
+// A negative position means positions aren't being recorded.
+static void CountTerm(hashset *termCounts, const scannedterm *term, postingfield field, int position) {
+  rssTermCount termCount = { term->text, term->hashcode };
+  rssTermCount *existingTermCount = HashSetLookup(termCounts, &termCount);
+  if (existingTermCount == NULL) {
+    termCount.word = strdup(term->text);
+    if (position >= 0) VectorNew(&termCount.positions, sizeof(int), NULL, 4);
+    HashSetEnter(termCounts, &termCount);
+    existingTermCount = HashSetLookup(termCounts, &termCount);
+    assert(existingTermCount != NULL);
+  }
+
+  existingTermCount->fieldFreqs[field]++;
+  if (position >= 0) VectorAppend(&existingTermCount->positions, &position);
+}
+
+static void AddTermToIndices(void *elem, void *auxData) {
+  rssTermCount *termCount = elem;
+  rssPostingDestination *destination = auxData;
+  rssIndexEntry indexEntry = { termCount->word, termCount->hashcode }; // partial initialization
+  rssIndexEntry *existingIndexEntry = HashSetLookup(destination->indices, &indexEntry);
   if (existingIndexEntry == NULL) {
-    indexEntry.meaningfulWord = strdup(word);
-    VectorNew(&indexEntry.relevantArticles, sizeof(rssRelevantArticleEntry), NULL, 0);
-    HashSetEnter(indices, &indexEntry);
-    existingIndexEntry = HashSetLookup(indices, &indexEntry); // pretend like it's been there all along
+    PostingListNew(&indexEntry.relevantArticles);
+    HashSetEnter(destination->indices, &indexEntry); // the index now owns the word
+    existingIndexEntry = HashSetLookup(destination->indices, &indexEntry);
     assert(existingIndexEntry != NULL);
+  } else {
+    free((char *) termCount->word);
+  }
+
+  const int *positions = destination->recordPositions ? VectorNth(&termCount->positions, 0) : NULL;
+  PostingListAppend(&existingIndexEntry->relevantArticles, destination->articleIndex, termCount->fieldFreqs, positions);
+  if (destination->recordPositions) VectorDispose(&termCount->positions);
+}
+
+// Frees what AddTermToIndices would have handed off, for an article that isn't indexed after all.
+static void DiscardTermCount(void *elem, void *auxData) {
+  rssTermCount *termCount = elem;
+  bool recordPositions = *(bool *) auxData;
+  free((char *) termCount->word);
+  if (recordPositions) VectorDispose(&termCount->positions);
+}
+
+/**
+ * Folds every shard into the pending snapshot's index.  A word seen by only one worker has its
+ * entry handed over wholesale; otherwise the shard's postings are merged with
+ * the ones already there.  Each worker claims its article ids in increasing
+ * order, but the workers' ids interleave, so the merge keeps the combined list
+ * in article order.  No article is ever scanned by more than one worker, so the
+ * two lists never share a posting.
+ */
+
+static void MergeShards(rssDatabase *db, int numShards) {
+  for (int i = 0; i < numShards; i++) {
+    HashSetMap(&db->shards[i], MergeIndexEntry, &db->pending->indices);
+    HashSetDispose(&db->shards[i]);
   }
+  free(db->shards);
+  db->shards = NULL;
+}
 
-  rssRelevantArticleEntry articleEntry = { articleIndex, 0 };
-  int existingArticleIndex =
-    VectorSearch(&existingIndexEntry->relevantArticles, &articleEntry, ArticleIndexCompare, 0, false);
-  if (existingArticleIndex == -1) {
-    VectorAppend(&existingIndexEntry->relevantArticles, &articleEntry);
-    existingArticleIndex = VectorLength(&existingIndexEntry->relevantArticles) - 1;
+static void MergeIndexEntry(void *elem, void *auxData) {
+  rssIndexEntry *shardEntry = elem;
+  hashset *indices = auxData;
+  rssIndexEntry *existingIndexEntry = HashSetLookup(indices, shardEntry);
+  if (existingIndexEntry == NULL) {
+    HashSetEnter(indices, shardEntry); // indices now owns the word and its postings
+    return;
   }
-  
-  rssRelevantArticleEntry *existingArticleEntry = 
-    VectorNth(&existingIndexEntry->relevantArticles, existingArticleIndex);
-  existingArticleEntry->freq++;
+
+  postinglist merged;
+  PostingListMerge(&merged, &existingIndexEntry->relevantArticles, &shardEntry->relevantArticles);
+  if (existingIndexEntry->shared != NULL) { // published snapshots keep the old postings, and share the word
+    ReleaseSharedPostings(existingIndexEntry->shared);
+    existingIndexEntry->shared = NULL;
+    existingIndexEntry->meaningfulWord = shardEntry->meaningfulWord;
+    PostingListDispose(&shardEntry->relevantArticles);
+  } else {
+    PostingListDispose(&existingIndexEntry->relevantArticles);
+    IndexEntryFree(shardEntry);
+  }
+  existingIndexEntry->relevantArticles = merged;
+}
+
+/**
+ * Each crawl indexes into a pending snapshot that starts out as a copy of the
+ * published one.  Once a snapshot's published, every word and posting list in
+ * it belongs to an rssSharedPostings, which each later snapshot's copy of the
+ * entry just views and counts itself in, so copying allocates nothing beyond
+ * the entries themselves.  Only a word the crawl finds in new articles gets new
+ * postings, merged from the shared ones and the crawl's, and those are shared
+ * in turn when the pending snapshot's published.  Shared postings are freed
+ * along with the last snapshot holding them.  In exchange for the copying,
+ * published snapshots are never written to again, and queries read them
+ * without locks.
+ */
+
+static const int kNumIndexBuckets = 10007;
+static rssIndexSnapshot *NewSnapshot(rssDatabase *db, rssIndexSnapshot *base) {
+  rssIndexSnapshot *snapshot = malloc(sizeof(rssIndexSnapshot));
+  assert(snapshot != NULL);
+  HashSetNew(&snapshot->indices, sizeof(rssIndexEntry), kNumIndexBuckets, IndexEntryHash, IndexEntryCompare, IndexEntryFree);
+  TermDictionaryNew(&snapshot->terms, NULL, 0); // built for real once the snapshot's published
+  VectorNew(&snapshot->articles, sizeof(rssNewsArticle), NULL, 0); // the strings belong to previouslySeenArticles
+  snapshot->stopWords = &db->stopWords;
+  snapshot->normalizer = &db->normalizer;
+  if (base != NULL) HashSetMap(&base->indices, CopyIndexEntry, &snapshot->indices);
+  return snapshot;
+}
+
+static void CopyIndexEntry(void *elem, void *auxData) {
+  rssIndexEntry *entry = elem;
+  hashset *indices = auxData;
+  assert(entry->shared != NULL); // published entries are all shared
+  __atomic_add_fetch(&entry->shared->numEntries, 1, __ATOMIC_RELAXED);
+  HashSetEnter(indices, entry);
+}
+
+// Snapshots can be freed by whichever thread releases them last, so the count is changed atomically.
+static void ReleaseSharedPostings(rssSharedPostings *shared) {
+  if (__atomic_sub_fetch(&shared->numEntries, 1, __ATOMIC_ACQ_REL) > 0) return;
+  free(shared->word);
+  PostingListDispose(&shared->postings);
+  free(shared);
+}
+
+// Only the thread running the crawl appends to previouslySeenArticles, and the crawl is over.
+// The index won't change again, so it's time to build the dictionary of its words.
+static void PublishSnapshot(rssDatabase *db) {
+  for (int i = 0; i < VectorLength(&db->previouslySeenArticles); i++)
+    VectorAppend(&db->pending->articles, VectorNth(&db->previouslySeenArticles, i));
+
+  vector words;
+  VectorNew(&words, sizeof(char *), NULL, HashSetCount(&db->pending->indices) + 1);
+  HashSetMap(&db->pending->indices, CollectWord, &words);
+  VectorSort(&words, StringCompare);
+  TermDictionaryDispose(&db->pending->terms);
+  TermDictionaryNew(&db->pending->terms, (VectorLength(&words) == 0) ? NULL : VectorNth(&words, 0), VectorLength(&words));
+  VectorDispose(&words);
+  HashSetMap(&db->pending->indices, ShareIndexEntry, NULL);
+
+  SnapshotCellPublish(&db->published, db->pending);
+  db->pending = NULL;
+}
+
+// Hands whatever the entry owns over to a new rssSharedPostings, and leaves the entry viewing it.
+static void ShareIndexEntry(void *elem, void *auxData) {
+  rssIndexEntry *entry = elem;
+  if (entry->shared != NULL) return;
+  rssSharedPostings *shared = malloc(sizeof(rssSharedPostings));
+  assert(shared != NULL);
+  shared->word = (char *) entry->meaningfulWord;
+  shared->postings = entry->relevantArticles;
+  shared->numEntries = 1;
+  entry->shared = shared;
+  PostingListView(&entry->relevantArticles, shared->postings.bytes, shared->postings.numBytes, shared->postings.count,
+                  shared->postings.lastArticleIndex, shared->postings.skips, shared->postings.numSkips);
+}
+
+static void CollectWord(void *elem, void *auxData) {
+  rssIndexEntry *entry = elem;
+  VectorAppend(auxData, &entry->meaningfulWord);
+}
+
+static int StringCompare(const void *elem1, const void *elem2) {
+  return strcmp(*(const char **) elem1, *(const char **) elem2);
+}
+
+static void SnapshotFree(void *snapshot) {
+  rssIndexSnapshot *indexSnapshot = snapshot;
+  HashSetDispose(&indexSnapshot->indices);
+  TermDictionaryDispose(&indexSnapshot->terms);
+  VectorDispose(&indexSnapshot->articles);
+  free(indexSnapshot);
+}
+
+/**
+ * With a refresh interval, a background thread re-crawls the feeds that often,
+ * indexing whatever's appeared since into a new snapshot, saving it as the next
+ * segment, and publishing it, all while queries carry on against the last one.
+ * Articles already indexed are recognized by their fingerprints and skipped.
+ * When saved segments were loaded at startup, they're published straight away,
+ * and the same thread runs the startup crawl too, before any waiting; without
+ * an interval, that crawl is its only one.  Stopping waits for a crawl that's
+ * underway to finish, the startup crawl included, so whatever it finds is saved
+ * however soon queries end.  SIGINT and SIGTERM are left to the thread serving
+ * queries.
+ */
+
+static void StartRefreshing(rssRefresher *refresher, rssDatabase *db, const char *feedsFileName,
+                            const char *indexName, int interval, bool crawlFirst) {
+  refresher->db = db;
+  refresher->feedsFileName = feedsFileName;
+  refresher->indexName = indexName;
+  refresher->interval = interval;
+  refresher->crawlFirst = crawlFirst;
+  refresher->stopRequested = false;
+  pthread_mutex_init(&refresher->lock, NULL);
+  pthread_cond_init(&refresher->stopRequestedChanged, NULL);
+
+  sigset_t shutdownSignals, oldMask; // the crawl's workers inherit the mask too
+  sigemptyset(&shutdownSignals);
+  sigaddset(&shutdownSignals, SIGINT);
+  sigaddset(&shutdownSignals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &shutdownSignals, &oldMask);
+  pthread_create(&refresher->thread, NULL, RefreshPeriodically, refresher);
+  pthread_sigmask(SIG_SETMASK, &oldMask, NULL);
+}
+
+static void *RefreshPeriodically(void *arg) {
+  rssRefresher *refresher = arg;
+  bool crawlNow = refresher->crawlFirst;
+  pthread_mutex_lock(&refresher->lock);
+  while (crawlNow || refresher->interval > 0) {
+    if (!crawlNow) {
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_sec += refresher->interval;
+      while (!refresher->stopRequested &&
+             pthread_cond_timedwait(&refresher->stopRequestedChanged, &refresher->lock, &deadline) != ETIMEDOUT);
+      if (refresher->stopRequested) break;
+    }
+
+    crawlNow = false;
+    pthread_mutex_unlock(&refresher->lock);
+    RefreshIndex(refresher->db, refresher->feedsFileName, refresher->indexName);
+    pthread_mutex_lock(&refresher->lock);
+  }
+  pthread_mutex_unlock(&refresher->lock);
+  return NULL;
+}
+
+static void RefreshIndex(rssDatabase *db, const char *feedsFileName, const char *indexName) {
+  rssIndexSnapshot *current = SnapshotCellAcquire(&db->published);
+  db->pending = NewSnapshot(db, current);
+  SnapshotCellRelease(&db->published, current);
+
+  int numArticles = VectorLength(&db->previouslySeenArticles);
+  BuildIndices(db, feedsFileName);
+  int numNewArticles = VectorLength(&db->previouslySeenArticles) - numArticles;
+  SaveIndex(db, indexName); // the feed cache has changed even if the index hasn't
+  if (numNewArticles == 0) {
+    SnapshotFree(db->pending);
+    db->pending = NULL;
+    printf("Refreshed the feeds, but found no new articles.\n");
+  } else {
+    PublishSnapshot(db);
+    printf("Refreshed the feeds and indexed %d new article%s.\n", numNewArticles, (numNewArticles == 1) ? "" : "s");
+  }
+  fflush(stdout);
+}
+
+static void StopRefreshing(rssRefresher *refresher) {
+  pthread_mutex_lock(&refresher->lock);
+  refresher->stopRequested = true;
+  pthread_cond_signal(&refresher->stopRequestedChanged);
+  pthread_mutex_unlock(&refresher->lock);
+
+  pthread_join(refresher->thread, NULL);
+  pthread_cond_destroy(&refresher->stopRequestedChanged);
+  pthread_mutex_destroy(&refresher->lock);
 }
 
 static void QueryIndices(rssDatabase *db) {
   char response[1024];
   while (true) {
-    printf("Please enter a single query term that might be in our set of indices [enter to quit]: ");
+    printf("Please enter a query term, or several joined by OR and NOT, that might be in our set of indices [enter to quit]: ");
     fgets(response, sizeof(response), stdin);
     response[strlen(response) - 1] = '\0';
     if (strcasecmp(response, "") == 0) break;
     ProcessResponse(db, response);
   }
-  
-  HashSetDispose(&db->indices);
+}
+
+/**
+ * The alternative to QueryIndices for when the program runs as a daemon.  Each
+ * request is a query, exactly as it would be typed at the prompt, and each
+ * reply is a line holding the number of matching articles, followed by a line
+ * for each of the top ones, best first, of the form
+ *
+ *     <score> TAB <occurrences> TAB <title> TAB <url>
+ *
+ * and then the empty line that ends every reply.  Each query reads whichever
+ * snapshot of the index was published last, so any number can run at once.
+ */
+
+static const int kNumQueryWorkers = 4;
+static void ServeQueries(rssDatabase *db, const char *socketPath) {
+  printf("Serving queries on \"%s\" until interrupted...\n", socketPath);
+  fflush(stdout);
+  if (!QueryServerRun(socketPath, kNumQueryWorkers, AnswerQuery, db))
+    printf("Unable to serve queries on \"%s\".\n", socketPath);
+}
+
+static void AnswerQuery(const char *request, FILE *reply, void *auxData) {
+  rssDatabase *db = auxData;
+  rssIndexSnapshot *snapshot = SnapshotCellAcquire(&db->published);
+  const postinglist *terms[MaxQueryWords(request)];
+  postinglist matches, computed[MaxQueryWords(request)];
+  boundedheap topArticles;
+  int numComputed;
+
+  int numTerms = EvaluateQuery(snapshot, request, &matches, terms, computed, &numComputed, false);
+  RankArticles(&matches, terms, numTerms, VectorLength(&snapshot->articles), &topArticles);
+  fprintf(reply, "%d\n", PostingListCount(&matches));
+  for (int i = 0; i < BoundedHeapCount(&topArticles); i++) {
+    const rssScoredArticle *scoredArticle = BoundedHeapNth(&topArticles, i);
+    const rssNewsArticle *relevantArticle = VectorNth(&snapshot->articles, scoredArticle->articleIndex);
+    fprintf(reply, "%.4f\t%d\t", scoredArticle->score, scoredArticle->freq);
+    PrintField(reply, relevantArticle->title);
+    fputc('\t', reply);
+    PrintField(reply, relevantArticle->fullURL);
+    fputc('\n', reply);
+  }
+
+  BoundedHeapDispose(&topArticles);
+  PostingListDispose(&matches);
+  for (int i = 0; i < numComputed; i++) PostingListDispose(&computed[i]);
+  SnapshotCellRelease(&db->published, snapshot);
+}
+
+// Titles come straight from the feeds, so any tabs or line breaks are flattened into spaces.
+static void PrintField(FILE *outfile, const char *text) {
+  for (const char *c = text; *c != '\0'; c++)
+    fputc((*c == '\t' || *c == '\n' || *c == '\r') ? ' ' : *c, outfile);
+}
+
+static void DisposeDatabase(rssDatabase *db) {
+  SnapshotCellDispose(&db->published);
+  VectorDispose(&db->segments); // only once nothing's left viewing them
   VectorDispose(&db->previouslySeenArticles); 
+  FingerprintSetDispose(&db->seenArticles);
+  SimHashIndexDispose(&db->nearDuplicates);
+  FeedCacheDispose(&db->feedItems);
   HashSetDispose(&db->stopWords);
+  sem_destroy(&db->lock);
 }
 
-static void ProcessResponse(rssDatabase *db, const char *word) {
-  if (!WordIsWellFormed(word)) {
+static void ProcessResponse(rssDatabase *db, const char *response) {
+  rssIndexSnapshot *snapshot = SnapshotCellAcquire(&db->published);
+  if (strpbrk(response, " \t\"") != NULL) ProcessQuery(snapshot, response);
+  else if (IsPattern(response)) ProcessPattern(snapshot, response);
+  else ProcessWord(snapshot, response);
+  SnapshotCellRelease(&db->published, snapshot);
+}
+
+static void ProcessWord(rssIndexSnapshot *snapshot, const char *response) {
+  if (!WordIsWellFormed(snapshot, response)) {
     printf("That search term couldn't possibly be in our set of indices.\n\n");
     return;
   }
-  
-  if (HashSetLookup(&db->stopWords, &word) != NULL) {
-    printf("\"%s\" is too common a word to be taken seriously. Please be more specific.\n\n", word);
+
+  bool isStopWord;
+  rssIndexEntry *existingIndex = LookUpWord(snapshot, response, &isStopWord);
+  if (isStopWord) {
+    printf("\"%s\" is too common a word to be taken seriously. Please be more specific.\n\n", response);
     return;
   }
 
-  rssIndexEntry entry = { word };
-  rssIndexEntry *existingIndex = HashSetLookup(&db->indices, &entry);
   if (existingIndex == NULL) {
-    printf("None of today's news articles contain the word \"%s\".\n\n", word);
+    printf("None of today's news articles contain the word \"%s\".\n\n", response);
     return;
   }
 
-  ListTopArticles(existingIndex, &db->previouslySeenArticles);
+  int numArticles = PostingListCount(&existingIndex->relevantArticles);
+  printf("Nice! We found %d article%s that include%s the word \"%s\". ", 
+         numArticles, (numArticles == 1) ? "" : "s", (numArticles != 1) ? "" : "s", response);
+  const postinglist *terms[] = { &existingIndex->relevantArticles };
+  ListTopArticles(&existingIndex->relevantArticles, terms, 1, &snapshot->articles);
 }
 
-static void ListTopArticles(rssIndexEntry *matchingEntry, vector *previouslySeenArticles) {
-  int i, numArticles, articleIndex, count;
-  rssRelevantArticleEntry *relevantArticleEntry;
-  rssNewsArticle *relevantArticle;
-  
-  numArticles = VectorLength(&matchingEntry->relevantArticles);
-  printf("Nice! We found %d article%s that include%s the word \"%s\". ", 
-         numArticles, (numArticles == 1) ? "" : "s", (numArticles != 1) ? "" : "s", matchingEntry->meaningfulWord);
-  if (numArticles > 10) { printf("[We'll just list 10 of them, though.]"); numArticles = 10; }
-  printf("\n\n");
-  
-  VectorSort(&matchingEntry->relevantArticles, ArticleFrequencyCompare);
-  for (i = 0; i < numArticles; i++) {
-    relevantArticleEntry = VectorNth(&matchingEntry->relevantArticles, i);
-    articleIndex = relevantArticleEntry->articleIndex;
-    count = relevantArticleEntry->freq;
-    relevantArticle = VectorNth(previouslySeenArticles, articleIndex);
-    printf("\t%2d.) \"%s\" [search term occurs %d time%s]\n", i + 1, 
-           relevantArticle->title, count, (count == 1) ? "" : "s");
-    printf("\t%2s   \"%s\"\n", "", relevantArticle->fullURL);
+static void ProcessPattern(rssIndexSnapshot *snapshot, const char *response) {
+  postinglist matches;
+  int numWords = MatchPattern(snapshot, response, &matches, true);
+  if (numWords == 0) {
+    printf("None of today's news articles contain a word matching \"%s\".\n\n", response);
+  } else {
+    ListCompletions(snapshot, response);
+    int numArticles = PostingListCount(&matches);
+    printf("Nice! We found %d article%s that include%s a word matching \"%s\". ",
+           numArticles, (numArticles == 1) ? "" : "s", (numArticles != 1) ? "" : "s", response);
+    const postinglist *terms[] = { &matches };
+    ListTopArticles(&matches, terms, 1, &snapshot->articles);
   }
-  
-  printf("\n");
+  PostingListDispose(&matches);
+}
+
+/**
+ * A query is one or more groups of words separated by OR, and an article matches
+ * if it matches any group.  To match a group, an article must contain every word
+ * in it (AND can be written between them but needn't be), save those preceded by
+ * NOT or a '-', which it mustn't contain.  Each group is one PostingListIntersect
+ * call, and the groups' results are merged together.  Stop words are dropped, and
+ * a group that requires a word no article contains can't match anything.
+ *
+ * Words in double quotes form a phrase, which an article holds only if the words
+ * appear there in order, one right after the other.  "like this"~N relaxes that,
+ * allowing as many as N other words in among them.  A phrase can be required or
+ * excluded just as a word can, and it ranks the articles that hold it as a word
+ * would, by how often it appears and how few articles it appears in.
+ *
+ * A word with a '*' or '?' in it is a pattern, which stands for every indexed word
+ * it matches: '*' matches any run of characters, and '?' any one.  The articles
+ * holding any of those words are required or excluded as a single word's would be.
+ */
+
+static void ProcessQuery(rssIndexSnapshot *snapshot, const char *response) {
+  const postinglist *terms[MaxQueryWords(response)];
+  postinglist matches, computed[MaxQueryWords(response)];
+  int numComputed;
+
+  int numTerms = EvaluateQuery(snapshot, response, &matches, terms, computed, &numComputed, true);
+  int numArticles = PostingListCount(&matches);
+  if (numArticles == 0) {
+    printf("None of today's news articles match \"%s\".\n\n", response);
+  } else {
+    printf("Nice! We found %d article%s that match%s \"%s\". ", 
+           numArticles, (numArticles == 1) ? "" : "s", (numArticles != 1) ? "" : "es", response);
+    ListTopArticles(&matches, terms, numTerms, &snapshot->articles);
+  }
+  PostingListDispose(&matches);
+  for (int i = 0; i < numComputed; i++) PostingListDispose(&computed[i]);
+}
+
+// Words are separated by at least one space, so a query can't hold any more than this.
+static int MaxQueryWords(const char *query) {
+  return strlen(query) / 2 + 1;
+}
+
+/**
+ * Initializes matches to the articles matching the query, and fills terms with
+ * the posting lists of the distinct words, phrases and patterns it requires (which
+ * are what rank the matches), returning how many there are.  The postings of the
+ * query's phrases and patterns are computed into computed, and *numComputed of them
+ * are left there for the caller to dispose of once it's done with terms.  terms and
+ * computed both need room for MaxQueryWords entries.  Stop words are noted on standard output if
+ * reportStopWords is true.
+ */
+
+static int EvaluateQuery(rssIndexSnapshot *snapshot, const char *query, postinglist *matches,
+                         const postinglist *terms[], postinglist computed[], int *numComputed, bool reportStopWords) {
+  char words[strlen(query) + 1];
+  strcpy(words, query);
+  int maxWords = MaxQueryWords(query);
+  const postinglist *required[maxWords], *excluded[maxWords];
+  int numRequired = 0, numExcluded = 0, numTerms = 0;
+  bool groupCanMatch = true, negateNextWord = false;
+  PostingListNew(matches);
+  *numComputed = 0;
+
+  char *remaining = words;
+  char *word = NextQueryToken(&remaining);
+  while (true) {
+    if (word == NULL || strcmp(word, "OR") == 0) {
+      if (groupCanMatch && numRequired > 0) {
+        postinglist groupMatches, merged;
+        PostingListIntersect(&groupMatches, required, numRequired, excluded, numExcluded);
+        PostingListMerge(&merged, matches, &groupMatches);
+        PostingListDispose(&groupMatches);
+        PostingListDispose(matches);
+        *matches = merged;
+        for (int i = 0; i < numRequired; i++) { // every distinct required word counts toward the ranking
+          int j = 0;
+          while (j < numTerms && terms[j] != required[i]) j++;
+          if (j == numTerms) terms[numTerms++] = required[i];
+        }
+      }
+      numRequired = numExcluded = 0;
+      groupCanMatch = true;
+      if (word == NULL) break;
+    } else if (strcmp(word, "NOT") == 0) {
+      negateNextWord = true;
+    } else if (strcmp(word, "AND") != 0) {
+      bool negated = negateNextWord || word[0] == '-';
+      negateNextWord = false;
+      if (word[0] == '-') word++;
+
+      bool isStopWord = false;
+      const postinglist *postings = NULL;
+      if (word[0] == '"') {
+        isStopWord = !MatchPhrase(snapshot, word, &computed[*numComputed], reportStopWords);
+        if (!isStopWord) postings = &computed[(*numComputed)++];
+      } else if (IsPattern(word)) {
+        MatchPattern(snapshot, word, &computed[*numComputed], reportStopWords);
+        postings = &computed[(*numComputed)++];
+      } else {
+        rssIndexEntry *existingIndex = LookUpWord(snapshot, word, &isStopWord);
+        if (isStopWord && reportStopWords)
+          printf("[Ignoring \"%s\": it's too common a word to be taken seriously.]\n", word);
+        if (existingIndex != NULL) postings = &existingIndex->relevantArticles;
+      }
+
+      if (postings != NULL) {
+        if (negated) excluded[numExcluded++] = postings;
+        else required[numRequired++] = postings;
+      } else if (!negated && !isStopWord) {
+        groupCanMatch = false;
+      }
+    }
+    word = NextQueryToken(&remaining);
+  }
+
+  return numTerms;
 }
 
-static bool WordIsWellFormed(const char *word) {
-  if (strlen(word) == 0) return true;
-  if (!isalpha((int) word[0])) return false;
-  for (int i = 1; i < strlen(word); i++)
-    if (!isalnum((int) word[i]) && (word[i] != '-')) return false; 
+// Splits off the next word of the query, or the next whole phrase, quotes, leading '-'
+// and trailing ~N included, and returns it, or returns NULL if there's nothing left.
+static char *NextQueryToken(char **remaining) {
+  char *token = *remaining + strspn(*remaining, " \t");
+  if (*token == '\0') return NULL;
+
+  char *end = token;
+  char *quote = (token[0] == '"') ? token : (token[0] == '-' && token[1] == '"') ? token + 1 : NULL;
+  if (quote != NULL) {
+    char *closingQuote = strchr(quote + 1, '"');
+    end = (closingQuote == NULL) ? quote + strlen(quote) : closingQuote + 1;
+  }
+  end += strcspn(end, " \t");
+  if (*end != '\0') *end++ = '\0';
+  *remaining = end;
+  return token;
+}
+
+/**
+ * Initializes matches to the articles holding the phrase, as written in the query,
+ * quotes and all, and returns true, or returns false (leaving matches alone) if
+ * the phrase has nothing but stop words in it.  Each posting counts the places the
+ * phrase appears, by the field each begins in, and records no positions.
+ *
+ * The articles holding every word are found by intersecting the words' postings,
+ * and then each one's positions are decoded and checked.  Articles indexed without
+ * positions can't be checked, so they never match, though the ones that might have
+ * are noted on standard output along with the stop words.
+ */
+
+static const int kMaxPhraseSlop = 64;
+static bool MatchPhrase(rssIndexSnapshot *snapshot, char *phrase, postinglist *matches, bool reportStopWords) {
+  int slop = 0;
+  char *closingQuote = strchr(phrase + 1, '"');
+  if (closingQuote != NULL) {
+    if (closingQuote[1] == '~') slop = atoi(closingQuote + 2);
+    *closingQuote = '\0';
+  }
+  if (slop < 0) slop = 0;
+  if (slop > kMaxPhraseSlop) slop = kMaxPhraseSlop;
+
+  const char *text = phrase + 1;
+  char words[strlen(text) + 1];
+  strcpy(words, text);
+  const postinglist *postings[MaxQueryWords(text)];
+  int numWords = 0;
+  bool everyWordIndexed = true;
+  char *remaining;
+  for (char *word = strtok_r(words, " \t", &remaining); word != NULL; word = strtok_r(NULL, " \t", &remaining)) {
+    bool isStopWord = false;
+    rssIndexEntry *existingIndex = LookUpWord(snapshot, word, &isStopWord);
+    if (isStopWord) {
+      if (reportStopWords) printf("[Ignoring \"%s\" in \"%s\": it's too common a word to be taken seriously.]\n", word, text);
+    } else if (existingIndex == NULL) {
+      everyWordIndexed = false;
+    } else {
+      postings[numWords++] = &existingIndex->relevantArticles;
+    }
+  }
 
+  if (numWords == 0 && everyWordIndexed) return false;
+  if (!everyWordIndexed || numWords == 1) { // positions can't matter
+    if (everyWordIndexed) PostingListCopy(matches, postings[0]);
+    else PostingListNew(matches);
+    return true;
+  }
+
+  postinglist candidates;
+  postingiterator candidateIt, wordIts[numWords];
+  int *positions[numWords], numPositions[numWords], allocatedPositions[numWords];
+  int numUnpositioned = 0;
+  for (int i = 0; i < numWords; i++) {
+    PostingIteratorNew(&wordIts[i], postings[i]);
+    positions[i] = NULL;
+    allocatedPositions[i] = 0;
+  }
+
+  PostingListNew(matches);
+  PostingListIntersect(&candidates, postings, numWords, NULL, 0);
+  PostingIteratorNew(&candidateIt, &candidates);
+  while (PostingIteratorNext(&candidateIt)) {
+    bool positioned = true;
+    for (int i = 0; i < numWords && positioned; i++) {
+      PostingIteratorAdvanceTo(&wordIts[i], candidateIt.articleIndex); // it's there, since every list holds it
+      numPositions[i] = wordIts[i].freq;
+      if (numPositions[i] > allocatedPositions[i]) {
+        allocatedPositions[i] = numPositions[i];
+        positions[i] = realloc(positions[i], allocatedPositions[i] * sizeof(int));
+        assert(positions[i] != NULL);
+      }
+      positioned = PostingIteratorPositions(&wordIts[i], positions[i]);
+    }
+
+    if (!positioned) {
+      numUnpositioned++;
+      continue;
+    }
+    int fieldFreqs[kNumPostingFields] = {0};
+    if (CountPhraseOccurrences(positions, numPositions, numWords, slop, fieldFreqs) > 0)
+      PostingListAppend(matches, candidateIt.articleIndex, fieldFreqs, NULL);
+  }
+
+  if (numUnpositioned > 0 && reportStopWords)
+    printf("[%d article%s with every word of \"%s\" w%s indexed without positions, so %s can't be matched as a phrase.]\n",
+           numUnpositioned, (numUnpositioned == 1) ? "" : "s", text, (numUnpositioned == 1) ? "as" : "ere",
+           (numUnpositioned == 1) ? "it" : "they");
+  for (int i = 0; i < numWords; i++) free(positions[i]);
+  PostingListDispose(&candidates);
   return true;
 }
 
-static int StringHash(const void *elem, int numBuckets) {
-  unsigned long hashcode = 0;
-  const char *s = *(const char **) elem;
+static bool IsPattern(const char *word) {
+  return strpbrk(word, "*?") != NULL;
+}
+
+// Folds the pattern's letters, as indexed terms' are, and copies whatever precedes its first wildcard into
+// prefix.  Patterns aren't stemmed, so "elections*" can't match "elect", but "elect*" matches it and much else.
+static void SplitPattern(const termnormalizer *normalizer, const char *pattern, char foldedPattern[], char prefix[]) {
+  TermNormalizerFoldPattern(normalizer, pattern, foldedPattern);
+  int prefixLength = strcspn(foldedPattern, "*?[");
+  memcpy(prefix, foldedPattern, prefixLength);
+  prefix[prefixLength] = '\0';
+}
 
-  for (int i = 0; i < strlen(s); i++)
-    hashcode = hashcode * -1664117991L + tolower(s[i]);
+static bool NextPatternMatch(termiterator *it, const char *foldedPattern) {
+  while (TermIteratorNext(it))
+    if (fnmatch(foldedPattern, it->term, FNM_NOESCAPE) == 0) return true;
+  return false;
+}
 
-  return hashcode % numBuckets;
+static rssIndexEntry *MatchedEntry(rssIndexSnapshot *snapshot, const termiterator *it) {
+  rssIndexEntry key = { it->term, WordHash(it->term) };
+  rssIndexEntry *entry = HashSetLookup(&snapshot->indices, &key);
+  assert(entry != NULL); // the dictionary holds exactly the words in the index
+  return entry;
 }
 
-static int StringCompare(const void *elem1, const void *elem2) {
-  const char *s1 = *(const char **) elem1;
-  const char *s2 = *(const char **) elem2;
-  return strcasecmp(s1, s2);
+/**
+ * Initializes matches to the articles holding any indexed word that matches the
+ * pattern, and returns the number of words that do.  The dictionary is walked from
+ * the first word beginning with whatever precedes the pattern's first wildcard, and
+ * stops at the last, so "presid*" touches only the words it's after, though a
+ * pattern that begins with a wildcard walks the whole dictionary.  Only the first
+ * kMaxPatternWords matching words count, which is noted on standard output if
+ * reportTruncation is true.
+ */
+
+static const int kMaxPatternWords = 256;
+static int MatchPattern(rssIndexSnapshot *snapshot, const char *pattern, postinglist *matches, bool reportTruncation) {
+  char foldedPattern[strlen(pattern) + 1], prefix[strlen(pattern) + 1];
+  SplitPattern(snapshot->normalizer, pattern, foldedPattern, prefix);
+
+  termiterator it;
+  int numWords = 0;
+  PostingListNew(matches);
+  TermIteratorNew(&it, &snapshot->terms, prefix);
+  while (NextPatternMatch(&it, foldedPattern)) {
+    if (numWords == kMaxPatternWords) {
+      if (reportTruncation)
+        printf("[\"%s\" matches more than %d words, so we'll just look for the first %d.]\n",
+               pattern, kMaxPatternWords, kMaxPatternWords);
+      break;
+    }
+
+    rssIndexEntry *entry = MatchedEntry(snapshot, &it);
+    postinglist merged;
+    PostingListMerge(&merged, matches, &entry->relevantArticles);
+    PostingListDispose(matches);
+    *matches = merged;
+    numWords++;
+  }
+  return numWords;
+}
+
+// Lists the first few words matching the pattern, in sorted order, so they can serve as completions.
+static const int kMaxCompletionsListed = 10;
+static void ListCompletions(rssIndexSnapshot *snapshot, const char *pattern) {
+  char foldedPattern[strlen(pattern) + 1], prefix[strlen(pattern) + 1];
+  SplitPattern(snapshot->normalizer, pattern, foldedPattern, prefix);
+
+  termiterator it;
+  int numListed = 0;
+  TermIteratorNew(&it, &snapshot->terms, prefix);
+  printf("[Matching words:");
+  while (NextPatternMatch(&it, foldedPattern)) {
+    if (numListed == kMaxCompletionsListed) {
+      printf(" ...");
+      break;
+    }
+    rssIndexEntry *entry = MatchedEntry(snapshot, &it);
+    printf("%s %s (%d)", (numListed == 0) ? "" : ",", it.term, PostingListCount(&entry->relevantArticles));
+    numListed++;
+  }
+  printf("]\n");
+}
+
+/**
+ * Tallies each place the words appear in order, with the whole run spanning no more
+ * than numWords + slop positions, under the field the run begins in, and returns
+ * how many there are.  Each run is
+ * begun with an occurrence of the first word and extended with the earliest
+ * occurrence of each of the others that will do, which makes it as short as a run
+ * beginning there can be.  Since later starting points never call for earlier
+ * occurrences, each word's occurrences are only ever scanned once.
+ */
+
+static int CountPhraseOccurrences(int *positions[], const int numPositions[], int numWords, int slop,
+                                  int fieldFreqs[]) {
+  int next[numWords], count = 0;
+  memset(next, 0, sizeof(next));
+  for (int i = 0; i < numPositions[0]; i++) {
+    int start = positions[0][i], end = start;
+    for (int k = 1; k < numWords; k++) {
+      while (next[k] < numPositions[k] && positions[k][next[k]] <= end) next[k]++;
+      if (next[k] == numPositions[k]) return count;
+      end = positions[k][next[k]];
+    }
+    if (end - start < numWords + slop) {
+      fieldFreqs[start >> kFieldPositionShift]++;
+      count++;
+    }
+  }
+  return count;
+}
+
+// Normalizes the word just as the termscanner normalizes indexed terms, folding it, checking
+// it against the stop words, and only then stemming it.  Sets *isStopWord, and returns the
+// word's index entry, or NULL if it hasn't one (as it can't if it isn't well-formed).
+static rssIndexEntry *LookUpWord(rssIndexSnapshot *snapshot, const char *word, bool *isStopWord) {
+  char normalizedWord[strlen(word) + 1]; // neither folding nor stemming ever lengthens a word
+  *isStopWord = false;
+  if (!TermNormalizerFoldWord(snapshot->normalizer, word, normalizedWord, sizeof(normalizedWord))) return NULL;
+  hashedword key = { normalizedWord, WordHash(normalizedWord) };
+  *isStopWord = HashSetLookup(snapshot->stopWords, &key) != NULL;
+  if (*isStopWord) return NULL;
+
+  TermNormalizerStem(snapshot->normalizer, normalizedWord, strlen(normalizedWord));
+  rssIndexEntry entry = { normalizedWord, WordHash(normalizedWord) };
+  return HashSetLookup(&snapshot->indices, &entry);
+}
+
+/**
+ * Matching articles are ranked by TF-IDF: each query word an article contains
+ * contributes 1 + log(tf), where tf is the number of times it occurs there,
+ * weighted by log(1 + N/df), where N is the number of articles indexed and df
+ * the number that contain the word.  Rare words count for more than common ones,
+ * and a word's hundredth occurrence counts for far less than its first.  An
+ * occurrence in the title or description the feed gives the article counts
+ * kFieldWeights times over in tf, since a word there says far more about what
+ * the article is about than one buried in its body does.
+ *
+ * Only the best kMaxArticlesListed are ever kept, in a bounded heap, and the
+ * stored postings are only ever read.  RankArticles leaves the best of them
+ * in topArticles, sorted, and the caller disposes of the heap.
+ */
+
+static const int kMaxArticlesListed = 10;
+static const double kFieldWeights[kNumPostingFields] = { 1.0, 4.0, 2.0 }; // body, title, description
+static void RankArticles(const postinglist *matches, const postinglist *terms[], int numTerms,
+                         int numIndexed, boundedheap *topArticles) {
+  double idf[numTerms];
+  postingiterator termIts[numTerms], it;
+  for (int i = 0; i < numTerms; i++) {
+    idf[i] = log(1.0 + (double) numIndexed / PostingListCount(terms[i]));
+    PostingIteratorNew(&termIts[i], terms[i]);
+  }
+
+  BoundedHeapNew(topArticles, sizeof(rssScoredArticle), kMaxArticlesListed, ScoredArticleCompare);
+  PostingIteratorNew(&it, matches);
+  while (PostingIteratorNext(&it)) {
+    rssScoredArticle candidate = { it.articleIndex, it.freq, 0.0 };
+    for (int i = 0; i < numTerms; i++)
+      if (PostingIteratorAdvanceTo(&termIts[i], it.articleIndex) && termIts[i].articleIndex == it.articleIndex)
+        candidate.score += (1.0 + log(WeightedFrequency(termIts[i].fieldFreqs))) * idf[i];
+    BoundedHeapOffer(topArticles, &candidate);
+  }
+  BoundedHeapSort(topArticles);
+}
+
+static double WeightedFrequency(const int fieldFreqs[]) {
+  double freq = 0.0;
+  for (int field = 0; field < kNumPostingFields; field++) freq += kFieldWeights[field] * fieldFreqs[field];
+  return freq;
+}
+
+static void ListTopArticles(const postinglist *matches, const postinglist *terms[], int numTerms,
+                            vector *articles) {
+  boundedheap topArticles;
+  
+  if (PostingListCount(matches) > kMaxArticlesListed)
+    printf("[We'll just list %d of them, though.]", kMaxArticlesListed);
+  printf("\n\n");
+  
+  RankArticles(matches, terms, numTerms, VectorLength(articles), &topArticles);
+  for (int i = 0; i < BoundedHeapCount(&topArticles); i++) {
+    const rssScoredArticle *scoredArticle = BoundedHeapNth(&topArticles, i);
+    const rssNewsArticle *relevantArticle = VectorNth(articles, scoredArticle->articleIndex);
+    int count = scoredArticle->freq;
+    printf("\t%2d.) \"%s\" [search term%s occur%s %d time%s]\n", i + 1, relevantArticle->title,
+           (numTerms == 1) ? "" : "s", (numTerms == 1) ? "s" : "", count, (count == 1) ? "" : "s");
+    printf("\t%2s   \"%s\"\n", "", relevantArticle->fullURL);
+  }
+  
+  printf("\n");
+  BoundedHeapDispose(&topArticles);
+}
+
+static bool WordIsWellFormed(rssIndexSnapshot *snapshot, const char *word) {
+  char folded[strlen(word) + 1];
+  return TermNormalizerFoldWord(snapshot->normalizer, word, folded, sizeof(folded));
 }
 
 static void StringFree(void *elem) {
@@ -440,15 +1829,6 @@ static void NewsArticleClone(rssNewsArticle *article, const char *title,
   article->fullURL = strdup(fullURL);
 }
 
-static int NewsArticleCompare(const void *elem1, const void *elem2) {
-  const rssNewsArticle *article1 = elem1;
-  const rssNewsArticle *article2 = elem2;
-  if ((StringCompare(&article1->title, &article2->title) == 0) &&
-      (StringCompare(&article1->server, &article2->server) == 0)) return 0;
-  
-  return StringCompare(&article1->fullURL, &article2->fullURL);
-}
-
 static void NewsArticleFree(void *elem) {
   rssNewsArticle *article = elem;
   StringFree(&article->title);
@@ -457,30 +1837,27 @@ static void NewsArticleFree(void *elem) {
 }
 
 static int IndexEntryHash(const void *elem, int numBuckets) {
-  const rssIndexEntry *entry = elem;
-  return StringHash(&entry->meaningfulWord, numBuckets);
+  return HashedWordHash(elem, numBuckets); // rssIndexEntry starts out just like a hashedword
 }
 
 static int IndexEntryCompare(const void *elem1, const void *elem2) {
-  const rssIndexEntry *entry1 = elem1;
-  const rssIndexEntry *entry2 = elem2;
-  return StringCompare(&entry1->meaningfulWord, &entry2->meaningfulWord);
+  return HashedWordCompare(elem1, elem2);
 }
 
 static void IndexEntryFree(void *elem) {
   rssIndexEntry *entry = elem;
+  if (entry->shared != NULL) {
+    ReleaseSharedPostings(entry->shared);
+    return;
+  }
   StringFree(&entry->meaningfulWord);
-  VectorDispose(&entry->relevantArticles);
-}
-
-static int ArticleIndexCompare(const void *elem1, const void *elem2) {
-  const rssRelevantArticleEntry *entry1 = elem1;
-  const rssRelevantArticleEntry *entry2 = elem2;
-  return entry1->articleIndex - entry2->articleIndex;
+  PostingListDispose(&entry->relevantArticles);
 }
 
-static int ArticleFrequencyCompare(const void *elem1, const void *elem2) {
-  const rssRelevantArticleEntry *entry1 = elem1;
-  const rssRelevantArticleEntry *entry2 = elem2;
-  return entry2->freq - entry1->freq;
+// Higher scores are better, and ties go to the article indexed first.
+static int ScoredArticleCompare(const void *elem1, const void *elem2) {
+  const rssScoredArticle *article1 = elem1;
+  const rssScoredArticle *article2 = elem2;
+  if (article1->score != article2->score) return (article1->score > article2->score) ? 1 : -1;
+  return article2->articleIndex - article1->articleIndex;
 }
@@ -0,0 +1,197 @@
+/**
+ * File: rss-query-load.c
+ * ----------------------
+ * A load generator for rss-news-search running as a query server.  It
+ * opens some number of connections to the server's socket, and on each,
+ * one thread sends queries drawn from a file one at a time, waiting for
+ * each reply before sending the next, so the number of connections is the
+ * number of queries in flight.  Once every connection has sent its share,
+ * the overall throughput and the latency percentiles are reported.
+ *
+ *     rss-query-load <socket> <query-file> [<connections> [<queries-per-connection>]]
+ */
+
+#include "bool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+typedef struct {
+  const char *socketPath;
+  char **queries;
+  int numQueries;
+  int firstQuery;          // connections start at different points in the query list
+  int numToSend;
+  long *latencies;         // numToSend of them, in nanoseconds
+  int numAnswered;
+} loadConnection;
+
+static const int kMaxQueryLength = 4095; // leaves room for the newline within the server's limit
+
+static void ReadQueries(const char *filename, char ***queries, int *numQueries)
+{
+  FILE *infile = fopen(filename, "r");
+  if (infile == NULL) {
+    fprintf(stderr, "Could not open query file named \"%s\"\n", filename);
+    exit(1);
+  }
+
+  int allocated = 64;
+  *queries = malloc(allocated * sizeof(char *));
+  *numQueries = 0;
+  char line[kMaxQueryLength + 2];
+  while (fgets(line, sizeof(line), infile) != NULL) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '\0') continue;
+    if (*numQueries == allocated) {
+      allocated *= 2;
+      *queries = realloc(*queries, allocated * sizeof(char *));
+    }
+    (*queries)[(*numQueries)++] = strdup(line);
+  }
+  fclose(infile);
+}
+
+static int Connect(const char *socketPath)
+{
+  struct sockaddr_un address;
+  if (strlen(socketPath) >= sizeof(address.sun_path)) return -1;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, socketPath);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1) return -1;
+  if (connect(fd, (struct sockaddr *) &address, sizeof(address)) == -1) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Reads up to and including the empty line that ends a reply.
+static bool ReadReply(FILE *replies)
+{
+  char line[1024];
+  bool atLineStart = true;
+  while (fgets(line, sizeof(line), replies) != NULL) {
+    if (atLineStart && strcmp(line, "\n") == 0) return true;
+    atLineStart = (line[strlen(line) - 1] == '\n');
+  }
+  return false;
+}
+
+static long NanosecondsSince(const struct timespec *start)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1000000000L + (now.tv_nsec - start->tv_nsec);
+}
+
+static void *SendQueries(void *arg)
+{
+  loadConnection *conn = arg;
+  int fd = Connect(conn->socketPath);
+  if (fd == -1) {
+    fprintf(stderr, "Could not connect to \"%s\": %s\n", conn->socketPath, strerror(errno));
+    return NULL;
+  }
+
+  FILE *requests = fdopen(fd, "w");
+  FILE *replies = fdopen(dup(fd), "r");
+  for (int i = 0; i < conn->numToSend; i++) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    fprintf(requests, "%s\n", conn->queries[(conn->firstQuery + i) % conn->numQueries]);
+    if (fflush(requests) != 0 || !ReadReply(replies)) {
+      fprintf(stderr, "The server hung up after %d queries.\n", i);
+      break;
+    }
+    conn->latencies[conn->numAnswered++] = NanosecondsSince(&start);
+  }
+
+  fclose(requests);
+  fclose(replies);
+  return NULL;
+}
+
+static int LongCompare(const void *elem1, const void *elem2)
+{
+  long one = *(const long *) elem1;
+  long two = *(const long *) elem2;
+  return (one > two) - (one < two);
+}
+
+static void PrintLatencyReport(long *latencies, int numQueries, long elapsed, int numConnections)
+{
+  static const double kPercentiles[] = { 50, 90, 99, 99.9 };
+  qsort(latencies, numQueries, sizeof(long), LongCompare);
+
+  printf("Answered %d queries over %d connection%s in %.3f ms (%.0f queries/s).\n", numQueries, numConnections,
+         (numConnections == 1) ? "" : "s", elapsed / 1e6, numQueries / (elapsed / 1e9));
+  if (numQueries == 0) return;
+  printf("Per-query latency:");
+  for (int i = 0; i < sizeof(kPercentiles) / sizeof(kPercentiles[0]); i++) {
+    int rank = (int) (kPercentiles[i] / 100 * (numQueries - 1));
+    printf(" p%g=%ldns", kPercentiles[i], latencies[rank]);
+  }
+  printf(" max=%ldns\n", latencies[numQueries - 1]);
+}
+
+int main(int argc, const char *argv[])
+{
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s <socket> <query-file> [<connections> [<queries-per-connection>]]\n", argv[0]);
+    return 1;
+  }
+
+  char **queries;
+  int numQueries;
+  ReadQueries(argv[2], &queries, &numQueries);
+  if (numQueries == 0) {
+    fprintf(stderr, "There aren't any queries in \"%s\".\n", argv[2]);
+    return 1;
+  }
+
+  int numConnections = (argc > 3) ? atoi(argv[3]) : 8;
+  int queriesPerConnection = (argc > 4) ? atoi(argv[4]) : numQueries;
+  if (numConnections < 1) numConnections = 1;
+  if (queriesPerConnection < 1) queriesPerConnection = 1;
+
+  long *latencies = malloc((size_t) numConnections * queriesPerConnection * sizeof(long));
+  loadConnection *conns = calloc(numConnections, sizeof(loadConnection));
+  pthread_t *threads = malloc(numConnections * sizeof(pthread_t));
+  assert(latencies != NULL && conns != NULL && threads != NULL);
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < numConnections; i++) {
+    conns[i] = (loadConnection) { argv[1], queries, numQueries, i * numQueries / numConnections,
+                                  queriesPerConnection, latencies + (size_t) i * queriesPerConnection, 0 };
+    pthread_create(&threads[i], NULL, SendQueries, &conns[i]);
+  }
+
+  // gather every connection's latencies at the front of the array
+  int numAnswered = 0;
+  for (int i = 0; i < numConnections; i++) {
+    pthread_join(threads[i], NULL);
+    memmove(latencies + numAnswered, conns[i].latencies, conns[i].numAnswered * sizeof(long));
+    numAnswered += conns[i].numAnswered;
+  }
+  long elapsed = NanosecondsSince(&start);
+
+  PrintLatencyReport(latencies, numAnswered, elapsed, numConnections);
+  for (int i = 0; i < numQueries; i++) free(queries[i]);
+  free(queries);
+  free(threads);
+  free(conns);
+  free(latencies);
+  return 0;
+}
@@ -0,0 +1,154 @@
+#include "simhash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+/**
+ * Checks the two promises simhash.h makes.  The first is that the
+ * simhashindex finds exactly what comparing a signature against every
+ * one it holds would find, which is checked by doing just that.  The
+ * second is that similar documents get similar signatures and different
+ * ones don't, which is checked on made-up articles of about the length
+ * the feeds carry, shingled the way the crawler shingles them.
+ */
+
+static const int kNumSignatures = 5000;
+static const int kNumQueries = 20000;
+static const int kNumArticles = 200;
+static const int kArticleLength = 200;     // words
+static const int kEditLength = 6;          // a clause, or a short sentence
+static const int kVocabularySize = 5000;
+static const int kShingleLength = 3;
+
+static uint64_t RandomBits(void)
+{
+  uint64_t bits = 0;
+  for (int i = 0; i < 4; i++) bits = (bits << 16) | (rand() & 0xFFFF);
+  return bits;
+}
+
+static int Distance(uint64_t signature1, uint64_t signature2)
+{
+  return __builtin_popcountll(signature1 ^ signature2);
+}
+
+/**
+ * Function: TestIndexFind
+ * -----------------------
+ * Fills an index with random signatures, and then asks it for copies of
+ * them with anywhere from none to twice kMaxNearDuplicateDistance bits
+ * flipped, along with brand new signatures.  Whatever SimHashIndexFind
+ * answers is checked against a linear search: it has to find a signature
+ * whenever one is close enough, and when it does, one of the closest.
+ */
+
+static void TestIndexFind(void)
+{
+  simhashindex index;
+  SimHashIndexNew(&index);
+  uint64_t *signatures = malloc(kNumSignatures * sizeof(uint64_t));
+  assert(signatures != NULL);
+  for (int i = 0; i < kNumSignatures; i++) {
+    signatures[i] = RandomBits();
+    SimHashIndexAdd(&index, signatures[i], i);
+  }
+
+  int numFound = 0;
+  for (int i = 0; i < kNumQueries; i++) {
+    uint64_t query = (i % 4 == 0) ? RandomBits() : signatures[rand() % kNumSignatures];
+    int numFlipped = rand() % (2 * kMaxNearDuplicateDistance + 1);
+    for (int j = 0; j < numFlipped; j++) query ^= (uint64_t) 1 << (rand() % 64);
+
+    int closest = kMaxNearDuplicateDistance + 1;
+    for (int j = 0; j < kNumSignatures; j++)
+      if (Distance(query, signatures[j]) < closest) closest = Distance(query, signatures[j]);
+
+    int id = SimHashIndexFind(&index, query);
+    if (closest > kMaxNearDuplicateDistance) {
+      assert(id == -1);
+    } else {
+      assert(id >= 0 && id < kNumSignatures && Distance(query, signatures[id]) == closest);
+      numFound++;
+    }
+  }
+
+  printf("Of %d queries, the index found a signature for each of the %d within %d bits of one "
+         "of its %d.\n", kNumQueries, numFound, kMaxNearDuplicateDistance, kNumSignatures);
+  free(signatures);
+  SimHashIndexDispose(&index);
+}
+
+/**
+ * Function: ArticleSignature
+ * --------------------------
+ * Returns the signature of an article whose words are given as hash codes,
+ * with each run of kShingleLength consecutive words as one feature.
+ */
+
+static uint64_t ArticleSignature(const uint64_t words[], int numWords)
+{
+  simhash sh;
+  SimHashNew(&sh);
+  for (int i = 0; i + kShingleLength <= numWords; i++) {
+    uint64_t shingle = 0;
+    for (int j = 0; j < kShingleLength; j++)
+      shingle = shingle * 31 + words[i + j];
+    SimHashAdd(&sh, shingle);
+  }
+  assert(sh.numFeatures == numWords - kShingleLength + 1);
+  return SimHashValue(&sh);
+}
+
+static void RandomArticle(uint64_t words[], int numWords)
+{
+  for (int i = 0; i < numWords; i++) words[i] = rand() % kVocabularySize;
+}
+
+/**
+ * Function: TestSignatures
+ * ------------------------
+ * Makes kNumArticles random articles, and for each, a copy with
+ * kEditLength words in a row rewritten, and confirms that most copies'
+ * signatures are within kMaxNearDuplicateDistance bits of their
+ * originals', while no two unrelated articles' signatures are.  Being
+ * random, the made-up articles never repeat a phrase, so every word
+ * rewritten changes kShingleLength of their features.
+ */
+
+static void TestSignatures(void)
+{
+  uint64_t original[kArticleLength], edited[kArticleLength], unrelated[kArticleLength];
+  int numNear = 0, numFalseMatches = 0, totalDistance = 0, closestUnrelated = 64;
+  for (int i = 0; i < kNumArticles; i++) {
+    RandomArticle(original, kArticleLength);
+    uint64_t signature = ArticleSignature(original, kArticleLength);
+    assert(ArticleSignature(original, kArticleLength) == signature);
+
+    for (int j = 0; j < kArticleLength; j++) edited[j] = original[j];
+    int start = rand() % (kArticleLength - kEditLength);
+    RandomArticle(edited + start, kEditLength);
+    int distance = Distance(signature, ArticleSignature(edited, kArticleLength));
+    totalDistance += distance;
+    if (distance <= kMaxNearDuplicateDistance) numNear++;
+
+    RandomArticle(unrelated, kArticleLength);
+    distance = Distance(signature, ArticleSignature(unrelated, kArticleLength));
+    if (distance < closestUnrelated) closestUnrelated = distance;
+    if (distance <= kMaxNearDuplicateDistance) numFalseMatches++;
+  }
+
+  printf("%d of %d articles with %d words rewritten were within %d bits of the original "
+         "(%.1f bits on average),\n", numNear, kNumArticles, kEditLength, kMaxNearDuplicateDistance,
+         (double) totalDistance / kNumArticles);
+  printf("and no unrelated article came closer than %d bits.\n", closestUnrelated);
+  assert(numNear >= kNumArticles * 3 / 4);
+  assert(numFalseMatches == 0);
+}
+
+int main(int ignored, char **alsoIgnored)
+{
+  srand(107);
+  TestIndexFind();
+  TestSignatures();
+  return 0;
+}
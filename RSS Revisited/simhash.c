@@ -0,0 +1,98 @@
+#include "simhash.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static const int kBandBits = 64 / kNumSignatureBands;
+static const int kNumBandBuckets = 1 << (64 / kNumSignatureBands);
+
+// The finalizer of the splitmix64 generator, so every bit of the result depends on every bit of x.
+static uint64_t Mix(uint64_t x)
+{
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+void SimHashNew(simhash *sh)
+{
+  memset(sh, 0, sizeof(simhash));
+}
+
+void SimHashAdd(simhash *sh, uint64_t feature)
+{
+  uint64_t bits = Mix(feature);
+  for (int i = 0; i < 64; i++)
+    sh->ones[i] += (bits >> i) & 1;
+  sh->numFeatures++;
+}
+
+uint64_t SimHashValue(const simhash *sh)
+{
+  uint64_t signature = 0;
+  for (int i = 0; i < 64; i++)
+    if (2 * sh->ones[i] > sh->numFeatures) signature |= (uint64_t) 1 << i;
+  return signature;
+}
+
+static int Distance(uint64_t signature1, uint64_t signature2)
+{
+  return __builtin_popcountll(signature1 ^ signature2);
+}
+
+static int *Bucket(const simhashindex *index, uint64_t signature, int band)
+{
+  int value = (signature >> (band * kBandBits)) & (kNumBandBuckets - 1);
+  return &index->buckets[band * kNumBandBuckets + value];
+}
+
+void SimHashIndexNew(simhashindex *index)
+{
+  index->entries = NULL;
+  index->count = index->allocatedCount = 0;
+  index->buckets = malloc(kNumSignatureBands * kNumBandBuckets * sizeof(int));
+  assert(index->buckets != NULL);
+  for (int i = 0; i < kNumSignatureBands * kNumBandBuckets; i++) index->buckets[i] = -1;
+}
+
+void SimHashIndexDispose(simhashindex *index)
+{
+  free(index->entries);
+  free(index->buckets);
+}
+
+int SimHashIndexFind(const simhashindex *index, uint64_t signature)
+{
+  int bestID = -1, bestDistance = kMaxNearDuplicateDistance + 1;
+  for (int band = 0; band < kNumSignatureBands; band++) {
+    for (int i = *Bucket(index, signature, band); i != -1; i = index->entries[i].next[band]) {
+      int distance = Distance(signature, index->entries[i].signature);
+      if (distance < bestDistance) {
+        bestID = index->entries[i].id;
+        bestDistance = distance;
+      }
+    }
+  }
+  return bestID;
+}
+
+static const int kInitialAllocation = 64;
+void SimHashIndexAdd(simhashindex *index, uint64_t signature, int id)
+{
+  assert(id >= 0);
+  if (index->count == index->allocatedCount) {
+    index->allocatedCount = (index->allocatedCount == 0) ? kInitialAllocation : 2 * index->allocatedCount;
+    index->entries = realloc(index->entries, index->allocatedCount * sizeof(simhashentry));
+    assert(index->entries != NULL);
+  }
+
+  simhashentry *entry = &index->entries[index->count];
+  entry->signature = signature;
+  entry->id = id;
+  for (int band = 0; band < kNumSignatureBands; band++) {
+    int *head = Bucket(index, signature, band);
+    entry->next[band] = *head;
+    *head = index->count;
+  }
+  index->count++;
+}
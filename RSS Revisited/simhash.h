@@ -0,0 +1,126 @@
+/**
+ * File: simhash.h
+ * ---------------
+ * Exports the simhash type, which condenses the features of a document
+ * into a 64-bit signature such that similar documents get signatures
+ * differing in only a few bits (Charikar's similarity hash), and the
+ * simhashindex type, which finds the signatures within a few bits of a
+ * new one without comparing it against every signature it holds.
+ *
+ * The index splits each signature into kNumSignatureBands bands of 8
+ * bits, and files it under the value of each.  Two signatures differing
+ * in no more than kMaxNearDuplicateDistance < kNumSignatureBands bits
+ * must agree on at least one band, so only the signatures sharing a
+ * band's bucket with the new one need to be compared against it.
+ *
+ * News articles are short, and a couple hundred words hold too few
+ * features for the 3-bit distances used on whole web pages: two copies
+ * of a story differing in a handful of words are usually 5 or 6 bits
+ * apart, and rewriting a whole sentence takes them to 7 or 8, while
+ * unrelated stories are rarely closer than 16.
+ */
+
+#ifndef __simhash_
+#define __simhash_
+
+#include <stdint.h>
+
+#define kNumSignatureBands 8
+#define kMaxNearDuplicateDistance 7
+
+/**
+ * Type: simhash
+ * -------------
+ * Accumulates a document's features.  ones[i] counts the features whose
+ * hash has bit i set, and the signature's bit i is set if more than half
+ * do.  The fields are exposed only because C gives us no good way to
+ * hide them, though clients are free to read numFeatures.
+ */
+
+typedef struct {
+  int ones[64];
+  int numFeatures;
+} simhash;
+
+/**
+ * Function: SimHashNew
+ * --------------------
+ * Initializes the simhash to hold no features.
+ */
+
+void SimHashNew(simhash *sh);
+
+/**
+ * Function: SimHashAdd
+ * --------------------
+ * Adds one feature, identified by a hash code.  The hash code needn't
+ * be well mixed, as it's mixed again here.  A feature added several
+ * times counts that many times.
+ */
+
+void SimHashAdd(simhash *sh, uint64_t feature);
+
+/**
+ * Function: SimHashValue
+ * ----------------------
+ * Returns the signature of the features added so far.
+ */
+
+uint64_t SimHashValue(const simhash *sh);
+
+typedef struct {
+  uint64_t signature;
+  int id;
+  int next[kNumSignatureBands]; // the next entry in the same bucket, band by band, or -1
+} simhashentry;
+
+/**
+ * Type: simhashindex
+ * ------------------
+ * A set of signatures, each tagged with a client-supplied id.  It isn't
+ * thread-safe; clients sharing one must lock around every call.
+ */
+
+typedef struct {
+  simhashentry *entries;
+  int count;
+  int allocatedCount;
+  int *buckets;             // for each band, a bucket head for each value, -1 or an index into entries
+} simhashindex;
+
+/**
+ * Function: SimHashIndexNew
+ * -------------------------
+ * Initializes the index to be empty.
+ */
+
+void SimHashIndexNew(simhashindex *index);
+
+/**
+ * Function: SimHashIndexDispose
+ * -----------------------------
+ * Releases all resources held by the index.
+ */
+
+void SimHashIndexDispose(simhashindex *index);
+
+/**
+ * Function: SimHashIndexFind
+ * --------------------------
+ * Returns the id of a signature in the index differing from the specified
+ * one in no more than kMaxNearDuplicateDistance bits, or -1 if there's none.
+ * If several are that close, the one differing in the fewest bits is chosen.
+ */
+
+int SimHashIndexFind(const simhashindex *index, uint64_t signature);
+
+/**
+ * Function: SimHashIndexAdd
+ * -------------------------
+ * Adds the signature to the index under the specified id, which must be
+ * nonnegative.
+ */
+
+void SimHashIndexAdd(simhashindex *index, uint64_t signature, int id);
+
+#endif
@@ -0,0 +1,192 @@
+#include "snapshot-cell.h"
+#include "bool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <assert.h>
+
+/**
+ * Checks that the snapshotcell frees each version exactly once, and only
+ * after the last reader holding it has let it go.  The versions are never
+ * really freed, just marked as such, so a reader who's handed a freed one
+ * finds out rather than crashing, and each remembers how many readers say
+ * they're holding it, which the free function insists be none.
+ */
+
+#define kNumReaders 8
+static const int kNumVersions = 2000;
+#define kNumValues 16
+static const int kMaxHoldTime = 50;        // yields
+
+typedef struct {
+  int number;
+  int values[kNumValues];   // every one of them number, until it's freed
+  int numHolders;           // updated atomically
+  int timesFreed;           // ditto
+} testversion;
+
+static testversion *versions;
+static int numFreed;        // updated atomically
+static int numFreedByReaders; // ditto, and only counts those freed off the publishing thread
+static pthread_t publisher;
+
+static void FreeVersion(void *snapshot)
+{
+  testversion *version = snapshot;
+  assert(__atomic_load_n(&version->numHolders, __ATOMIC_ACQUIRE) == 0);
+  for (int i = 0; i < kNumValues; i++) version->values[i] = -1;
+  __atomic_add_fetch(&version->timesFreed, 1, __ATOMIC_RELEASE);
+  __atomic_add_fetch(&numFreed, 1, __ATOMIC_RELAXED);
+  if (!pthread_equal(pthread_self(), publisher))
+    __atomic_add_fetch(&numFreedByReaders, 1, __ATOMIC_RELAXED);
+}
+
+static testversion *NewVersion(int number)
+{
+  testversion *version = &versions[number];
+  version->number = number;
+  for (int i = 0; i < kNumValues; i++) version->values[i] = number;
+  version->numHolders = 0;
+  version->timesFreed = 0;
+  return version;
+}
+
+static void ExpectIntact(const testversion *version)
+{
+  assert(__atomic_load_n(&version->timesFreed, __ATOMIC_ACQUIRE) == 0);
+  for (int i = 0; i < kNumValues; i++) assert(version->values[i] == version->number);
+}
+
+static testversion *Acquire(snapshotcell *sc)
+{
+  testversion *version = SnapshotCellAcquire(sc);
+  __atomic_add_fetch(&version->numHolders, 1, __ATOMIC_ACQ_REL);
+  ExpectIntact(version);
+  return version;
+}
+
+static void Release(snapshotcell *sc, testversion *version)
+{
+  ExpectIntact(version);
+  __atomic_sub_fetch(&version->numHolders, 1, __ATOMIC_ACQ_REL);
+  SnapshotCellRelease(sc, version);
+}
+
+/**
+ * Function: TestReleaseOrder
+ * --------------------------
+ * Walks a single thread through the orders a replaced version can be
+ * released in: a version no one holds is freed as soon as it's replaced,
+ * and of two retired versions, each is freed when its own last reader
+ * releases it, regardless of which was retired first.
+ */
+
+static void TestReleaseOrder(void)
+{
+  snapshotcell sc;
+  SnapshotCellNew(&sc, NewVersion(0), FreeVersion);
+  testversion *held0 = Acquire(&sc);
+  testversion *alsoHeld0 = Acquire(&sc);
+  assert(held0 == &versions[0] && alsoHeld0 == held0);
+  SnapshotCellPublish(&sc, NewVersion(1));
+  testversion *held1 = Acquire(&sc);
+  assert(held1 == &versions[1]);
+  SnapshotCellPublish(&sc, NewVersion(2));
+  assert(numFreed == 0);
+
+  Release(&sc, held1);                       // the newer retired version goes first
+  assert(versions[1].timesFreed == 1 && numFreed == 1);
+  Release(&sc, held0);
+  assert(versions[0].timesFreed == 0);       // someone else still has it
+  Release(&sc, alsoHeld0);
+  assert(versions[0].timesFreed == 1 && numFreed == 2);
+
+  SnapshotCellPublish(&sc, NewVersion(3));   // no one holds version 2
+  assert(versions[2].timesFreed == 1 && numFreed == 3);
+  Release(&sc, Acquire(&sc));                // releasing the current version frees nothing
+  assert(numFreed == 3);
+  SnapshotCellDispose(&sc);
+  assert(versions[3].timesFreed == 1 && numFreed == 4);
+  printf("Replaced versions were freed when their last readers released them, in any order.\n");
+}
+
+/**
+ * Function: Reader
+ * ----------------
+ * Repeatedly acquires the current version, sometimes acquiring again
+ * before releasing the first, holds on to it for a little while, and
+ * confirms throughout that it's intact.  Versions are published in
+ * numerical order, so no version acquired can be older than the one
+ * acquired before it.  Returns once the last version's been published.
+ */
+
+static void *Reader(void *arg)
+{
+  snapshotcell *sc = arg;
+  unsigned int seed = (unsigned long) pthread_self();
+  int newest = 0;
+  while (true) {
+    testversion *version = Acquire(sc);
+    assert(version->number >= newest);
+    newest = version->number;
+    testversion *another = (rand_r(&seed) % 4 == 0) ? Acquire(sc) : NULL;
+    assert(another == NULL || another->number >= newest);
+
+    int holdTime = newest % kMaxHoldTime;
+    for (int i = 0; i < holdTime; i++) sched_yield();
+    ExpectIntact(version);
+    if (another != NULL) {
+      newest = another->number;
+      Release(sc, version);      // the older one first
+      Release(sc, another);
+    } else {
+      Release(sc, version);
+    }
+    if (newest == kNumVersions - 1) return NULL;
+  }
+}
+
+/**
+ * Function: TestConcurrentReaders
+ * -------------------------------
+ * Runs kNumReaders readers while the main thread publishes kNumVersions
+ * versions in turn, and confirms that after the cell's been disposed of,
+ * every version has been freed exactly once.  The publisher yields once
+ * per reader after each version, so even on a single processor, readers
+ * get to hold most versions when they're replaced, and the reader who
+ * releases one last is the one who frees it.
+ */
+
+static void TestConcurrentReaders(void)
+{
+  snapshotcell sc;
+  pthread_t readers[kNumReaders];
+  numFreed = 0;
+  numFreedByReaders = 0;
+  publisher = pthread_self();
+  SnapshotCellNew(&sc, NewVersion(0), FreeVersion);
+  for (int i = 0; i < kNumReaders; i++)
+    pthread_create(&readers[i], NULL, Reader, &sc);
+  for (int i = 1; i < kNumVersions; i++) {
+    SnapshotCellPublish(&sc, NewVersion(i));
+    for (int j = 0; j < kNumReaders; j++) sched_yield();
+  }
+  for (int i = 0; i < kNumReaders; i++)
+    pthread_join(readers[i], NULL);
+
+  SnapshotCellDispose(&sc);
+  for (int i = 0; i < kNumVersions; i++) assert(versions[i].timesFreed == 1);
+  assert(numFreed == kNumVersions);
+  printf("%d readers saw each of %d versions intact until they released it, and every one was freed once,\n"
+         "%d of them by the reader who released it last.\n", kNumReaders, kNumVersions, numFreedByReaders);
+}
+
+int main(int ignored, char **alsoIgnored)
+{
+  versions = malloc(kNumVersions * sizeof(testversion));
+  assert(versions != NULL);
+  TestReleaseOrder();
+  TestConcurrentReaders();
+  free(versions);
+  return 0;
+}
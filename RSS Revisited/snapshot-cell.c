@@ -0,0 +1,84 @@
+#include "snapshot-cell.h"
+#include <stdlib.h>
+#include <assert.h>
+
+static snapshotversion *NewVersion(void *snapshot)
+{
+  snapshotversion *version = malloc(sizeof(snapshotversion));
+  assert(version != NULL);
+  version->snapshot = snapshot;
+  version->numReaders = 0;
+  version->next = NULL;
+  return version;
+}
+
+void SnapshotCellNew(snapshotcell *sc, void *initial, SnapshotFreeFunction freefn)
+{
+  sc->current = NewVersion(initial);
+  sc->retired = NULL;
+  sc->freefn = freefn;
+  pthread_mutex_init(&sc->lock, NULL);
+}
+
+void SnapshotCellDispose(snapshotcell *sc)
+{
+  assert(sc->retired == NULL && sc->current->numReaders == 0);
+  sc->freefn(sc->current->snapshot);
+  free(sc->current);
+  pthread_mutex_destroy(&sc->lock);
+}
+
+void *SnapshotCellAcquire(snapshotcell *sc)
+{
+  pthread_mutex_lock(&sc->lock);
+  sc->current->numReaders++;
+  void *snapshot = sc->current->snapshot;
+  pthread_mutex_unlock(&sc->lock);
+  return snapshot;
+}
+
+// Freeing happens outside the lock, since a large version can take a while to tear down.
+void SnapshotCellRelease(snapshotcell *sc, void *snapshot)
+{
+  snapshotversion *unused = NULL;
+
+  pthread_mutex_lock(&sc->lock);
+  if (sc->current->snapshot == snapshot) {
+    assert(sc->current->numReaders > 0);
+    sc->current->numReaders--;
+  } else {
+    snapshotversion **link = &sc->retired;
+    while (*link != NULL && (*link)->snapshot != snapshot) link = &(*link)->next;
+    assert(*link != NULL && (*link)->numReaders > 0);
+    if (--(*link)->numReaders == 0) {
+      unused = *link;
+      *link = unused->next;
+    }
+  }
+  pthread_mutex_unlock(&sc->lock);
+
+  if (unused != NULL) {
+    sc->freefn(unused->snapshot);
+    free(unused);
+  }
+}
+
+void SnapshotCellPublish(snapshotcell *sc, void *snapshot)
+{
+  snapshotversion *replaced, *next = NewVersion(snapshot);
+
+  pthread_mutex_lock(&sc->lock);
+  replaced = sc->current;
+  sc->current = next;
+  if (replaced->numReaders > 0) {
+    replaced->next = sc->retired;
+    sc->retired = replaced;
+    replaced = NULL; // its last reader frees it
+  }
+  pthread_mutex_unlock(&sc->lock);
+
+  if (replaced != NULL) {
+    sc->freefn(replaced->snapshot);
+    free(replaced);
+  }
+}
@@ -0,0 +1,87 @@
+/**
+ * File: snapshot-cell.h
+ * ---------------------
+ * Exports the snapshotcell type, which holds the current version of
+ * some read-only structure (for us, the index) and lets a writer swap
+ * in a new version while readers are still using the old one.  A
+ * reader acquires whatever version is current, uses it for as long as
+ * it likes without any further locking, and then releases it.  A
+ * version that's been replaced is freed only once the last reader
+ * holding it lets it go, so every reader sees one consistent version
+ * from start to finish, and the writer never waits on any of them.
+ */
+
+#ifndef __snapshot_cell_
+#define __snapshot_cell_
+
+#include <pthread.h>
+
+/**
+ * Type: SnapshotFreeFunction
+ * --------------------------
+ * Disposes of a version that's been replaced and is no longer in use.
+ */
+
+typedef void (*SnapshotFreeFunction)(void *snapshot);
+
+typedef struct snapshotversion {
+  void *snapshot;
+  int numReaders;
+  struct snapshotversion *next;    // only used on the retired list
+} snapshotversion;
+
+typedef struct {
+  snapshotversion *current;
+  snapshotversion *retired;        // replaced versions that readers still hold
+  SnapshotFreeFunction freefn;
+  pthread_mutex_t lock;
+} snapshotcell;
+
+/**
+ * Function: SnapshotCellNew
+ * -------------------------
+ * Initializes the cell to hold the specified version, which it owns
+ * from now on and eventually disposes of with freefn.
+ */
+
+void SnapshotCellNew(snapshotcell *sc, void *initial, SnapshotFreeFunction freefn);
+
+/**
+ * Function: SnapshotCellDispose
+ * -----------------------------
+ * Frees the current version.  Every acquired version must have been
+ * released by now.
+ */
+
+void SnapshotCellDispose(snapshotcell *sc);
+
+/**
+ * Function: SnapshotCellAcquire
+ * -----------------------------
+ * Returns the current version, which stays valid (and unchanged, as
+ * long as no one writes to it) until it's passed to SnapshotCellRelease.
+ */
+
+void *SnapshotCellAcquire(snapshotcell *sc);
+
+/**
+ * Function: SnapshotCellRelease
+ * -----------------------------
+ * Gives up a version returned by SnapshotCellAcquire.  If it's been
+ * replaced and this was the last reader holding it, it's freed.
+ */
+
+void SnapshotCellRelease(snapshotcell *sc, void *snapshot);
+
+/**
+ * Function: SnapshotCellPublish
+ * -----------------------------
+ * Makes the specified version current, so that it's what every later
+ * SnapshotCellAcquire returns.  The cell owns it from now on.  The
+ * version it replaces is freed right away if no one holds it, and
+ * otherwise as soon as its last reader releases it.
+ */
+
+void SnapshotCellPublish(snapshotcell *sc, void *snapshot);
+
+#endif
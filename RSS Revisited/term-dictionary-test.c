@@ -0,0 +1,178 @@
+#include "term-dictionary.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fnmatch.h>
+#include <assert.h>
+
+/**
+ * Checks the termdictionary against the plain sorted array of words it's
+ * built from.  Whatever words an iterator returns for some prefix, or
+ * whatever of them match some wildcard pattern, a linear scan of the
+ * array must find the same ones, in the same order.  The words are drawn
+ * from a three-letter alphabet, so they share long prefixes and every
+ * prefix tried matches a good many of them, and some are hundreds of
+ * characters long, so the shared prefix lengths don't all fit in a byte.
+ */
+
+static const int kNumDictionaries = 200;
+static const int kMaxTerms = 1500;
+static const int kNumQueries = 100;        // per dictionary, of each kind
+static const int kMaxShortTermLength = 8;
+static const int kMaxStemLength = 400;
+static const char kAlphabet[] = "abc";
+static const char kPatternAlphabet[] = "abc*?";
+
+static void RandomString(char *s, int length, const char *alphabet)
+{
+  int alphabetSize = strlen(alphabet);
+  for (int i = 0; i < length; i++) s[i] = alphabet[rand() % alphabetSize];
+  s[length] = '\0';
+}
+
+/**
+ * Function: RandomTerm
+ * --------------------
+ * Returns a newly allocated word, which is usually short, but one time in
+ * ten is a run of up to kMaxStemLength a's followed by a short tail, and
+ * one time in a hundred is as long as the dictionary allows.
+ */
+
+static char *RandomTerm(void)
+{
+  char *term = malloc(kMaxDictionaryTermLength + 1);
+  assert(term != NULL);
+  int kind = rand() % 100;
+  if (kind == 0) {
+    RandomString(term, kMaxDictionaryTermLength, kAlphabet);
+  } else if (kind < 10) {
+    int stemLength = rand() % (kMaxStemLength + 1);
+    memset(term, 'a', stemLength);
+    RandomString(term + stemLength, rand() % kMaxShortTermLength, kAlphabet);
+  } else {
+    RandomString(term, 1 + rand() % kMaxShortTermLength, kAlphabet);
+  }
+  return term;
+}
+
+static int CompareTerms(const void *elemAddr1, const void *elemAddr2)
+{
+  return strcmp(*(const char **) elemAddr1, *(const char **) elemAddr2);
+}
+
+// Fills terms with up to maxTerms distinct words, sorted, and returns how many there are.
+static int RandomTerms(char *terms[], int maxTerms)
+{
+  int numTerms = 0;
+  for (int i = 0; i < maxTerms; i++) terms[i] = RandomTerm();
+  qsort(terms, maxTerms, sizeof(char *), CompareTerms);
+  for (int i = 0; i < maxTerms; i++) {
+    if (numTerms > 0 && strcmp(terms[numTerms - 1], terms[i]) == 0) free(terms[i]);
+    else terms[numTerms++] = terms[i];
+  }
+  return numTerms;
+}
+
+/**
+ * Function: RandomPrefix
+ * ----------------------
+ * Returns a prefix to look for: most often the beginning of one of the
+ * words, sometimes a whole word, and otherwise some random string, which
+ * may or may not begin any of them.
+ */
+
+static void RandomPrefix(char prefix[], char *terms[], int numTerms)
+{
+  int kind = rand() % 4;
+  if (numTerms > 0 && kind < 3) {
+    const char *term = terms[rand() % numTerms];
+    int length = (kind == 0) ? strlen(term) : rand() % (strlen(term) + 1);
+    memcpy(prefix, term, length);
+    prefix[length] = '\0';
+  } else {
+    RandomString(prefix, rand() % (kMaxShortTermLength + 1), kAlphabet);
+  }
+}
+
+/**
+ * Function: ExpectIterated
+ * ------------------------
+ * Iterates over the words beginning with prefix and asserts that those
+ * matching pattern (all of them, if pattern is NULL) are exactly what a
+ * scan of terms finds, and returns how many that is.
+ */
+
+static int ExpectIterated(const termdictionary *td, char *terms[], int numTerms,
+                          const char *prefix, const char *pattern)
+{
+  termiterator it;
+  TermIteratorNew(&it, td, prefix);
+  int numMatched = 0, prefixLength = strlen(prefix);
+  for (int i = 0; i < numTerms; i++) {
+    if (strncmp(terms[i], prefix, prefixLength) != 0) continue;
+    if (pattern != NULL && fnmatch(pattern, terms[i], FNM_NOESCAPE) != 0) continue;
+    bool found;
+    while ((found = TermIteratorNext(&it)) && pattern != NULL &&
+           fnmatch(pattern, it.term, FNM_NOESCAPE) != 0)
+      ;
+    assert(found && strcmp(it.term, terms[i]) == 0);
+    numMatched++;
+  }
+  while (pattern != NULL && TermIteratorNext(&it))
+    assert(fnmatch(pattern, it.term, FNM_NOESCAPE) != 0);
+  assert(!TermIteratorNext(&it));
+  assert(!TermIteratorNext(&it)); // and stays done
+  return numMatched;
+}
+
+/**
+ * Function: TestIteration
+ * -----------------------
+ * Builds dictionaries of random sizes, including the empty one and ones
+ * that aren't a whole number of blocks, and checks that the empty prefix
+ * iterates over every word, then tries random prefixes, and random
+ * patterns split the way the query code splits them, at the first
+ * wildcard.
+ */
+
+static void TestIteration(void)
+{
+  char **terms = malloc(kMaxTerms * sizeof(char *));
+  assert(terms != NULL);
+  int numPrefixMatches = 0, numPatternMatches = 0;
+  for (int i = 0; i < kNumDictionaries; i++) {
+    int numTerms = RandomTerms(terms, (i == 0) ? 0 : rand() % (kMaxTerms + 1));
+    termdictionary td;
+    TermDictionaryNew(&td, (const char **) terms, numTerms);
+    assert(TermDictionaryCount(&td) == numTerms);
+    assert(ExpectIterated(&td, terms, numTerms, "", NULL) == numTerms);
+
+    for (int j = 0; j < kNumQueries; j++) {
+      char prefix[kMaxDictionaryTermLength + 1];
+      RandomPrefix(prefix, terms, numTerms);
+      numPrefixMatches += ExpectIterated(&td, terms, numTerms, prefix, NULL);
+
+      char pattern[kMaxShortTermLength + 1];
+      RandomString(pattern, 1 + rand() % kMaxShortTermLength, kPatternAlphabet);
+      int patternPrefixLength = strcspn(pattern, "*?");
+      memcpy(prefix, pattern, patternPrefixLength);
+      prefix[patternPrefixLength] = '\0';
+      numPatternMatches += ExpectIterated(&td, terms, numTerms, prefix, pattern);
+    }
+
+    TermDictionaryDispose(&td);
+    for (int j = 0; j < numTerms; j++) free(terms[j]);
+  }
+
+  printf("Over %d dictionaries, %d prefixes matched %d words and %d patterns matched %d, "
+         "just as scanning for them did.\n", kNumDictionaries, kNumDictionaries * kNumQueries,
+         numPrefixMatches, kNumDictionaries * kNumQueries, numPatternMatches);
+  free(terms);
+}
+
+int main(int ignored, char **alsoIgnored)
+{
+  srand(107);
+  TestIteration();
+  return 0;
+}
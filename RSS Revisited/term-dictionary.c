@@ -0,0 +1,158 @@
+#include "term-dictionary.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static const int kTermsPerBlock = 16;
+
+/**
+ * A block's first word is stored as a null-terminated string.  Every other word
+ * is stored as the number of leading characters it shares with the word before,
+ * as a variable-length integer, followed by the rest of it, null-terminated.
+ */
+
+static int SharedPrefixLength(const char *word1, const char *word2)
+{
+  int length = 0;
+  while (word1[length] != '\0' && word1[length] == word2[length]) length++;
+  return length;
+}
+
+static int VarintLength(unsigned int value)
+{
+  int length = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    length++;
+  }
+  return length;
+}
+
+static unsigned char *WriteVarint(unsigned char *cursor, unsigned int value)
+{
+  while (value >= 0x80) {
+    *cursor++ = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  *cursor++ = value;
+  return cursor;
+}
+
+static unsigned int ReadVarint(const unsigned char **cursor)
+{
+  unsigned int value = 0;
+  int shift = 0;
+  unsigned char byte;
+  do {
+    byte = *(*cursor)++;
+    value |= (unsigned int) (byte & 0x7f) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  return value;
+}
+
+void TermDictionaryNew(termdictionary *td, const char *terms[], int numTerms)
+{
+  int numBytes = 0;
+  for (int i = 0; i < numTerms; i++) {
+    assert(strlen(terms[i]) <= kMaxDictionaryTermLength);
+    assert(i == 0 || strcmp(terms[i - 1], terms[i]) < 0);
+    int shared = (i % kTermsPerBlock == 0) ? 0 : SharedPrefixLength(terms[i - 1], terms[i]);
+    if (i % kTermsPerBlock != 0) numBytes += VarintLength(shared);
+    numBytes += strlen(terms[i] + shared) + 1;
+  }
+
+  td->numTerms = numTerms;
+  td->numBytes = numBytes;
+  td->numBlocks = (numTerms + kTermsPerBlock - 1) / kTermsPerBlock;
+  td->bytes = malloc(numBytes > 0 ? numBytes : 1);
+  td->blockOffsets = malloc(td->numBlocks > 0 ? td->numBlocks * sizeof(int) : 1);
+  assert(td->bytes != NULL && td->blockOffsets != NULL);
+
+  unsigned char *cursor = td->bytes;
+  for (int i = 0; i < numTerms; i++) {
+    int shared = 0;
+    if (i % kTermsPerBlock == 0) {
+      td->blockOffsets[i / kTermsPerBlock] = cursor - td->bytes;
+    } else {
+      shared = SharedPrefixLength(terms[i - 1], terms[i]);
+      cursor = WriteVarint(cursor, shared);
+    }
+    int suffixLength = strlen(terms[i] + shared) + 1;
+    memcpy(cursor, terms[i] + shared, suffixLength);
+    cursor += suffixLength;
+  }
+  assert(cursor == td->bytes + numBytes);
+}
+
+void TermDictionaryDispose(termdictionary *td)
+{
+  free(td->bytes);
+  free(td->blockOffsets);
+}
+
+int TermDictionaryCount(const termdictionary *td)
+{
+  return td->numTerms;
+}
+
+// Decodes the next word into it->term, which holds the word before it.
+static void DecodeTerm(termiterator *it)
+{
+  int shared = (it->nextTerm % kTermsPerBlock == 0) ? 0 : ReadVarint(&it->cursor);
+  int suffixLength = strlen((const char *) it->cursor) + 1;
+  memcpy(it->term + shared, it->cursor, suffixLength);
+  it->cursor += suffixLength;
+  it->nextTerm++;
+}
+
+static const char *BlockFirstTerm(const termdictionary *td, int block)
+{
+  return (const char *) td->bytes + td->blockOffsets[block];
+}
+
+// Starts from the last block whose first word sorts before prefix, since that's the
+// only one that can hold both words that don't begin with it and words that do.
+void TermIteratorNew(termiterator *it, const termdictionary *td, const char *prefix)
+{
+  it->td = td;
+  it->prefix = prefix;
+  it->prefixLength = strlen(prefix);
+  it->pending = false;
+  it->done = false;
+  it->term[0] = '\0';
+
+  int low = 0, high = td->numBlocks - 1;
+  while (low < high) {
+    int mid = (low + high + 1) / 2;
+    if (strcmp(BlockFirstTerm(td, mid), prefix) < 0) low = mid;
+    else high = mid - 1;
+  }
+
+  it->nextTerm = low * kTermsPerBlock;
+  it->cursor = td->bytes + (td->numBlocks == 0 ? 0 : td->blockOffsets[low]);
+  while (it->nextTerm < td->numTerms) {
+    DecodeTerm(it);
+    if (strcmp(it->term, prefix) >= 0) {
+      it->pending = true;
+      return;
+    }
+  }
+  it->done = true;
+}
+
+bool TermIteratorNext(termiterator *it)
+{
+  if (it->done) return false;
+  if (it->pending) {
+    it->pending = false;
+  } else if (it->nextTerm < it->td->numTerms) {
+    DecodeTerm(it);
+  } else {
+    it->done = true;
+    return false;
+  }
+
+  if (strncmp(it->term, it->prefix, it->prefixLength) != 0) it->done = true; // past every word with the prefix
+  return !it->done;
+}
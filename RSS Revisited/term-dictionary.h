@@ -0,0 +1,89 @@
+/**
+ * File: term-dictionary.h
+ * -----------------------
+ * Exports the termdictionary type, a sorted and compactly stored list of
+ * every word in the index.  The hashset of index entries can only tell
+ * whether a given word is there; the dictionary can also enumerate, in
+ * order, every word that begins a certain way, which is what prefix and
+ * wildcard queries need.
+ *
+ * Words are front-coded: sorted words share long prefixes with their
+ * predecessors, so each is stored as the length of the prefix it shares
+ * with the one before and the characters that follow.  Every
+ * kTermsPerBlock words, a word is stored whole, and the offsets of those
+ * are kept in a small array, so finding where some prefix begins is a
+ * binary search over the blocks followed by a scan of just one of them.
+ */
+
+#ifndef __term_dictionary_
+#define __term_dictionary_
+
+#include "bool.h"
+
+#define kMaxDictionaryTermLength 1023
+
+typedef struct {
+  unsigned char *bytes;
+  int numBytes;
+  int *blockOffsets;        // of each block's first word, which is stored whole
+  int numBlocks;
+  int numTerms;
+} termdictionary;
+
+typedef struct {
+  const termdictionary *td;
+  const char *prefix;
+  int prefixLength;
+  int nextTerm;             // number of the next word to decode
+  const unsigned char *cursor;
+  bool pending;             // true if term was decoded in advance and hasn't been returned yet
+  bool done;
+  char term[kMaxDictionaryTermLength + 1]; // the word most recently returned by TermIteratorNext
+} termiterator;
+
+/**
+ * Function: TermDictionaryNew
+ * ---------------------------
+ * Initializes the dictionary to hold the numTerms words in terms, which
+ * must be distinct, in increasing strcmp order, and no longer than
+ * kMaxDictionaryTermLength characters.  The words are copied.
+ */
+
+void TermDictionaryNew(termdictionary *td, const char *terms[], int numTerms);
+
+/**
+ * Function: TermDictionaryDispose
+ * -------------------------------
+ * Releases the memory held by the dictionary.
+ */
+
+void TermDictionaryDispose(termdictionary *td);
+
+/**
+ * Function: TermDictionaryCount
+ * -----------------------------
+ * Returns the number of words in the dictionary.
+ */
+
+int TermDictionaryCount(const termdictionary *td);
+
+/**
+ * Function: TermIteratorNew
+ * -------------------------
+ * Positions the iterator before the first word in the dictionary that
+ * begins with prefix.  The prefix isn't copied, and must outlive the
+ * iterator, as must the dictionary.  The empty prefix matches every word.
+ */
+
+void TermIteratorNew(termiterator *it, const termdictionary *td, const char *prefix);
+
+/**
+ * Function: TermIteratorNext
+ * --------------------------
+ * Decodes the next word beginning with the iterator's prefix into its
+ * term field and returns true, or returns false once there are no more.
+ */
+
+bool TermIteratorNext(termiterator *it);
+
+#endif
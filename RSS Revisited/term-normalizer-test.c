@@ -0,0 +1,117 @@
+#include "term-normalizer.h"
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+/**
+ * Checks the termnormalizer against words whose normal forms are known.
+ * The stems are those Porter's own paper gives as examples of each step of
+ * his algorithm, along with a few words the news feeds are full of.  Each
+ * pair is a word and what it should become.
+ */
+
+static const char *const kStems[][2] = {
+  // step 1a: plurals
+  {"caresses", "caress"}, {"ponies", "poni"}, {"ties", "ti"}, {"caress", "caress"}, {"cats", "cat"},
+  // step 1b: -ed and -ing, and the tidying up after them
+  {"feed", "feed"}, {"agreed", "agre"}, {"plastered", "plaster"}, {"bled", "bled"},
+  {"motoring", "motor"}, {"sing", "sing"}, {"conflated", "conflat"}, {"troubled", "troubl"},
+  {"sized", "size"}, {"hopping", "hop"}, {"tanned", "tan"}, {"falling", "fall"},
+  {"hissing", "hiss"}, {"fizzed", "fizz"}, {"failing", "fail"}, {"filing", "file"},
+  // step 1c: a final y after a vowelled stem
+  {"happy", "happi"}, {"sky", "sky"},
+  // step 2: double suffixes
+  {"relational", "relat"}, {"conditional", "condit"}, {"rational", "ration"},
+  {"valenci", "valenc"}, {"digitizer", "digit"}, {"conformabli", "conform"},
+  {"radicalli", "radic"}, {"differentli", "differ"}, {"vileli", "vile"},
+  {"analogousli", "analog"}, {"vietnamization", "vietnam"}, {"predication", "predic"},
+  {"operator", "oper"}, {"feudalism", "feudal"}, {"decisiveness", "decis"},
+  {"hopefulness", "hope"}, {"callousness", "callous"}, {"formaliti", "formal"},
+  {"sensitiviti", "sensit"}, {"sensibiliti", "sensibl"},
+  // step 3: -ic-, -full, -ness and the like
+  {"triplicate", "triplic"}, {"formative", "form"}, {"formalize", "formal"},
+  {"electriciti", "electr"}, {"electrical", "electr"}, {"hopeful", "hope"}, {"goodness", "good"},
+  // step 4: -ant, -ence and the like, from long enough stems
+  {"revival", "reviv"}, {"allowance", "allow"}, {"inference", "infer"}, {"airliner", "airlin"},
+  {"gyroscopic", "gyroscop"}, {"adjustable", "adjust"}, {"defensible", "defens"},
+  {"irritant", "irrit"}, {"replacement", "replac"}, {"adjustment", "adjust"},
+  {"dependent", "depend"}, {"adoption", "adopt"}, {"homologou", "homolog"},
+  {"communism", "commun"}, {"activate", "activ"}, {"angulariti", "angular"},
+  {"homologous", "homolog"}, {"effective", "effect"}, {"bowdlerize", "bowdler"},
+  // step 5: a final e, and a final double l
+  {"probate", "probat"}, {"rate", "rate"}, {"cease", "ceas"}, {"controll", "control"}, {"roll", "roll"},
+  // the news
+  {"elections", "elect"}, {"election", "elect"}, {"president", "presid"},
+  {"presidential", "presidenti"}, {"generalizations", "gener"}, {"oscillators", "oscil"},
+  // words left alone: too short, or not all letters
+  {"is", "is"}, {"as", "as"}, {"a1-b", "a1-b"}, {"covid-19", "covid-19"}
+};
+
+static void TestStems(void)
+{
+  termnormalizer tn;
+  TermNormalizerNew(&tn, kFoldAccents | kStemWords);
+  int numStems = sizeof(kStems) / sizeof(kStems[0]);
+  for (int i = 0; i < numStems; i++) {
+    char word[32];
+    strcpy(word, kStems[i][0]);
+    int length = TermNormalizerStem(&tn, word, strlen(word));
+    if (strcmp(word, kStems[i][1]) != 0)
+      printf("  \"%s\" was stemmed to \"%s\", not \"%s\".\n", kStems[i][0], word, kStems[i][1]);
+    assert(strcmp(word, kStems[i][1]) == 0 && length == strlen(word));
+  }
+
+  TermNormalizerNew(&tn, kFoldAccents); // stemming turned off
+  char word[] = "elections";
+  assert(TermNormalizerStem(&tn, word, strlen(word)) == strlen("elections"));
+  assert(strcmp(word, "elections") == 0);
+  printf("All %d words were stemmed as Porter's algorithm says they should be.\n", numStems);
+}
+
+/**
+ * Function: ExpectFolded
+ * ----------------------
+ * Asserts that folding word under the specified options yields expected,
+ * or that the word is refused if expected is NULL.
+ */
+
+static void ExpectFolded(int options, const char *word, const char *expected)
+{
+  termnormalizer tn;
+  TermNormalizerNew(&tn, options);
+  char folded[16];
+  bool wellFormed = TermNormalizerFoldWord(&tn, word, folded, sizeof(folded));
+  assert(wellFormed == (expected != NULL));
+  assert(!wellFormed || strcmp(folded, expected) == 0);
+}
+
+static void TestFolding(void)
+{
+  ExpectFolded(kFoldAccents, "Election", "election");
+  ExpectFolded(kFoldAccents, "\xc9lection", "election");          // Latin-1
+  ExpectFolded(kFoldAccents, "\xc3\x89lections", "elections");    // UTF-8
+  ExpectFolded(kFoldAccents, "caf\xe9", "cafe");
+  ExpectFolded(kFoldAccents, "na\xc3\xafve", "naive");
+  ExpectFolded(0, "ELECTION", "election");
+  ExpectFolded(0, "caf\xe9", NULL);                               // unfolded accents aren't letters
+  ExpectFolded(kFoldAccents, "covid-19", "covid-19");
+  ExpectFolded(kFoldAccents, "1st", NULL);                        // must start with a letter
+  ExpectFolded(kFoldAccents, "two words", NULL);
+  ExpectFolded(kFoldAccents, "", NULL);
+  ExpectFolded(kFoldAccents, "abcdefghijklmno", "abcdefghijklmno"); // just fits
+  ExpectFolded(kFoldAccents, "abcdefghijklmnop", NULL);
+
+  termnormalizer tn;
+  TermNormalizerNew(&tn, kFoldAccents | kStemWords);
+  char folded[32];
+  TermNormalizerFoldPattern(&tn, "\xc9LECT*[0-9]?", folded);
+  assert(strcmp(folded, "elect*[0-9]?") == 0);
+  printf("Words were lowercased and folded, and the ill-formed ones refused.\n");
+}
+
+int main(int ignored, char **alsoIgnored)
+{
+  TestStems();
+  TestFolding();
+  return 0;
+}
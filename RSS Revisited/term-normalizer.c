@@ -0,0 +1,259 @@
+#include "term-normalizer.h"
+#include <string.h>
+#include <ctype.h>
+
+/**
+ * What each Latin-1 code point from 0xC0 up folds to, '.' marking the two
+ * that aren't letters (the multiplication and division signs).  The table
+ * folds one character to one, so "ß" and "æ" lose a letter.
+ */
+
+static const char kLatin1Folds[] =
+  "aaaaaaaceeeeiiiidnooooo.ouuuuyts"  // 0xC0 through 0xDF
+  "aaaaaaaceeeeiiiidnooooo.ouuuuyty"; // 0xE0 through 0xFF
+static const int kFirstFoldedLatin1 = 0xC0;
+
+void TermNormalizerNew(termnormalizer *tn, int options)
+{
+  tn->options = options;
+  memset(tn->folded, '\0', sizeof(tn->folded));
+  for (int ch = 0; ch < 128; ch++)
+    if (isalnum(ch) || ch == '-') tn->folded[ch] = tolower(ch);
+  if (options & kFoldAccents) {
+    for (int ch = kFirstFoldedLatin1; ch < 256; ch++) {
+      char folded = kLatin1Folds[ch - kFirstFoldedLatin1];
+      tn->folded[ch] = (folded == '.') ? '\0' : folded;
+    }
+  }
+}
+
+// Latin-1 code points 0x80 through 0xFF are two bytes in UTF-8, the first 0xC2 or 0xC3.
+// Returns the next character, decoding it if it's one of them, and advances past it.
+static int NextCharacter(const unsigned char **c)
+{
+  const unsigned char *next = *c;
+  if ((next[0] == 0xC2 || next[0] == 0xC3) && (next[1] & 0xC0) == 0x80) {
+    *c += 2;
+    return ((next[0] & 0x1F) << 6) | (next[1] & 0x3F);
+  }
+  (*c)++;
+  return next[0];
+}
+
+bool TermNormalizerFoldWord(const termnormalizer *tn, const char *word, char folded[], int size)
+{
+  int length = 0;
+  const unsigned char *c = (const unsigned char *) word;
+  while (*c != '\0') {
+    int foldedCh = tn->folded[NextCharacter(&c)];
+    if (foldedCh == '\0' || (length == 0 && !isalpha(foldedCh)) || length == size - 1) return false;
+    folded[length++] = foldedCh;
+  }
+
+  folded[length] = '\0';
+  return length > 0; // a word has at least its first letter
+}
+
+/**
+ * The stemmer is a transcription of the one Martin Porter describes in "An
+ * algorithm for suffix stripping" (Program 14(3), 1980), down to the handful
+ * of departures his own C implementation makes from the paper.  It works on
+ * word[0..k], and j marks the end of the stem left by the suffix EndsWith
+ * last matched.
+ */
+
+typedef struct {
+  char *word;
+  int k;
+  int j;
+} stemmer;
+
+typedef struct {
+  const char *suffix;
+  const char *replacement;
+} suffixRule;
+
+static bool IsConsonant(const stemmer *s, int i)
+{
+  switch (s->word[i]) {
+    case 'a': case 'e': case 'i': case 'o': case 'u': return false;
+    case 'y': return i == 0 || !IsConsonant(s, i - 1);
+    default: return true;
+  }
+}
+
+// Returns the number of vowel-consonant sequences in word[0..j], the m of the paper.
+static int Measure(const stemmer *s)
+{
+  int m = 0, i = 0;
+  while (i <= s->j && IsConsonant(s, i)) i++;
+  while (i <= s->j) {
+    while (i <= s->j && !IsConsonant(s, i)) i++;
+    if (i > s->j) break;
+    while (i <= s->j && IsConsonant(s, i)) i++;
+    m++;
+  }
+  return m;
+}
+
+static bool VowelInStem(const stemmer *s)
+{
+  for (int i = 0; i <= s->j; i++)
+    if (!IsConsonant(s, i)) return true;
+  return false;
+}
+
+static bool EndsWithDoubleConsonant(const stemmer *s, int i)
+{
+  return i >= 1 && s->word[i] == s->word[i - 1] && IsConsonant(s, i);
+}
+
+// True if word[i - 2..i] is consonant-vowel-consonant, and the last isn't w, x or y.
+static bool EndsWithCVC(const stemmer *s, int i)
+{
+  if (i < 2 || !IsConsonant(s, i) || IsConsonant(s, i - 1) || !IsConsonant(s, i - 2)) return false;
+  return s->word[i] != 'w' && s->word[i] != 'x' && s->word[i] != 'y';
+}
+
+// Sets j to mark the stem before suffix, but only if word[0..k] ends with it.
+static bool EndsWith(stemmer *s, const char *suffix)
+{
+  int length = strlen(suffix);
+  if (length > s->k + 1 || memcmp(s->word + s->k - length + 1, suffix, length) != 0) return false;
+  s->j = s->k - length;
+  return true;
+}
+
+// Replaces whatever follows the stem with replacement, which is never longer than what it replaces.
+static void SetTo(stemmer *s, const char *replacement)
+{
+  int length = strlen(replacement);
+  memcpy(s->word + s->j + 1, replacement, length);
+  s->k = s->j + length;
+}
+
+// Replaces the first of the suffixes the word ends with, provided what precedes it has m > 0.
+static void ReplaceSuffix(stemmer *s, const suffixRule rules[], int numRules)
+{
+  for (int i = 0; i < numRules; i++) {
+    if (EndsWith(s, rules[i].suffix)) {
+      if (Measure(s) > 0) SetTo(s, rules[i].replacement);
+      return;
+    }
+  }
+}
+
+// Step 1a and 1b: "caresses" -> "caress", "ponies" -> "poni", "agreed" -> "agree", "hopping" -> "hop".
+static void RemovePluralsAndParticiples(stemmer *s)
+{
+  if (s->word[s->k] == 's') {
+    if (EndsWith(s, "sses")) s->k -= 2;
+    else if (EndsWith(s, "ies")) SetTo(s, "i");
+    else if (s->word[s->k - 1] != 's') s->k--;
+  }
+
+  if (EndsWith(s, "eed")) {
+    if (Measure(s) > 0) s->k--;
+  } else if ((EndsWith(s, "ed") || EndsWith(s, "ing")) && VowelInStem(s)) {
+    s->k = s->j;
+    if (EndsWith(s, "at")) SetTo(s, "ate");
+    else if (EndsWith(s, "bl")) SetTo(s, "ble");
+    else if (EndsWith(s, "iz")) SetTo(s, "ize");
+    else if (EndsWithDoubleConsonant(s, s->k)) {
+      char ch = s->word[s->k];
+      if (ch != 'l' && ch != 's' && ch != 'z') s->k--;
+    } else if (Measure(s) == 1 && EndsWithCVC(s, s->k)) {
+      SetTo(s, "e");
+    }
+  }
+}
+
+// Step 1c: "happy" -> "happi".
+static void TurnTerminalY(stemmer *s)
+{
+  if (EndsWith(s, "y") && VowelInStem(s)) s->word[s->k] = 'i';
+}
+
+// Step 2: double suffixes are mapped to single ones, as in "relational" -> "relate".
+static const suffixRule kDoubleSuffixes[] = {
+  { "ational", "ate" }, { "tional", "tion" }, { "enci", "ence" }, { "anci", "ance" },
+  { "izer", "ize" }, { "bli", "ble" }, { "alli", "al" }, { "entli", "ent" }, { "eli", "e" },
+  { "ousli", "ous" }, { "ization", "ize" }, { "ation", "ate" }, { "ator", "ate" },
+  { "alism", "al" }, { "iveness", "ive" }, { "fulness", "ful" }, { "ousness", "ous" },
+  { "aliti", "al" }, { "iviti", "ive" }, { "biliti", "ble" }, { "logi", "log" }
+};
+
+// Step 3: "-ic-", "-full", "-ness" and the like, as in "hopeful" -> "hope".
+static const suffixRule kDerivationalSuffixes[] = {
+  { "icate", "ic" }, { "ative", "" }, { "alize", "al" }, { "iciti", "ic" },
+  { "ical", "ic" }, { "ful", "" }, { "ness", "" }
+};
+
+// Step 4: suffixes dropped outright if what precedes them has m > 1, as in "adjustment" -> "adjust".
+static const char *const kRemovableSuffixes[] = {
+  "al", "ance", "ence", "er", "ic", "able", "ible", "ant", "ement", "ment", "ent",
+  "ion", "ou", "ism", "ate", "iti", "ous", "ive", "ize"
+};
+
+static const int kNumDoubleSuffixes = sizeof(kDoubleSuffixes) / sizeof(kDoubleSuffixes[0]);
+static const int kNumDerivationalSuffixes = sizeof(kDerivationalSuffixes) / sizeof(kDerivationalSuffixes[0]);
+static const int kNumRemovableSuffixes = sizeof(kRemovableSuffixes) / sizeof(kRemovableSuffixes[0]);
+
+// "-ion" only goes if it follows an s or a t, so "adoption" loses it and "onion" doesn't.
+static void RemoveSuffix(stemmer *s)
+{
+  for (int i = 0; i < kNumRemovableSuffixes; i++) {
+    if (!EndsWith(s, kRemovableSuffixes[i])) continue;
+    if (strcmp(kRemovableSuffixes[i], "ion") == 0 && (s->j < 0 || (s->word[s->j] != 's' && s->word[s->j] != 't')))
+      continue;
+    if (Measure(s) > 1) s->k = s->j;
+    return;
+  }
+}
+
+// Step 5: a final e goes if m > 1 (or m = 1 and it doesn't follow a cvc), and "ll" becomes "l" if m > 1.
+static void TidyUp(stemmer *s)
+{
+  s->j = s->k;
+  if (s->word[s->k] == 'e') {
+    int m = Measure(s);
+    if (m > 1 || (m == 1 && !EndsWithCVC(s, s->k - 1))) s->k--;
+  }
+  if (s->word[s->k] == 'l' && EndsWithDoubleConsonant(s, s->k) && Measure(s) > 1) s->k--;
+}
+
+void TermNormalizerFoldPattern(const termnormalizer *tn, const char *pattern, char folded[])
+{
+  const unsigned char *c = (const unsigned char *) pattern;
+  while (*c != '\0') {
+    const unsigned char *start = c;
+    int foldedCh = tn->folded[NextCharacter(&c)];
+    if (foldedCh != '\0') {
+      *folded++ = foldedCh;
+    } else {
+      memcpy(folded, start, c - start);
+      folded += c - start;
+    }
+  }
+  *folded = '\0';
+}
+
+int TermNormalizerStem(const termnormalizer *tn, char word[], int length)
+{
+  if (!(tn->options & kStemWords) || length <= 2) return length;
+  for (int i = 0; i < length; i++)
+    if (!islower((unsigned char) word[i])) return length;
+
+  stemmer s = { word, length - 1, 0 };
+  RemovePluralsAndParticiples(&s);
+  if (s.k > 0) {
+    TurnTerminalY(&s);
+    ReplaceSuffix(&s, kDoubleSuffixes, kNumDoubleSuffixes);
+    ReplaceSuffix(&s, kDerivationalSuffixes, kNumDerivationalSuffixes);
+    RemoveSuffix(&s);
+    TidyUp(&s);
+  }
+
+  word[s.k + 1] = '\0';
+  return s.k + 1;
+}
@@ -0,0 +1,85 @@
+/**
+ * File: term-normalizer.h
+ * -----------------------
+ * Exports the termnormalizer type, which decides what form a word takes
+ * in the index, so that "Election", "elections" and "&Eacute;lection" can
+ * all be found by one query.  Words are always lowercased.  Optionally,
+ * accented Latin-1 letters are folded to their unaccented ASCII
+ * equivalents, and words are reduced to their stems by Porter's
+ * algorithm.  The same normalizer must be applied to words as they're
+ * indexed and to words as they're queried.
+ *
+ * Lowercasing, folding and the well-formedness check are all a single
+ * lookup per byte in a table built up front.  The stemmer works in place
+ * on the lowercase word, and its suffix rules are tables too.
+ */
+
+#ifndef __term_normalizer_
+#define __term_normalizer_
+
+#include "bool.h"
+
+typedef enum {
+  kFoldAccents = 1 << 0,    // "é" is indexed as "e", and so on
+  kStemWords = 1 << 1       // "elections" is indexed as "elect"
+} normalizationoption;
+
+/**
+ * Type: termnormalizer
+ * --------------------
+ * folded maps every byte to the character it's indexed as, or to '\0'
+ * if it can't appear in a word at all.  The fields are exposed only so
+ * that the termscanner can consult the table as it reads each byte.
+ */
+
+typedef struct {
+  int options;              // normalizationoptions, or'ed together
+  unsigned char folded[256];
+} termnormalizer;
+
+/**
+ * Function: TermNormalizerNew
+ * ---------------------------
+ * Initializes the normalizer to apply the specified options, which
+ * are any combination of the normalizationoptions.
+ */
+
+void TermNormalizerNew(termnormalizer *tn, int options);
+
+/**
+ * Function: TermNormalizerFoldWord
+ * --------------------------------
+ * Copies word into folded, lowercasing each character, and stripping it
+ * of its accent if accents are folded.  Accented letters written in UTF-8
+ * are folded just like the Latin-1 characters they encode.  Returns
+ * false, leaving folded unspecified, if the result wouldn't be
+ * well-formed (a letter followed by letters, digits and dashes) or
+ * wouldn't fit in size bytes.  Stop words should be checked for after
+ * folding and before stemming.
+ */
+
+bool TermNormalizerFoldWord(const termnormalizer *tn, const char *word, char folded[], int size);
+
+/**
+ * Function: TermNormalizerStem
+ * ----------------------------
+ * Reduces the folded, null-terminated word of the specified length to
+ * its stem in place, if the normalizer stems words at all, and returns
+ * the stem's length.  Words holding anything other than letters are left
+ * alone, as are words of two letters or fewer.
+ */
+
+int TermNormalizerStem(const termnormalizer *tn, char word[], int length);
+
+/**
+ * Function: TermNormalizerFoldPattern
+ * -----------------------------------
+ * Folds the letters of an fnmatch pattern as TermNormalizerFoldWord
+ * would, so it can be matched against indexed words, and copies whatever
+ * else it holds, like its wildcards, as is.  The pattern isn't stemmed.
+ * folded must have room for at least as many characters as pattern.
+ */
+
+void TermNormalizerFoldPattern(const termnormalizer *tn, const char *pattern, char folded[]);
+
+#endif
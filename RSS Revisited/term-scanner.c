@@ -0,0 +1,214 @@
+#include "term-scanner.h"
+#include "html-utils.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+static const signed long kHashMultiplier = -1664117991L;
+
+void TSNew(termscanner *ts, FILE *infile, const char *delimiters, hashset *stopWords,
+           const termnormalizer *normalizer)
+{
+  assert(infile != NULL);
+  assert(delimiters != NULL);
+  assert(normalizer != NULL);
+
+  STNew(&ts->st, infile, delimiters, false); // only used to hand to SkipIrrelevantContent
+  ts->infile = infile;
+  ts->stopWords = stopWords;
+  ts->normalizer = normalizer;
+  ts->numPending = 0;
+  memset(ts->isDelimiter, 0, sizeof(ts->isDelimiter));
+  for (const char *delim = delimiters; *delim != '\0'; delim++)
+    ts->isDelimiter[(unsigned char) *delim] = true;
+  ts->isDelimiter['<'] = true;
+}
+
+void TSDispose(termscanner *ts)
+{
+  STDispose(&ts->st);
+}
+
+static const struct {
+  const char *name;
+  int ch;
+} kNamedEscapes[] = {
+  { "amp", '&' }, { "lt", '<' }, { "gt", '>' },
+  { "quot", '"' }, { "apos", '\'' }, { "nbsp", ' ' }
+};
+
+static const int kNumNamedEscapes = sizeof(kNamedEscapes) / sizeof(kNamedEscapes[0]);
+
+// The names of the Latin-1 letters from 0xC0 through 0xFF.  The two that aren't letters are left
+// out, so that, like any other unknown escape, they end the term they turn up in.
+static const char *const kLatin1Escapes[] = {
+  "Agrave", "Aacute", "Acirc", "Atilde", "Auml", "Aring", "AElig", "Ccedil",
+  "Egrave", "Eacute", "Ecirc", "Euml", "Igrave", "Iacute", "Icirc", "Iuml",
+  "ETH", "Ntilde", "Ograve", "Oacute", "Ocirc", "Otilde", "Ouml", NULL,
+  "Oslash", "Ugrave", "Uacute", "Ucirc", "Uuml", "Yacute", "THORN", "szlig",
+  "agrave", "aacute", "acirc", "atilde", "auml", "aring", "aelig", "ccedil",
+  "egrave", "eacute", "ecirc", "euml", "igrave", "iacute", "icirc", "iuml",
+  "eth", "ntilde", "ograve", "oacute", "ocirc", "otilde", "ouml", NULL,
+  "oslash", "ugrave", "uacute", "ucirc", "uuml", "yacute", "thorn", "yuml"
+};
+
+static const int kNumLatin1Escapes = sizeof(kLatin1Escapes) / sizeof(kLatin1Escapes[0]);
+static const int kFirstLatin1Escape = 0xC0;
+static const int kMaxEscapeLength = 8;
+static const int kUnknownEscape = -1;
+
+// Characters handed back by DecodeEscape are read before anything else in the file.
+static inline int NextByte(termscanner *ts)
+{
+  return (ts->numPending > 0) ? (unsigned char) ts->pending[--ts->numPending] : getc_unlocked(ts->infile);
+}
+
+/**
+ * Called just after a '&' has been read from the file.  If what follows
+ * is an escape sequence like "amp;" or "#39;", it's consumed and the
+ * single character it stands for is returned.  Otherwise kUnknownEscape
+ * is returned, which ends the current token: either the sequence isn't
+ * one we know (or names a character outside the one-byte range), or the
+ * '&' didn't begin an escape at all, as in "AT&T".  In the latter case
+ * whatever was read past the '&' is handed back, so it's scanned as the
+ * start of the next token rather than lost.
+ */
+
+static int DecodeEscape(termscanner *ts)
+{
+  char name[kMaxEscapeLength + 1];
+  int length = 0;
+  int next;
+
+  assert(ts->numPending == 0 && sizeof(ts->pending) >= kMaxEscapeLength);
+  while ((next = getc_unlocked(ts->infile)) != EOF && length < kMaxEscapeLength &&
+	 (isalnum(next) || (length == 0 && next == '#')))
+    name[length++] = next;
+  name[length] = '\0';
+
+  if (next != ';') {
+    if (next != EOF) ungetc(next, ts->infile);
+    while (length > 0) ts->pending[ts->numPending++] = name[--length];
+    return kUnknownEscape;
+  }
+
+  if (name[0] == '#') {
+    char *end;
+    long ch = (name[1] == 'x' || name[1] == 'X') ? strtol(name + 2, &end, 16) : strtol(name + 1, &end, 10);
+    return (*end == '\0' && ch > 0 && ch < 256) ? ch : kUnknownEscape;
+  }
+
+  for (int i = 0; i < kNumNamedEscapes; i++)
+    if (strcmp(name, kNamedEscapes[i].name) == 0) return kNamedEscapes[i].ch;
+  for (int i = 0; i < kNumLatin1Escapes; i++)
+    if (kLatin1Escapes[i] != NULL && strcmp(name, kLatin1Escapes[i]) == 0) return kFirstLatin1Escape + i;
+  return kUnknownEscape;
+}
+
+/**
+ * Called just after a byte of 0xC2 or 0xC3 has been read.  In UTF-8, that
+ * introduces one of the Latin-1 characters from 0x80 through 0xFF, and if
+ * the byte that follows continues it, the character is returned.  Otherwise
+ * the byte that follows is left unread, and lead itself is returned.
+ */
+
+static int DecodeLatin1(FILE *infile, int lead)
+{
+  int next = getc_unlocked(infile);
+  if (next != EOF && (next & 0xC0) == 0x80) return ((lead & 0x1F) << 6) | (next & 0x3F);
+  if (next != EOF) ungetc(next, infile);
+  return lead;
+}
+
+/**
+ * Folds one more character into the term being assembled: it's looked up
+ * in the normalizer's table, which lowercases it (and strips it of any
+ * accent) and says whether it can appear in a term at all, and then it's
+ * stored and mixed into the running hash code.  Once a term is known to be
+ * malformed (or too long to store), later characters are consumed but
+ * otherwise ignored.
+ */
+
+static void AppendCharacter(const termnormalizer *normalizer, scannedterm *term, bool *wellFormed, int ch)
+{
+  if (!*wellFormed) return;
+  int folded = normalizer->folded[ch];
+  bool legal = (term->length == 0) ? isalpha(folded) : (folded != '\0');
+  if (!legal || term->length == sizeof(term->text) - 1) {
+    *wellFormed = false;
+    return;
+  }
+
+  term->text[term->length++] = folded;
+  term->hashcode = term->hashcode * kHashMultiplier + folded;
+}
+
+bool TSNextTerm(termscanner *ts, scannedterm *term)
+{
+  int ch;
+  while (true) {
+    while ((ch = NextByte(ts)) != EOF && ts->isDelimiter[ch])
+      if (ch == '<') SkipIrrelevantContent(&ts->st);
+    if (ch == EOF) return false;
+
+    bool wellFormed = true;
+    term->length = 0;
+    term->hashcode = 0;
+    for (; ch != EOF; ch = NextByte(ts)) {
+      if (ts->isDelimiter[ch]) {
+	if (ch == '<') ungetc(ch, ts->infile); // let the outer loop skip the tag
+	break;
+      }
+
+      if (ch == '&') {
+	ch = DecodeEscape(ts);
+	if (ch == kUnknownEscape || ts->isDelimiter[ch]) break;
+      } else if (ch == 0xC2 || ch == 0xC3) {
+	ch = DecodeLatin1(ts->infile, ch);
+      }
+
+      AppendCharacter(ts->normalizer, term, &wellFormed, ch);
+    }
+
+    if (!wellFormed || term->length == 0) continue;
+    term->text[term->length] = '\0';
+    if (ts->stopWords != NULL) {
+      hashedword key = { term->text, term->hashcode };
+      if (HashSetLookup(ts->stopWords, &key) != NULL) continue;
+    }
+
+    if (ts->normalizer->options & kStemWords) {
+      term->length = TermNormalizerStem(ts->normalizer, term->text, term->length);
+      term->hashcode = WordHash(term->text);
+    }
+    return true;
+  }
+}
+
+unsigned long WordHash(const char *word)
+{
+  unsigned long hashcode = 0;
+  for (const char *c = word; *c != '\0'; c++)
+    hashcode = hashcode * kHashMultiplier + tolower((unsigned char) *c);
+  return hashcode;
+}
+
+int HashedWordHash(const void *elem, int numBuckets)
+{
+  const hashedword *hw = elem;
+  return hw->hashcode % numBuckets;
+}
+
+int HashedWordCompare(const void *elem1, const void *elem2)
+{
+  const hashedword *hw1 = elem1;
+  const hashedword *hw2 = elem2;
+  return strcmp(hw1->word, hw2->word);
+}
+
+void HashedWordFree(void *elem)
+{
+  hashedword *hw = elem;
+  free((char *) hw->word);
+}
@@ -0,0 +1,127 @@
+/**
+ * File: term-scanner.h
+ * --------------------
+ * Exports the termscanner type, which pulls ready-to-index
+ * terms out of an HTML document in a single pass over its bytes.
+ * Tokenizing, HTML escape and UTF-8 decoding, lowercasing and accent
+ * folding, well-formedness checking, hashing and stop word filtering
+ * all happen as each character is read, rather than as separate passes
+ * over every word.  Only stemming waits until a whole word has been read.
+ */
+
+#ifndef __term_scanner_
+#define __term_scanner_
+
+#include <stdio.h>
+#include "bool.h"
+#include "hashset.h"
+#include "streamtokenizer.h"
+#include "term-normalizer.h"
+
+/**
+ * Type: hashedword
+ * ----------------
+ * Bundles a lowercase C string with its full hash code (the
+ * value computed by WordHash, before it's reduced modulo the
+ * number of buckets).  The word comes first so that the address
+ * of a hashedword can be used wherever a char ** is expected, and
+ * so that any record beginning with the same two fields can be
+ * stored in a hashset built around HashedWordHash and HashedWordCompare.
+ */
+
+typedef struct {
+  const char *word;
+  unsigned long hashcode;
+} hashedword;
+
+/**
+ * Type: scannedterm
+ * -----------------
+ * Populated by TSNextTerm.  The text is always normalized, null-terminated,
+ * and well-formed (a letter followed by letters, digits and dashes), and
+ * length and hashcode describe it so clients needn't call strlen or
+ * rehash it.
+ */
+
+typedef struct {
+  char text[1024];
+  int length;
+  unsigned long hashcode;
+} scannedterm;
+
+/**
+ * Type: termscanner
+ * -----------------
+ * As with the streamtokenizer, the fields are exposed only
+ * because C gives us no good way to hide them.  Clients should
+ * interact with a termscanner solely through the functions below.
+ */
+
+typedef struct {
+  streamtokenizer st;
+  FILE *infile;
+  hashset *stopWords;
+  const termnormalizer *normalizer;
+  bool isDelimiter[256];
+  char pending[8];          // read past a '&' that began no escape, last to be rescanned first
+  int numPending;
+} termscanner;
+
+/**
+ * Function: TSNew
+ * ---------------
+ * Initializes the termscanner to pull terms from infile, splitting on any
+ * of the characters in delimiters.  A '<' always introduces an HTML tag,
+ * which is skipped via SkipIrrelevantContent.  Every term is normalized
+ * by the normalizer, which must outlive the termscanner.  If stopWords is
+ * non-NULL, it must be a hashset of hashedwords, and any term found there
+ * once it's folded, but before it's stemmed, is discarded.
+ */
+
+void TSNew(termscanner *ts, FILE *infile, const char *delimiters, hashset *stopWords,
+           const termnormalizer *normalizer);
+
+/**
+ * Function: TSDispose
+ * -------------------
+ * Releases the resources acquired by TSNew.  The FILE * isn't closed.
+ */
+
+void TSDispose(termscanner *ts);
+
+/**
+ * Function: TSNextTerm
+ * --------------------
+ * Populates the scannedterm with the next indexable term in the stream,
+ * returning true if one was found and false once the stream is exhausted.
+ * Tokens that aren't well-formed, that are too long to fit in the term's
+ * buffer, or that are stop words are silently skipped.
+ */
+
+bool TSNextTerm(termscanner *ts, scannedterm *term);
+
+/**
+ * Function: WordHash
+ * ------------------
+ * Computes the full case-insensitive hash code of the specified
+ * C string.  It is the same value TSNextTerm computes incrementally,
+ * so words hashed here can be matched against scanned terms.
+ */
+
+unsigned long WordHash(const char *word);
+
+/**
+ * Functions: HashedWordHash, HashedWordCompare, HashedWordFree
+ * ------------------------------------------------------------
+ * Callbacks for hashsets whose elements begin with a hashedword.
+ * HashedWordHash reuses the precomputed hash code rather than walking
+ * the string, and HashedWordCompare compares the words case-sensitively,
+ * since they're expected to be lowercase already.  HashedWordFree frees
+ * the word, assuming it was dynamically allocated.
+ */
+
+int HashedWordHash(const void *elem, int numBuckets);
+int HashedWordCompare(const void *elem1, const void *elem2);
+void HashedWordFree(void *elem);
+
+#endif
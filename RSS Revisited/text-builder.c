@@ -0,0 +1,50 @@
+#include "text-builder.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static const int kInitialLength = 64;
+
+void TextBuilderNew(textbuilder *tb, int maxLength)
+{
+  assert(maxLength >= 0);
+  tb->allocatedLength = (maxLength < kInitialLength) ? maxLength : kInitialLength;
+  tb->text = malloc(tb->allocatedLength + 1);
+  assert(tb->text != NULL);
+  tb->text[0] = '\0';
+  tb->length = 0;
+  tb->maxLength = maxLength;
+}
+
+void TextBuilderDispose(textbuilder *tb)
+{
+  free(tb->text);
+}
+
+void TextBuilderClear(textbuilder *tb)
+{
+  tb->length = 0;
+  tb->text[0] = '\0';
+}
+
+void TextBuilderAppend(textbuilder *tb, const char *text, int len)
+{
+  if (len > tb->maxLength - tb->length) len = tb->maxLength - tb->length;
+  if (len <= 0) return;
+
+  if (tb->length + len > tb->allocatedLength) {
+    while (tb->length + len > tb->allocatedLength) tb->allocatedLength *= 2;
+    if (tb->allocatedLength > tb->maxLength) tb->allocatedLength = tb->maxLength;
+    tb->text = realloc(tb->text, tb->allocatedLength + 1);
+    assert(tb->text != NULL);
+  }
+
+  memcpy(tb->text + tb->length, text, len);
+  tb->length += len;
+  tb->text[tb->length] = '\0';
+}
+
+const char *TextBuilderText(const textbuilder *tb)
+{
+  return tb->text;
+}
@@ -0,0 +1,66 @@
+/**
+ * File: text-builder.h
+ * --------------------
+ * Exports the textbuilder type, a growable string that's built up a
+ * piece at a time, as expat hands over the text of an element in
+ * however many pieces it sees fit.  The builder tracks its own length,
+ * so each append costs time proportional to the piece appended rather
+ * than to everything accumulated so far, and it refuses to grow past
+ * a fixed limit, so one absurdly long field can't eat all our memory.
+ */
+
+#ifndef __text_builder_
+#define __text_builder_
+
+typedef struct {
+  char *text;               // always null-terminated
+  int length;
+  int allocatedLength;
+  int maxLength;
+} textbuilder;
+
+/**
+ * Function: TextBuilderNew
+ * ------------------------
+ * Initializes the builder to hold the empty string.  Text appended
+ * beyond the first maxLength characters is quietly dropped.
+ */
+
+void TextBuilderNew(textbuilder *tb, int maxLength);
+
+/**
+ * Function: TextBuilderDispose
+ * ----------------------------
+ * Releases the memory held by the builder.
+ */
+
+void TextBuilderDispose(textbuilder *tb);
+
+/**
+ * Function: TextBuilderClear
+ * --------------------------
+ * Empties the builder, holding on to its memory for whatever's
+ * appended next.
+ */
+
+void TextBuilderClear(textbuilder *tb);
+
+/**
+ * Function: TextBuilderAppend
+ * ---------------------------
+ * Appends the len characters at text, or as many of them as fit
+ * under the builder's limit.  The text needn't be null-terminated.
+ */
+
+void TextBuilderAppend(textbuilder *tb, const char *text, int len);
+
+/**
+ * Function: TextBuilderText
+ * -------------------------
+ * Returns the text built so far, which remains valid until the next
+ * call to TextBuilderAppend or TextBuilderDispose.
+ */
+
+const char *TextBuilderText(const textbuilder *tb);
+
+#endif
@@ -0,0 +1,153 @@
+#include "thread-pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+/**
+ * Checks the threadpool's promises: that every task scheduled is run
+ * exactly once, on its own copy of what was scheduled, that each runs on
+ * the worker ThreadPoolWorkerIndex says it does, and that neither
+ * ThreadPoolWait nor ThreadPoolDispose returns while a task is still
+ * queued or running.  The queue is much shorter than the number of
+ * tasks, so the scheduling thread spends most of its time blocked
+ * waiting for a free slot.
+ */
+
+#define kNumWorkers 8
+static const int kQueueCapacity = 4;
+static const int kNumTasks = 100000;
+static const int kNumRounds = 5;
+static const int kNumSlowTasks = 64;
+static const int kSlowTaskDelay = 2000;    // microseconds
+
+typedef struct {
+  int id;
+  bool slow;
+  char padding[40];         // each byte the id's low byte, so a task copied only in part is noticed
+} testtask;
+
+typedef struct {
+  threadpool *tp;
+  int *timesRun;            // indexed by task id, and updated atomically
+  int numRunByWorker[kNumWorkers]; // each updated only by its own worker
+} testpool;
+
+static void MakeTask(testtask *task, int id, bool slow)
+{
+  task->id = id;
+  task->slow = slow;
+  memset(task->padding, (char) id, sizeof(task->padding));
+}
+
+static void RunTask(void *taskAddr, void *auxData)
+{
+  testtask *task = taskAddr;
+  testpool *pool = auxData;
+  for (int i = 0; i < sizeof(task->padding); i++) assert(task->padding[i] == (char) task->id);
+  if (task->slow) usleep(kSlowTaskDelay);
+
+  int worker = ThreadPoolWorkerIndex(pool->tp);
+  assert(worker >= 0 && worker < kNumWorkers);
+  pool->numRunByWorker[worker]++;
+  __atomic_add_fetch(&pool->timesRun[task->id], 1, __ATOMIC_RELAXED);
+  memset(task, 0, sizeof(testtask)); // it's the worker's own copy, so nobody else should notice
+}
+
+static void TestPoolNew(testpool *pool, threadpool *tp, int numTasks)
+{
+  pool->tp = tp;
+  pool->timesRun = calloc(numTasks, sizeof(int));
+  assert(pool->timesRun != NULL);
+  memset(pool->numRunByWorker, 0, sizeof(pool->numRunByWorker));
+  ThreadPoolNew(tp, kNumWorkers, kQueueCapacity, sizeof(testtask), RunTask, pool);
+}
+
+/**
+ * Function: ExpectAllRun
+ * ----------------------
+ * Asserts that each of the numTasks tasks has been run exactly once,
+ * and returns how many of the workers ran any of them.
+ */
+
+static int ExpectAllRun(const testpool *pool, int numTasks)
+{
+  int numRun = 0, numBusyWorkers = 0;
+  for (int i = 0; i < numTasks; i++) assert(pool->timesRun[i] == 1);
+  for (int i = 0; i < kNumWorkers; i++) {
+    numRun += pool->numRunByWorker[i];
+    if (pool->numRunByWorker[i] > 0) numBusyWorkers++;
+  }
+  assert(numRun == numTasks);
+  return numBusyWorkers;
+}
+
+/**
+ * Function: TestWait
+ * ------------------
+ * Schedules kNumTasks tasks from the same local variable, which is
+ * overwritten as soon as each is scheduled, and confirms that once
+ * ThreadPoolWait returns, each task has been run exactly once.  All but
+ * the last are quick, so a wait that returns a task too early is
+ * almost sure to return before the slow one is done.  This is
+ * done kNumRounds times over with the same pool, since it's meant to
+ * stay usable after a wait.
+ */
+
+static void TestWait(void)
+{
+  threadpool tp;
+  testpool pool;
+  TestPoolNew(&pool, &tp, kNumTasks);
+  int numBusyWorkers = 0;
+  for (int round = 0; round < kNumRounds; round++) {
+    testtask task;
+    for (int i = 0; i < kNumTasks; i++) {
+      MakeTask(&task, i, i == kNumTasks - 1);
+      ThreadPoolSchedule(&tp, &task);
+    }
+    memset(&task, 0, sizeof(task));
+    ThreadPoolWait(&tp);
+    numBusyWorkers = ExpectAllRun(&pool, kNumTasks);
+    memset(pool.timesRun, 0, kNumTasks * sizeof(int));
+    memset(pool.numRunByWorker, 0, sizeof(pool.numRunByWorker));
+  }
+
+  ThreadPoolDispose(&tp);
+  free(pool.timesRun);
+  printf("%d rounds of %d tasks each ran exactly once, on %d of the %d workers the last time.\n",
+         kNumRounds, kNumTasks, numBusyWorkers, kNumWorkers);
+}
+
+/**
+ * Function: TestDispose
+ * ---------------------
+ * Schedules tasks that take long enough that most are still queued or
+ * running when ThreadPoolDispose is called, and confirms that all of
+ * them had run by the time it returned.
+ */
+
+static void TestDispose(void)
+{
+  threadpool tp;
+  testpool pool;
+  TestPoolNew(&pool, &tp, kNumSlowTasks);
+  for (int i = 0; i < kNumSlowTasks; i++) {
+    testtask task;
+    MakeTask(&task, i, true);
+    ThreadPoolSchedule(&tp, &task);
+  }
+  ThreadPoolDispose(&tp);
+  int numBusyWorkers = ExpectAllRun(&pool, kNumSlowTasks);
+  free(pool.timesRun);
+  printf("All %d slow tasks had run, on %d workers, by the time the pool was disposed of.\n",
+         kNumSlowTasks, numBusyWorkers);
+}
+
+int main(int ignored, char **alsoIgnored)
+{
+  TestWait();
+  TestDispose();
+  return 0;
+}
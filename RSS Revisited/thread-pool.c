@@ -0,0 +1,114 @@
+#include "thread-pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static void *TaskAddress(const threadpool *tp, int position)
+{
+  return tp->tasks + (position % tp->queueCapacity) * tp->taskSize;
+}
+
+static void *Worker(void *arg)
+{
+  threadpool *tp = arg;
+  char task[tp->taskSize];
+
+  pthread_mutex_lock(&tp->lock);
+  while (true) {
+    while (tp->numQueued == 0 && !tp->shuttingDown)
+      pthread_cond_wait(&tp->taskAvailable, &tp->lock);
+    if (tp->numQueued == 0) break; // shutting down and nothing left to do
+
+    memcpy(task, TaskAddress(tp, tp->head), tp->taskSize);
+    tp->head = (tp->head + 1) % tp->queueCapacity;
+    tp->numQueued--;
+    pthread_cond_signal(&tp->slotAvailable);
+    pthread_mutex_unlock(&tp->lock);
+
+    tp->taskfn(task, tp->auxData);
+
+    pthread_mutex_lock(&tp->lock);
+    if (--tp->numOutstanding == 0)
+      pthread_cond_broadcast(&tp->allDone);
+  }
+  pthread_mutex_unlock(&tp->lock);
+  return NULL;
+}
+
+void ThreadPoolNew(threadpool *tp, int numWorkers, int queueCapacity, int taskSize,
+		   ThreadPoolTaskFunction taskfn, void *auxData)
+{
+  assert(numWorkers > 0 && queueCapacity > 0 && taskSize > 0);
+  assert(taskfn != NULL);
+
+  tp->numWorkers = numWorkers;
+  tp->taskSize = taskSize;
+  tp->queueCapacity = queueCapacity;
+  tp->head = 0;
+  tp->numQueued = 0;
+  tp->numOutstanding = 0;
+  tp->shuttingDown = false;
+  tp->taskfn = taskfn;
+  tp->auxData = auxData;
+  tp->tasks = malloc(queueCapacity * taskSize);
+  tp->workers = malloc(numWorkers * sizeof(pthread_t));
+  assert(tp->tasks != NULL && tp->workers != NULL);
+  pthread_mutex_init(&tp->lock, NULL);
+  pthread_cond_init(&tp->taskAvailable, NULL);
+  pthread_cond_init(&tp->slotAvailable, NULL);
+  pthread_cond_init(&tp->allDone, NULL);
+
+  for (int i = 0; i < numWorkers; i++)
+    pthread_create(&tp->workers[i], NULL, Worker, tp);
+}
+
+void ThreadPoolSchedule(threadpool *tp, const void *taskAddr)
+{
+  pthread_mutex_lock(&tp->lock);
+  assert(!tp->shuttingDown);
+  while (tp->numQueued == tp->queueCapacity)
+    pthread_cond_wait(&tp->slotAvailable, &tp->lock);
+
+  memcpy(TaskAddress(tp, tp->head + tp->numQueued), taskAddr, tp->taskSize);
+  tp->numQueued++;
+  tp->numOutstanding++;
+  pthread_cond_signal(&tp->taskAvailable);
+  pthread_mutex_unlock(&tp->lock);
+}
+
+int ThreadPoolWorkerIndex(const threadpool *tp)
+{
+  pthread_t self = pthread_self();
+  for (int i = 0; i < tp->numWorkers; i++)
+    if (pthread_equal(tp->workers[i], self)) return i;
+  assert(false); // not called from one of this pool's workers
+  return -1;
+}
+
+void ThreadPoolWait(threadpool *tp)
+{
+  pthread_mutex_lock(&tp->lock);
+  while (tp->numOutstanding > 0)
+    pthread_cond_wait(&tp->allDone, &tp->lock);
+  pthread_mutex_unlock(&tp->lock);
+}
+
+void ThreadPoolDispose(threadpool *tp)
+{
+  ThreadPoolWait(tp);
+
+  pthread_mutex_lock(&tp->lock);
+  tp->shuttingDown = true;
+  pthread_cond_broadcast(&tp->taskAvailable);
+  pthread_mutex_unlock(&tp->lock);
+
+  for (int i = 0; i < tp->numWorkers; i++)
+    pthread_join(tp->workers[i], NULL);
+
+  pthread_cond_destroy(&tp->allDone);
+  pthread_cond_destroy(&tp->slotAvailable);
+  pthread_cond_destroy(&tp->taskAvailable);
+  pthread_mutex_destroy(&tp->lock);
+  free(tp->workers);
+  free(tp->tasks);
+}
@@ -0,0 +1,106 @@
+/**
+ * File: thread-pool.h
+ * -------------------
+ * Exports the threadpool type, a fixed number of worker threads
+ * fed by a bounded queue of tasks.  Tasks are copied into the queue
+ * by value, much like elements are copied into a vector, so clients
+ * needn't allocate each one separately.
+ */
+
+#ifndef __thread_pool_
+#define __thread_pool_
+
+#include <pthread.h>
+#include "bool.h"
+
+/**
+ * Type: ThreadPoolTaskFunction
+ * ----------------------------
+ * The function each worker calls on every task it pulls from the
+ * queue.  taskAddr is the address of the worker's private copy of
+ * the task, and auxData is whatever was passed to ThreadPoolNew.
+ * The function is responsible for releasing any resources the task owns.
+ */
+
+typedef void (*ThreadPoolTaskFunction)(void *taskAddr, void *auxData);
+
+/**
+ * Type: threadpool
+ * ----------------
+ * As with the vector and the hashset, the fields are exposed only
+ * because there's no easy way to hide them in C.
+ */
+
+typedef struct {
+  pthread_t *workers;
+  int numWorkers;
+  char *tasks;               // ring buffer of queueCapacity tasks
+  int taskSize;
+  int queueCapacity;
+  int head;                  // index of the oldest queued task
+  int numQueued;
+  int numOutstanding;        // queued plus currently running
+  bool shuttingDown;
+  ThreadPoolTaskFunction taskfn;
+  void *auxData;
+  pthread_mutex_t lock;
+  pthread_cond_t taskAvailable;
+  pthread_cond_t slotAvailable;
+  pthread_cond_t allDone;
+} threadpool;
+
+/**
+ * Function: ThreadPoolNew
+ * -----------------------
+ * Launches numWorkers threads, each of which repeatedly pulls
+ * the oldest task from a queue with room for queueCapacity
+ * tasks of taskSize bytes and passes it to taskfn along with auxData.
+ * An assert is raised unless numWorkers, queueCapacity and taskSize
+ * are all positive and taskfn is non-NULL.
+ */
+
+void ThreadPoolNew(threadpool *tp, int numWorkers, int queueCapacity, int taskSize,
+		   ThreadPoolTaskFunction taskfn, void *auxData);
+
+/**
+ * Function: ThreadPoolSchedule
+ * ----------------------------
+ * Copies the task at taskAddr into the queue.  If the queue is full,
+ * the caller blocks until a worker frees up a slot, which keeps a
+ * fast producer from getting arbitrarily far ahead of the workers.
+ * Workers may schedule tasks of their own, but only if the queue is
+ * large enough that doing so can never block every worker at once.
+ */
+
+void ThreadPoolSchedule(threadpool *tp, const void *taskAddr);
+
+/**
+ * Function: ThreadPoolWorkerIndex
+ * -------------------------------
+ * Returns the index, between 0 and numWorkers - 1, of the worker
+ * running the calling task, so tasks can keep per-worker state in
+ * an array without any locking.  Only meaningful when called from
+ * within a task running on the specified pool.
+ */
+
+int ThreadPoolWorkerIndex(const threadpool *tp);
+
+/**
+ * Function: ThreadPoolWait
+ * ------------------------
+ * Blocks until every task scheduled so far has been run to completion.
+ * The pool stays usable afterwards.
+ */
+
+void ThreadPoolWait(threadpool *tp);
+
+/**
+ * Function: ThreadPoolDispose
+ * ---------------------------
+ * Waits for all outstanding tasks, then stops and joins every
+ * worker and releases the queue.
+ */
+
+void ThreadPoolDispose(threadpool *tp);
+
+#endif
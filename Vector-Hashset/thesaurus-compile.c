@@ -0,0 +1,43 @@
+#include "thesaurus-image.h"
+#include <stdio.h>
+
+/**
+ * Provides the entry point to the converter.  Usage:
+ *
+ *     thesaurus-compile <flat-text-thesaurus> <thesaurus-image>
+ */
+
+int main(int argc, const char *argv[])
+{
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s <flat-text-thesaurus> <thesaurus-image>\n", argv[0]);
+    return 1;
+  }
+
+  FILE *infile = fopen(argv[1], "r");
+  if (infile == NULL) {
+    fprintf(stderr, "Could not open thesaurus file named \"%s\"\n", argv[1]);
+    return 1;
+  }
+
+  thesaurusimage image;
+  ThesaurusImageBuild(&image, infile, false);
+  fclose(infile);
+
+  FILE *outfile = fopen(argv[2], "wb");
+  if (outfile == NULL) {
+    fprintf(stderr, "Could not create thesaurus image named \"%s\"\n", argv[2]);
+    return 1;
+  }
+
+  bool written = ThesaurusImageWrite(&image, outfile);
+  if (fclose(outfile) != 0 || !written) {
+    fprintf(stderr, "Unable to write the thesaurus image.\n");
+    return 1;
+  }
+
+  printf("Wrote %u words, %u entries and %u synonyms.\n", image.header->numWords,
+         image.header->numEntries, image.header->numSynonyms);
+  ThesaurusImageClose(&image);
+  return 0;
+}
@@ -0,0 +1,398 @@
+#include "thesaurus-image.h"
+#include "hashset.h"
+#include "streamtokenizer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const signed long kHashMultiplier = -1664117991L;
+unsigned long ThesaurusImageHash(const char *word)
+{
+  unsigned long hashcode = 0;
+  for (const char *c = word; *c != '\0'; c++)
+    hashcode = hashcode * kHashMultiplier + tolower((unsigned char) *c);
+  return hashcode;
+}
+
+static bool StringIsValid(const thesaurusimage *ti, uint32_t offset)
+{
+  return offset < ti->header->stringsSize;
+}
+
+/**
+ * Confirms that the header is believable and that every array it
+ * describes fits within the image, points the array fields of the
+ * thesaurusimage at their sections, and then checks every offset and
+ * id stored in them, so that no lookup on an image that passes can
+ * read outside of it or probe forever, however the file was damaged.
+ */
+
+static bool LayOutSections(thesaurusimage *ti)
+{
+  if (ti->size < sizeof(thesaurusImageHeader)) return false;
+  const thesaurusImageHeader *header = ti->base;
+  if (memcmp(header->magic, kThesaurusImageMagic, sizeof(header->magic)) != 0) return false;
+  if (header->numWords > INT_MAX || header->numEntries > header->numWords) return false;
+  if (header->numBuckets == 0 || (header->numBuckets & (header->numBuckets - 1)) != 0) return false;
+  if (header->numBuckets <= header->numWords) return false;
+
+  uint64_t numInts = (uint64_t) header->numWords + header->numEntries + 1 +
+    header->numSynonyms + header->numBuckets;
+  if (sizeof(thesaurusImageHeader) + numInts * sizeof(uint32_t) + header->stringsSize != ti->size)
+    return false;
+
+  ti->header = header;
+  ti->wordOffsets = (const uint32_t *) (header + 1);
+  ti->synonymOffsets = ti->wordOffsets + header->numWords;
+  ti->synonyms = ti->synonymOffsets + header->numEntries + 1;
+  ti->buckets = ti->synonyms + header->numSynonyms;
+  ti->strings = (const char *) (ti->buckets + header->numBuckets);
+  if (header->stringsSize == 0 || ti->strings[header->stringsSize - 1] != '\0') return false;
+
+  for (uint32_t i = 0; i < header->numWords; i++)
+    if (!StringIsValid(ti, ti->wordOffsets[i])) return false;
+
+  if (ti->synonymOffsets[0] != 0 || ti->synonymOffsets[header->numEntries] != header->numSynonyms) return false;
+  for (uint32_t i = 0; i < header->numEntries; i++)
+    if (ti->synonymOffsets[i] > ti->synonymOffsets[i + 1]) return false;
+  for (uint32_t i = 0; i < header->numSynonyms; i++)
+    if (ti->synonyms[i] >= header->numWords) return false;
+  uint32_t numEmptyBuckets = 0;
+  for (uint32_t i = 0; i < header->numBuckets; i++) {
+    if (ti->buckets[i] > header->numWords) return false; // word id + 1, or 0 for an empty bucket
+    if (ti->buckets[i] == 0) numEmptyBuckets++;
+  }
+
+  return numEmptyBuckets > 0; // a lookup only ever stops on a match or an empty bucket
+}
+
+bool ThesaurusImageOpen(thesaurusimage *ti, const char *filename)
+{
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) return false;
+
+  struct stat info;
+  if (fstat(fd, &info) == -1 || info.st_size == 0) {
+    close(fd);
+    return false;
+  }
+
+  ti->size = info.st_size;
+  ti->mapped = true;
+  ti->base = mmap(NULL, ti->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // the mapping survives the close
+  if (ti->base == MAP_FAILED) return false;
+
+  if (!LayOutSections(ti)) {
+    munmap(ti->base, ti->size);
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * Associates a word with the integer id it was assigned when first
+ * encountered.  The word itself is owned by the words vector of the
+ * thesaurusBuilder, so the hashset of wordIds doesn't free anything.
+ */
+
+typedef struct {
+  const char *word;
+  int id;
+} wordId;
+
+/**
+ * Convenience struct used to accumulate everything read from the flat
+ * text thesaurus before it's laid out as an image.  Ids are handed
+ * out in the order words are first seen, and entryIndices maps each
+ * word id to the position of its entry within entries (or -1 if the word
+ * never heads a line of its own).  Each entry is a vector of synonym ids,
+ * and entryWords records which word heads each entry.
+ */
+
+typedef struct {
+  hashset wordIds;
+  vector words;
+  vector entryIndices;
+  vector entries;
+  vector entryWords;
+} thesaurusBuilder;
+
+static int WordIdHash(const void *elem, int numBuckets)
+{
+  const wordId *wid = elem;
+  return ThesaurusImageHash(wid->word) % numBuckets;
+}
+
+static int WordIdCompare(const void *elem1, const void *elem2)
+{
+  return strcmp(((const wordId *) elem1)->word, ((const wordId *) elem2)->word);
+}
+
+static void StringFree(void *elem)
+{
+  free(*(char **) elem);
+}
+
+static void SynonymListFree(void *elem)
+{
+  VectorDispose(elem);
+}
+
+static const int kNumWordBuckets = (1 << 19) - 1;
+static void BuilderNew(thesaurusBuilder *builder)
+{
+  HashSetNew(&builder->wordIds, sizeof(wordId), kNumWordBuckets, WordIdHash, WordIdCompare, NULL);
+  VectorNew(&builder->words, sizeof(char *), StringFree, 1 << 16);
+  VectorNew(&builder->entryIndices, sizeof(int), NULL, 1 << 16);
+  VectorNew(&builder->entries, sizeof(vector), SynonymListFree, 1 << 14);
+  VectorNew(&builder->entryWords, sizeof(int), NULL, 1 << 14);
+}
+
+static void BuilderDispose(thesaurusBuilder *builder)
+{
+  HashSetDispose(&builder->wordIds);
+  VectorDispose(&builder->words);
+  VectorDispose(&builder->entryIndices);
+  VectorDispose(&builder->entries);
+  VectorDispose(&builder->entryWords);
+}
+
+/**
+ * Returns the id of the specified word, assigning it the next
+ * available id if it's never been seen before.
+ */
+
+static int InternWord(thesaurusBuilder *builder, const char *word)
+{
+  wordId key = { word, -1 };
+  wordId *found = HashSetLookup(&builder->wordIds, &key);
+  if (found != NULL) return found->id;
+
+  char *copy = strdup(word);
+  int noEntry = -1;
+  key.word = copy;
+  key.id = VectorLength(&builder->words);
+  VectorAppend(&builder->words, &copy);
+  VectorAppend(&builder->entryIndices, &noEntry);
+  HashSetEnter(&builder->wordIds, &key);
+  return key.id;
+}
+
+static void ReadThesaurus(thesaurusBuilder *builder, streamtokenizer *st, bool progress)
+{
+  char buffer[2048];
+  while (STNextToken(st, buffer, sizeof(buffer))) {
+    int headId = InternWord(builder, buffer);
+    vector synonyms;
+    VectorNew(&synonyms, sizeof(int), NULL, 4);
+    while (STNextToken(st, buffer, sizeof(buffer)) && (buffer[0] == ',')) {
+      STNextToken(st, buffer, sizeof(buffer));
+      int synonymId = InternWord(builder, buffer);
+      VectorAppend(&synonyms, &synonymId);
+    }
+
+    int *entryIndex = VectorNth(&builder->entryIndices, headId);
+    if (*entryIndex == -1) {
+      *entryIndex = VectorLength(&builder->entries);
+      VectorAppend(&builder->entries, &synonyms);
+      VectorAppend(&builder->entryWords, &headId);
+    } else {
+      VectorReplace(&builder->entries, &synonyms, *entryIndex);
+    }
+
+    if (progress && VectorLength(&builder->entries) % 1000 == 0) {
+      printf(".");
+      fflush(stdout);
+    }
+  }
+}
+
+/**
+ * Renumbers the words so that entries come first (the image relies on
+ * id < numEntries meaning the word has synonyms), then allocates one
+ * block large enough for the entire image and fills in every section
+ * described in thesaurus-image.h.
+ */
+
+static void LayOutImage(thesaurusimage *ti, thesaurusBuilder *builder)
+{
+  uint32_t numWords = VectorLength(&builder->words);
+  uint32_t numEntries = VectorLength(&builder->entries);
+  uint32_t *newIds = malloc(numWords * sizeof(uint32_t));
+  uint32_t *oldIds = malloc(numWords * sizeof(uint32_t));
+  assert(numWords == 0 || (newIds != NULL && oldIds != NULL));
+
+  uint32_t nextId = 0;
+  for (uint32_t i = 0; i < numEntries; i++)
+    oldIds[nextId++] = *(int *) VectorNth(&builder->entryWords, i);
+  for (uint32_t i = 0; i < numWords; i++)
+    if (*(int *) VectorNth(&builder->entryIndices, i) == -1) oldIds[nextId++] = i;
+  for (uint32_t i = 0; i < numWords; i++)
+    newIds[oldIds[i]] = i;
+
+  thesaurusImageHeader header;
+  memcpy(header.magic, kThesaurusImageMagic, sizeof(header.magic));
+  header.numWords = numWords;
+  header.numEntries = numEntries;
+  header.numSynonyms = 0;
+  header.numBuckets = 1;
+  while (header.numBuckets < 2 * numWords + 1) header.numBuckets <<= 1;
+  header.stringsSize = 0;
+  for (uint32_t i = 0; i < numWords; i++)
+    header.stringsSize += strlen(*(char **) VectorNth(&builder->words, i)) + 1;
+  for (uint32_t i = 0; i < numEntries; i++)
+    header.numSynonyms += VectorLength(VectorNth(&builder->entries, i));
+  if (header.stringsSize == 0) header.stringsSize = 1; // keeps the final '\0' invariant
+
+  uint64_t numInts = (uint64_t) numWords + numEntries + 1 + header.numSynonyms + header.numBuckets;
+  ti->size = sizeof(header) + numInts * sizeof(uint32_t) + header.stringsSize;
+  ti->mapped = false;
+  ti->base = calloc(ti->size, 1);
+  assert(ti->base != NULL);
+  memcpy(ti->base, &header, sizeof(header));
+
+  uint32_t *wordOffsets = (uint32_t *) ((thesaurusImageHeader *) ti->base + 1);
+  uint32_t *synonymOffsets = wordOffsets + numWords;
+  uint32_t *synonyms = synonymOffsets + numEntries + 1;
+  uint32_t *buckets = synonyms + header.numSynonyms;
+  char *strings = (char *) (buckets + header.numBuckets);
+
+  uint32_t offset = 0;
+  uint32_t mask = header.numBuckets - 1;
+  for (uint32_t id = 0; id < numWords; id++) {
+    const char *word = *(char **) VectorNth(&builder->words, oldIds[id]);
+    int length = strlen(word) + 1;
+    memcpy(strings + offset, word, length);
+    wordOffsets[id] = offset;
+    offset += length;
+    uint32_t bucket = ThesaurusImageHash(word) & mask;
+    while (buckets[bucket] != 0) bucket = (bucket + 1) & mask;
+    buckets[bucket] = id + 1;
+  }
+
+  uint32_t numSynonyms = 0;
+  for (uint32_t id = 0; id < numEntries; id++) {
+    vector *entry = VectorNth(&builder->entries, id);
+    synonymOffsets[id] = numSynonyms;
+    for (int i = 0; i < VectorLength(entry); i++)
+      synonyms[numSynonyms++] = newIds[*(int *) VectorNth(entry, i)];
+  }
+  synonymOffsets[numEntries] = numSynonyms;
+
+  free(newIds);
+  free(oldIds);
+  bool wellFormed = LayOutSections(ti);
+  assert(wellFormed);
+}
+
+void ThesaurusImageBuild(thesaurusimage *ti, FILE *infile, bool progress)
+{
+  thesaurusBuilder builder;
+  streamtokenizer st;
+
+  BuilderNew(&builder);
+  STNew(&st, infile, ",\n", false);
+  ReadThesaurus(&builder, &st, progress);
+  STDispose(&st);
+  LayOutImage(ti, &builder);
+  BuilderDispose(&builder);
+}
+
+bool ThesaurusImageWrite(const thesaurusimage *ti, FILE *outfile)
+{
+  return fwrite(ti->base, 1, ti->size, outfile) == ti->size;
+}
+
+void ThesaurusImageClose(thesaurusimage *ti)
+{
+  if (ti->mapped) {
+    munmap(ti->base, ti->size);
+  } else {
+    free(ti->base);
+  }
+}
+
+int ThesaurusImageLookup(const thesaurusimage *ti, const char *word)
+{
+  uint32_t mask = ti->header->numBuckets - 1;
+  for (uint32_t bucket = ThesaurusImageHash(word) & mask; ti->buckets[bucket] != 0; bucket = (bucket + 1) & mask) {
+    int wordId = ti->buckets[bucket] - 1;
+    if (strcmp(ThesaurusImageWord(ti, wordId), word) == 0) return wordId;
+  }
+
+  return -1;
+}
+
+const char *ThesaurusImageWord(const thesaurusimage *ti, int wordId)
+{
+  assert(wordId >= 0 && wordId < ti->header->numWords);
+  return ti->strings + ti->wordOffsets[wordId];
+}
+
+int ThesaurusImageSynonymCount(const thesaurusimage *ti, int wordId)
+{
+  assert(wordId >= 0 && wordId < ti->header->numWords);
+  if (wordId >= ti->header->numEntries) return 0;
+  return ti->synonymOffsets[wordId + 1] - ti->synonymOffsets[wordId];
+}
+
+const uint32_t *ThesaurusImageSynonyms(const thesaurusimage *ti, int wordId)
+{
+  assert(wordId >= 0 && wordId < ti->header->numWords);
+  if (wordId >= ti->header->numEntries) return ti->synonyms;
+  return ti->synonyms + ti->synonymOffsets[wordId];
+}
+
+static int IntCompare(const void *elem1, const void *elem2)
+{
+  int one = *(const int *) elem1;
+  int two = *(const int *) elem2;
+  return (one > two) - (one < two);
+}
+
+void ThesaurusImageRelatedWords(const thesaurusimage *ti, int wordId, int maxHops, vector *related)
+{
+  // The visited bitmap is allocated per call rather than kept in the image, which
+  // keeps expansions stateless, and one bit per word is small even for a large thesaurus.
+  uint32_t numWords = ti->header->numWords;
+  unsigned char *visited = calloc(numWords / 8 + 1, 1);
+  assert(visited != NULL);
+  visited[wordId / 8] |= 1 << (wordId % 8);
+
+  vector frontier, next;
+  VectorNew(&frontier, sizeof(int), NULL, 16);
+  VectorAppend(&frontier, &wordId);
+  for (int hops = 1; hops <= maxHops && VectorLength(&frontier) > 0; hops++) {
+    VectorNew(&next, sizeof(int), NULL, 64);
+    for (int i = 0; i < VectorLength(&frontier); i++) {
+      int from = *(int *) VectorNth(&frontier, i);
+      const uint32_t *synonyms = ThesaurusImageSynonyms(ti, from);
+      int numSynonyms = ThesaurusImageSynonymCount(ti, from);
+      for (int j = 0; j < numSynonyms; j++) {
+	int to = synonyms[j];
+	if (visited[to / 8] & (1 << (to % 8))) continue;
+	visited[to / 8] |= 1 << (to % 8);
+	VectorAppend(&next, &to);
+      }
+    }
+
+    VectorSort(&next, IntCompare);
+    for (int i = 0; i < VectorLength(&next); i++) {
+      relatedWord word = { *(int *) VectorNth(&next, i), hops };
+      VectorAppend(related, &word);
+    }
+    VectorDispose(&frontier);
+    frontier = next;
+  }
+
+  VectorDispose(&frontier);
+  free(visited);
+}
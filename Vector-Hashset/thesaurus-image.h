@@ -0,0 +1,175 @@
+#ifndef _thesaurusimage_
+#define _thesaurusimage_
+
+#include "bool.h"
+#include "vector.h"
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * File: thesaurus-image.h
+ * -----------------------
+ * Defines a compact binary encoding of the flat text thesaurus and
+ * the functions needed to query it in place.  A thesaurus image is
+ * produced once by thesaurus-compile, and from then on
+ * thesaurus-lookup can mmap it and answer queries immediately, rather
+ * than spending its startup parsing text and strdup'ing every synonym.
+ *
+ * Every distinct word is assigned an integer id, and everything else
+ * refers to words by id.  The ids of words that head a line of the
+ * text thesaurus (the "entries") come first, so id < numEntries if and
+ * only if the word has a synonym list of its own.  The file is laid
+ * out as follows, with every integer stored as a native-endian uint32_t:
+ *
+ *     header          thesaurusImageHeader
+ *     wordOffsets     [numWords]        where each word starts in strings
+ *     synonymOffsets  [numEntries + 1]  entry i's synonyms are synonyms[synonymOffsets[i]]
+ *                                       up to (but excluding) synonyms[synonymOffsets[i + 1]]
+ *     synonyms        [numSynonyms]     word ids
+ *     buckets         [numBuckets]      open addressed hash table of word id + 1 (0 means empty)
+ *     strings         [stringsSize]     the null-terminated words, back to back
+ *
+ * The images are meant to be built and read on the same kind of machine.
+ *
+ * Taken together, synonymOffsets and synonyms are the compressed sparse
+ * row adjacency lists of a directed graph from each entry to its
+ * synonyms, which is what makes multi-hop expansions like
+ * ThesaurusImageRelatedWords cheap.
+ */
+
+#define kThesaurusImageMagic "THS1"
+
+typedef struct {
+  char magic[4];
+  uint32_t numWords;
+  uint32_t numEntries;
+  uint32_t numSynonyms;
+  uint32_t numBuckets;   // always a power of two
+  uint32_t stringsSize;
+} thesaurusImageHeader;
+
+/**
+ * Type: thesaurusimage
+ * --------------------
+ * A read-only view of a thesaurus image, either mapped in from disk
+ * or built in memory from a flat text thesaurus.  As with the vector
+ * and the hashset, clients should only interact with it through the
+ * functions below.
+ */
+
+typedef struct {
+  void *base;
+  size_t size;
+  bool mapped;
+  const thesaurusImageHeader *header;
+  const uint32_t *wordOffsets;
+  const uint32_t *synonymOffsets;
+  const uint32_t *synonyms;
+  const uint32_t *buckets;
+  const char *strings;
+} thesaurusimage;
+
+/**
+ * Function: ThesaurusImageOpen
+ * ----------------------------
+ * Maps the named thesaurus image into memory.  Returns true if and
+ * only if the file could be opened, mapped, and confirmed to be a
+ * well-formed image: every section must fit in the file, and every
+ * offset and word id within them must be in range, so the functions
+ * below can trust what they read.  Nothing needs to be disposed of if
+ * false is returned.
+ */
+
+bool ThesaurusImageOpen(thesaurusimage *ti, const char *filename);
+
+/**
+ * Function: ThesaurusImageBuild
+ * -----------------------------
+ * Tokenizes the flat text thesaurus accessible through infile, where
+ * each line is of the form
+ *
+ *     cold,arctic,blustery,freezing,frigid,icy,nippy,polar
+ *
+ * and lays it out in memory exactly as it would be laid out on disk.
+ * A word heading more than one line keeps only the synonyms of the last.
+ * If progress is true, a dot is printed for every thousand entries read.
+ */
+
+void ThesaurusImageBuild(thesaurusimage *ti, FILE *infile, bool progress);
+
+/**
+ * Function: ThesaurusImageWrite
+ * -----------------------------
+ * Writes the image to outfile so it can later be passed to
+ * ThesaurusImageOpen.  Returns true if and only if every byte was written.
+ */
+
+bool ThesaurusImageWrite(const thesaurusimage *ti, FILE *outfile);
+
+/**
+ * Function: ThesaurusImageClose
+ * -----------------------------
+ * Unmaps (or frees) the image.  Any strings or arrays previously handed back
+ * by the functions below are invalid once this is called.
+ */
+
+void ThesaurusImageClose(thesaurusimage *ti);
+
+/**
+ * Function: ThesaurusImageLookup
+ * ------------------------------
+ * Returns the id of the specified word, or -1 if the word appears nowhere
+ * in the thesaurus.  As with thesaurus-lookup's hashset, the match is exact.
+ */
+
+int ThesaurusImageLookup(const thesaurusimage *ti, const char *word);
+
+/**
+ * Functions: ThesaurusImageWord, ThesaurusImageSynonymCount, ThesaurusImageSynonyms
+ * --------------------------------------------------------------------------------
+ * Accessors for the word with the specified id.  Words that don't head an
+ * entry of their own have no synonyms, and ThesaurusImageSynonyms returns
+ * the address of the first of ThesaurusImageSynonymCount synonym ids.
+ */
+
+const char *ThesaurusImageWord(const thesaurusimage *ti, int wordId);
+int ThesaurusImageSynonymCount(const thesaurusimage *ti, int wordId);
+const uint32_t *ThesaurusImageSynonyms(const thesaurusimage *ti, int wordId);
+
+/**
+ * Type: relatedWord
+ * -----------------
+ * One word reached by ThesaurusImageRelatedWords, along with the
+ * fewest number of synonym hops needed to reach it.
+ */
+
+typedef struct {
+  int wordId;
+  int hops;
+} relatedWord;
+
+/**
+ * Function: ThesaurusImageRelatedWords
+ * ------------------------------------
+ * Appends to related (a vector of relatedWord records) every word
+ * reachable from the specified word by following at most maxHops
+ * synonym links, excluding the word itself.  Each word appears once,
+ * and all words one hop away are listed before those two hops away,
+ * and so forth.  Within a hop, words are ordered by id.  No state is
+ * kept inside the image, so concurrent expansions are safe.
+ */
+
+void ThesaurusImageRelatedWords(const thesaurusimage *ti, int wordId, int maxHops, vector *related);
+
+/**
+ * Function: ThesaurusImageHash
+ * ----------------------------
+ * The full (not yet reduced) case-insensitive hash code used to place
+ * words in an image's buckets.  It's exposed so that thesaurus-compile
+ * and the loader are guaranteed to agree.
+ */
+
+unsigned long ThesaurusImageHash(const char *word);
+
+#endif
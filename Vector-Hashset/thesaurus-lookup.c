@@ -2,11 +2,14 @@
 #include "hashset.h"
 #include "vector.h"
 #include "streamtokenizer.h"
+#include "thesaurus-image.h"
 #include <stdlib.h>  // for malloc, free, etc
 #include <string.h>  // for strcmp
+#include <assert.h>
 #include <strings.h>
-#include <ctype.h>   // for tolower
-#include <time.h>    // for time
+#include <time.h>    // for time, clock_gettime
+#include <unistd.h>  // for sysconf
+#include <pthread.h>
 
 /**
  * Convenience struct used to bundle a word (expressed 
@@ -23,7 +26,9 @@ typedef struct {
 /**
  * Hash function provided by the goddess of lecturing,
  * Julie Zelenski.  I'm not sure where it came from, but
- * I'm guessing the multiplier is standard.
+ * I'm guessing the multiplier is standard.  It's the same
+ * hash thesaurus images place their words with, so it's
+ * computed by ThesaurusImageHash, in one pass over the string.
  *
  * @param elem a void * which is understood to be the address
  *             of a char *, which itself addresses the first of
@@ -32,14 +37,9 @@ typedef struct {
  * @return the hashcode of the C string addressed by elem.
  */
 
-static const signed long kHashMultiplier = -1664117991L;
 static int StringHash(const void *elem, int numBuckets)
 {
-  char *s = *(char **) elem;
-  unsigned long hashcode = 0;
-  for (int i = 0; i < strlen(s); i++)  
-    hashcode = hashcode * kHashMultiplier + tolower(s[i]);  
-  return hashcode % numBuckets;                                  
+  return ThesaurusImageHash(*(char **) elem) % numBuckets;
 }
 
 /**
@@ -185,31 +185,184 @@ static int RandomInteger(int low, int high)
   return low + offset;
 }
 
+/**
+ * The thesaurus being queried: either an image produced by
+ * thesaurus-compile and mapped in place, or, by default, the hashset of
+ * thesaurusEntry records built from a flat text thesaurus.
+ */
+
+typedef struct {
+  bool isImage;
+  thesaurusimage image;
+  hashset entries;
+} thesaurus;
+
+/**
+ * One word reached while expanding a word's synonyms, along with the
+ * fewest number of synonym hops needed to reach it.
+ */
+
+typedef struct {
+  const char *word;
+  int hops;
+} relatedEntry;
+
+/**
+ * Breadth-first expansion over the hashset of thesaurusEntry records,
+ * the counterpart of ThesaurusImageRelatedWords.  Words are visited by
+ * name, and within a hop they're listed in alphabetical order.  Only
+ * words heading an entry of their own lead anywhere.
+ */
+
+static const int kNumVisitedBuckets = 1021;
+static void FindRelatedEntries(const hashset *entries, const char *word, int maxHops, vector *related)
+{
+  hashset visited;
+  HashSetNew(&visited, sizeof(const char *), kNumVisitedBuckets, StringHash, StringCompare, NULL);
+  HashSetEnter(&visited, &word);
+
+  vector frontier, next;
+  VectorNew(&frontier, sizeof(const char *), NULL, 16);
+  VectorAppend(&frontier, &word);
+  for (int hops = 1; hops <= maxHops && VectorLength(&frontier) > 0; hops++) {
+    VectorNew(&next, sizeof(const char *), NULL, 64);
+    for (int i = 0; i < VectorLength(&frontier); i++) {
+      const thesaurusEntry *entry = HashSetLookup(entries, VectorNth(&frontier, i));
+      if (entry == NULL) continue;
+      for (int j = 0; j < VectorLength(&entry->synonyms); j++) {
+	const char *to = *(const char **) VectorNth(&entry->synonyms, j);
+	if (HashSetLookup(&visited, &to) != NULL) continue;
+	HashSetEnter(&visited, &to);
+	VectorAppend(&next, &to);
+      }
+    }
+
+    VectorSort(&next, StringCompare);
+    for (int i = 0; i < VectorLength(&next); i++) {
+      relatedEntry entry = { *(const char **) VectorNth(&next, i), hops };
+      VectorAppend(related, &entry);
+    }
+    VectorDispose(&frontier);
+    frontier = next;
+  }
+
+  VectorDispose(&frontier);
+  HashSetDispose(&visited);
+}
+
+/**
+ * Appends to related (a vector of relatedEntry records) every word within
+ * maxHops synonym hops of the specified one, whichever kind of thesaurus
+ * it's drawn from.
+ */
+
+static void FindRelatedWords(const thesaurus *t, const char *word, int maxHops, vector *related)
+{
+  if (!t->isImage) {
+    FindRelatedEntries(&t->entries, word, maxHops, related);
+    return;
+  }
+
+  vector relatedIds;
+  VectorNew(&relatedIds, sizeof(relatedWord), NULL, 64);
+  ThesaurusImageRelatedWords(&t->image, ThesaurusImageLookup(&t->image, word), maxHops, &relatedIds);
+  for (int i = 0; i < VectorLength(&relatedIds); i++) {
+    const relatedWord *found = VectorNth(&relatedIds, i);
+    relatedEntry entry = { ThesaurusImageWord(&t->image, found->wordId), found->hops };
+    VectorAppend(related, &entry);
+  }
+  VectorDispose(&relatedIds);
+}
+
+/**
+ * Prints every word within the specified number of synonym hops of
+ * word, one line per hop, eliding all but the first few of each.
+ */
+
+static const int kMaxHops = 2;
+static const int kMaxWordsPerHop = 12;
+static void PrintRelatedWords(const thesaurus *t, const char *word)
+{
+  vector related;
+  VectorNew(&related, sizeof(relatedEntry), NULL, 64);
+  FindRelatedWords(t, word, kMaxHops, &related);
+
+  int i = 0;
+  for (int hops = 1; hops <= kMaxHops; hops++) {
+    int numPrinted = 0, numWords = 0;
+    printf("\tWithin %d hop%s:", hops, (hops == 1) ? "" : "s");
+    for (; i < VectorLength(&related) && ((relatedEntry *) VectorNth(&related, i))->hops == hops; i++, numWords++) {
+      if (numPrinted == kMaxWordsPerHop) continue;
+      printf("%s \"%s\"", (numPrinted == 0) ? "" : ",", ((relatedEntry *) VectorNth(&related, i))->word);
+      numPrinted++;
+    }
+    if (numWords == 0) printf(" nothing new");
+    if (numWords > numPrinted) printf(", and %d more", numWords - numPrinted);
+    printf("\n");
+  }
+
+  VectorDispose(&related);
+}
+
+/**
+ * Returns the number of synonyms listed for the specified word, or -1
+ * if the word appears nowhere in the thesaurus.
+ */
+
+static int CountSynonyms(const thesaurus *t, const char *word)
+{
+  if (!t->isImage) {
+    const thesaurusEntry *found = HashSetLookup(&t->entries, &word);
+    return (found == NULL) ? -1 : VectorLength(&found->synonyms);
+  }
+
+  int wordId = ThesaurusImageLookup(&t->image, word);
+  return (wordId == -1) ? -1 : ThesaurusImageSynonymCount(&t->image, wordId);
+}
+
+/**
+ * Returns the nth of the specified word's synonyms, where n is less
+ * than the count returned by CountSynonyms.
+ */
+
+static const char *NthSynonym(const thesaurus *t, const char *word, int n)
+{
+  if (!t->isImage) {
+    const thesaurusEntry *found = HashSetLookup(&t->entries, &word);
+    return *(char **) VectorNth(&found->synonyms, n);
+  }
+
+  int wordId = ThesaurusImageLookup(&t->image, word);
+  return ThesaurusImageWord(&t->image, ThesaurusImageSynonyms(&t->image, wordId)[n]);
+}
+
 /**
  * Simple question loop that prompts the user for a word, and
  * then looks up the word in the thesaurus.  If present, it
  * selects one of the its synonyms at random, printing it along
- * with the user supplied word.
+ * with the user supplied word, and then lists the words within
+ * two synonym hops of it.
  *
- * @param thesuarus the address of the hashset housing all of the
+ * @param thesuarus the address of the thesaurus housing all of the
  *                  synonyms sets of a large collection of English
  *                  words and phrases.
  */
 
-static void QueryThesaurus(hashset *thesaurus)
+static void QueryThesaurus(const thesaurus *t)
 {
   char response[1024];
-  char *responsep = response;
   while (true) {
     printf("Go ahead and enter a word: ");
-    fgets(response, sizeof(response), stdin);
-    response[strlen(response) - 1] = '\0';
+    if (fgets(response, sizeof(response), stdin) == NULL) return;
+    response[strcspn(response, "\n")] = '\0';
     if (strlen(response) == 0) return;
-    thesaurusEntry *found = HashSetLookup(thesaurus, &responsep);
-    if (found != NULL) {
-      int numSynonyms = VectorLength(&found->synonyms);
-      char *synonym = *(char **) VectorNth(&found->synonyms, RandomInteger(0, numSynonyms - 1));
+    int numSynonyms = CountSynonyms(t, response);
+    if (numSynonyms > 0) {
+      const char *synonym = NthSynonym(t, response, RandomInteger(0, numSynonyms - 1));
       printf("We found \"%s\" in the thesaurus! Its related word of the day is \"%s\".\n", response, synonym);
+      PrintRelatedWords(t, response);
+    } else if (numSynonyms == 0) {
+      printf("We found \"%s\" in the thesaurus, but it has no synonyms of its own.\n", response);
     } else {
       printf("My apologies, but I know of no such word spelled \"%s\".\n", response);
     }
@@ -217,18 +370,293 @@ static void QueryThesaurus(hashset *thesaurus)
 }
 
 /**
- * Provides the enty point to the program.
+ * Growable character buffer used by each batch worker to format its
+ * share of the results, so they can be written out in bulk once
+ * every worker is done.
+ */
+
+typedef struct {
+  char *text;
+  size_t length;
+  size_t capacity;
+} outputBuffer;
+
+static void AppendText(outputBuffer *buffer, const char *text, size_t length)
+{
+  if (buffer->length + length > buffer->capacity) {
+    buffer->capacity = 2 * (buffer->length + length);
+    buffer->text = realloc(buffer->text, buffer->capacity);
+    assert(buffer->text != NULL);
+  }
+
+  memcpy(buffer->text + buffer->length, text, length);
+  buffer->length += length;
+}
+
+/**
+ * Everything one batch worker thread needs: the (shared, read-only) thesaurus
+ * and queries, the half-open range [start, end) of queries it's responsible
+ * for, the shared array where it records each query's latency in nanoseconds,
+ * and the private buffer where it formats its results.
+ */
+
+typedef struct {
+  const thesaurus *thesaurus;
+  char **queries;
+  int start;
+  int end;
+  long *latencies;
+  outputBuffer output;
+} batchWorker;
+
+static long NanosecondsSince(const struct timespec *start)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1000000000L + (now.tv_nsec - start->tv_nsec);
+}
+
+/**
+ * Appends the specified word's synonyms to the buffer, separated by
+ * commas, or a '?' if the word isn't in the thesaurus at all.
+ */
+
+static void AppendSynonyms(outputBuffer *buffer, const thesaurus *t, const char *word)
+{
+  if (!t->isImage) {
+    const thesaurusEntry *found = HashSetLookup(&t->entries, &word);
+    if (found == NULL) AppendText(buffer, "?", 1);
+    for (int i = 0; found != NULL && i < VectorLength(&found->synonyms); i++) {
+      const char *synonym = *(char **) VectorNth(&found->synonyms, i);
+      if (i > 0) AppendText(buffer, ",", 1);
+      AppendText(buffer, synonym, strlen(synonym));
+    }
+    return;
+  }
+
+  int wordId = ThesaurusImageLookup(&t->image, word);
+  if (wordId == -1) AppendText(buffer, "?", 1);
+  int numSynonyms = (wordId == -1) ? 0 : ThesaurusImageSynonymCount(&t->image, wordId);
+  for (int i = 0; i < numSynonyms; i++) {
+    const char *synonym = ThesaurusImageWord(&t->image, ThesaurusImageSynonyms(&t->image, wordId)[i]);
+    if (i > 0) AppendText(buffer, ",", 1);
+    AppendText(buffer, synonym, strlen(synonym));
+  }
+}
+
+/**
+ * Thread routine that resolves each of its queries, producing one
+ * line per query of the form
+ *
+ *     cold: arctic,blustery,freezing,frigid,icy,nippy,polar
+ *
+ * or, for words that aren't in the thesaurus,
+ *
+ *     zzyzx: ?
+ *
+ * A word that's in the thesaurus but has no synonyms gets nothing
+ * after its colon.
+ */
+
+static void *ResolveQueries(void *arg)
+{
+  batchWorker *worker = arg;
+  for (int i = worker->start; i < worker->end; i++) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    const char *query = worker->queries[i];
+    AppendText(&worker->output, query, strlen(query));
+    AppendText(&worker->output, ": ", 2);
+    AppendSynonyms(&worker->output, worker->thesaurus, query);
+    AppendText(&worker->output, "\n", 1);
+
+    worker->latencies[i] = NanosecondsSince(&start);
+  }
+
+  return NULL;
+}
+
+/**
+ * Reads the query file into memory, one query per line, so that none
+ * of the timed work involves I/O.  Blank lines are ignored, and lines
+ * too long for the buffer are skipped with a warning rather than split.
+ */
+
+static void ReadQueries(vector *queries, const char *filename)
+{
+  FILE *infile = fopen(filename, "r");
+  if (infile == NULL) {
+    fprintf(stderr, "Could not open query file named \"%s\"\n", filename);
+    exit(1);
+  }
+
+  char buffer[1024];
+  int lineNumber = 0;
+  while (fgets(buffer, sizeof(buffer), infile) != NULL) {
+    lineNumber++;
+    if (strchr(buffer, '\n') == NULL) {
+      int ch = getc(infile);
+      if (ch != EOF && ch != '\n') {
+        while (ch != EOF && ch != '\n') ch = getc(infile);
+        fprintf(stderr, "Skipping line %d of \"%s\": queries can't be longer than %zu characters.\n",
+                lineNumber, filename, sizeof(buffer) - 1);
+        continue;
+      }
+    }
+
+    buffer[strcspn(buffer, "\r\n")] = '\0';
+    if (buffer[0] == '\0') continue;
+    char *query = strdup(buffer);
+    VectorAppend(queries, &query);
+  }
+
+  fclose(infile);
+}
+
+static int LongCompare(const void *elem1, const void *elem2)
+{
+  long one = *(const long *) elem1;
+  long two = *(const long *) elem2;
+  return (one > two) - (one < two);
+}
+
+static void PrintLatencyReport(long *latencies, int numQueries, long elapsed, int numThreads)
+{
+  static const double kPercentiles[] = { 50, 90, 99, 99.9 };
+  qsort(latencies, numQueries, sizeof(long), LongCompare);
+
+  printf("Resolved %d queries on %d thread%s in %.3f ms (%.0f queries/s).\n", numQueries, numThreads,
+         (numThreads == 1) ? "" : "s", elapsed / 1e6, numQueries / (elapsed / 1e9));
+  if (numQueries == 0) return;
+  printf("Per-query latency:");
+  for (int i = 0; i < sizeof(kPercentiles) / sizeof(kPercentiles[0]); i++) {
+    int rank = (int) (kPercentiles[i] / 100 * (numQueries - 1));
+    printf(" p%g=%ldns", kPercentiles[i], latencies[rank]);
+  }
+  printf(" max=%ldns\n", latencies[numQueries - 1]);
+}
+
+/**
+ * Non-interactive alternative to QueryThesaurus.  The queries are split
+ * into contiguous ranges, one per thread, and resolved in parallel against
+ * the shared, read-only thesaurus.  Each thread formats its own results, and
+ * the results are then written to the named file in query order.  Latency
+ * percentiles and overall throughput are reported on standard output.
+ */
+
+static void RunBatchQueries(const thesaurus *t, const char *queryFileName,
+                            const char *resultFileName, int numThreads)
+{
+  vector queries;
+  VectorNew(&queries, sizeof(char *), StringFree, 1 << 12);
+  ReadQueries(&queries, queryFileName);
+  int numQueries = VectorLength(&queries);
+  char **allQueries = (numQueries == 0) ? NULL : VectorNth(&queries, 0);
+
+  long *latencies = malloc((numQueries + 1) * sizeof(long));
+  batchWorker *workers = calloc(numThreads, sizeof(batchWorker));
+  pthread_t *threads = malloc(numThreads * sizeof(pthread_t));
+  assert(latencies != NULL && workers != NULL && threads != NULL);
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < numThreads; i++) {
+    workers[i].thesaurus = t;
+    workers[i].queries = allQueries;
+    workers[i].start = (long) numQueries * i / numThreads;
+    workers[i].end = (long) numQueries * (i + 1) / numThreads;
+    workers[i].latencies = latencies;
+    pthread_create(&threads[i], NULL, ResolveQueries, &workers[i]);
+  }
+  for (int i = 0; i < numThreads; i++)
+    pthread_join(threads[i], NULL);
+  long elapsed = NanosecondsSince(&start);
+
+  FILE *outfile = fopen(resultFileName, "w");
+  if (outfile == NULL) {
+    fprintf(stderr, "Could not create result file named \"%s\"\n", resultFileName);
+    exit(1);
+  }
+  for (int i = 0; i < numThreads; i++) {
+    fwrite(workers[i].output.text, 1, workers[i].output.length, outfile);
+    free(workers[i].output.text);
+  }
+  fclose(outfile);
+
+  PrintLatencyReport(latencies, numQueries, elapsed, numThreads);
+  free(threads);
+  free(workers);
+  free(latencies);
+  VectorDispose(&queries);
+}
+
+/**
+ * Returns true if and only if the named file begins with the magic
+ * number of a thesaurus image, whether or not the rest of it is sound.
+ */
+
+static bool HasImageMagic(const char *fileName)
+{
+  char magic[sizeof(kThesaurusImageMagic) - 1];
+  FILE *infile = fopen(fileName, "rb");
+  if (infile == NULL) return false;
+  bool found = fread(magic, 1, sizeof(magic), infile) == sizeof(magic) &&
+    memcmp(magic, kThesaurusImageMagic, sizeof(magic)) == 0;
+  fclose(infile);
+  return found;
+}
+
+/**
+ * Provides the enty point to the program.  The thesaurus file named on
+ * the command line may either be a flat text thesaurus, which is read
+ * into a hashset of thesaurusEntry records, or an image produced by
+ * thesaurus-compile.  Images are mapped and queried in place, so they're
+ * ready for questions the moment the program starts.  A file that starts
+ * out like an image but fails validation is reported as damaged, rather
+ * than read as text.
+ *
+ * Batch mode is requested like this:
+ *
+ *     thesaurus-lookup <thesaurus> -batch <query-file> <result-file> [<num-threads>]
+ *
+ * and answers every query in the query file (one per line) without
+ * any prompting.  The number of threads defaults to the number of processors.
  */
 
 static const int kApproximateWordCount = (1 << 19) - 1; // six-digit Marsenne prime
 int main(int argc, const char *argv[])
 {
-  hashset thesaurus;
-  HashSetNew(&thesaurus, sizeof(thesaurusEntry), kApproximateWordCount, StringHash, StringCompare, ThesEntryFree);
   const char *thesaurusFileName = (argc == 1) ? 
     "/usr/class/cs107/assignments/assn-3-vector-hashset-data/thesaurus.txt" : argv[1];
-  ReadThesaurus(&thesaurus, thesaurusFileName);
-  QueryThesaurus(&thesaurus);
-  HashSetDispose(&thesaurus);
+  bool batch = (argc >= 5 && strcmp(argv[2], "-batch") == 0);
+  if (argc > 2 && !batch) {
+    fprintf(stderr, "Usage: %s [<thesaurus> [-batch <query-file> <result-file> [<num-threads>]]]\n", argv[0]);
+    return 1;
+  }
+
+  thesaurus t;
+  t.isImage = HasImageMagic(thesaurusFileName);
+  if (t.isImage && !ThesaurusImageOpen(&t.image, thesaurusFileName)) {
+    fprintf(stderr, "\"%s\" is a damaged thesaurus image.  Rebuild it with thesaurus-compile.\n",
+            thesaurusFileName);
+    return 1;
+  }
+  if (!t.isImage) {
+    HashSetNew(&t.entries, sizeof(thesaurusEntry), kApproximateWordCount, StringHash, StringCompare, ThesEntryFree);
+    ReadThesaurus(&t.entries, thesaurusFileName);
+  }
+
+  if (batch) {
+    int numThreads = (argc > 5) ? atoi(argv[5]) : sysconf(_SC_NPROCESSORS_ONLN);
+    RunBatchQueries(&t, argv[3], argv[4], (numThreads > 0) ? numThreads : 1);
+  } else {
+    QueryThesaurus(&t);
+  }
+  if (t.isImage) {
+    ThesaurusImageClose(&t.image);
+  } else {
+    HashSetDispose(&t.entries);
+  }
   return 0;
 }
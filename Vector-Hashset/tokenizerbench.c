@@ -0,0 +1,245 @@
+#include "streamtokenizer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+/**
+ * Delimiter sets exercised by the benchmark.  The first two mirror
+ * what the RSS news search applications hand to STNew when pulling
+ * lines and article text, and the last is the one thesaurus-lookup
+ * uses to split a flat text thesaurus.
+ */
+
+static const char *const kWhiteSpaceDelimiters = " \t\n\r";
+static const char *const kArticleDelimiters = " \t\n\r\b!@$%^*()_+={[}]|\\'\":;/?.>,<~`";
+static const char *const kThesaurusDelimiters = ",\n";
+
+struct delimiterSet {
+  const char *name;
+  const char *delimiters;
+};
+
+static const struct delimiterSet kDelimiterSets[] = {
+  { "whitespace", kWhiteSpaceDelimiters },
+  { "article", kArticleDelimiters },
+  { "thesaurus", kThesaurusDelimiters },
+};
+
+static const int kNumDelimiterSets = sizeof(kDelimiterSets) / sizeof(kDelimiterSets[0]);
+
+static const char *const kWords[] = {
+  "the", "president", "of", "france", "announced", "new", "elections", "on",
+  "monday", "while", "markets", "in", "asia", "rallied", "sharply", "after",
+  "weeks", "decline", "antidisestablishmentarianism", "well-known", "cold",
+  "arctic", "blustery", "freezing", "frigid", "icy", "nippy", "polar", "a",
+  "news", "feed", "aggregator", "index", "thesaurus", "synonym", "2007"
+};
+
+static const int kNumWords = sizeof(kWords) / sizeof(kWords[0]);
+
+static const char *const kTags[] = {
+  "<p>", "</p>", "<a href=\"http://news.bbc.co.uk/2/hi/europe/default.stm\">", "</a>",
+  "<div class=\"story\">", "</div>", "<br/>", "<!-- advertisement -->", "<b>", "</b>"
+};
+
+static const int kNumTags = sizeof(kTags) / sizeof(kTags[0]);
+
+static const char *const kEscapes[] = { "&amp;", "&quot;", "&#39;", "&lt;", "&gt;" };
+static const int kNumEscapes = sizeof(kEscapes) / sizeof(kEscapes[0]);
+
+/**
+ * Function: NextRandom
+ * --------------------
+ * Small linear congruential generator so that every run of the
+ * benchmark builds byte-for-byte identical corpora.  rand() isn't
+ * used because its sequence differs from platform to platform.
+ */
+
+static unsigned long NextRandom(unsigned long *seed)
+{
+  *seed = *seed * 1103515245UL + 12345UL;
+  return (*seed >> 16) & 0x7fff;
+}
+
+static const char *RandomWord(unsigned long *seed)
+{
+  return kWords[NextRandom(seed) % kNumWords];
+}
+
+/**
+ * Function: WriteProseCorpus
+ * --------------------------
+ * Writes roughly numBytes worth of English-like sentences to outfile:
+ * words separated by single spaces, the occasional comma, and sentences
+ * ended with a period and the occasional newline.
+ */
+
+static void WriteProseCorpus(FILE *outfile, long numBytes, unsigned long seed)
+{
+  long written = 0;
+  while (written < numBytes) {
+    int sentenceLength = 4 + NextRandom(&seed) % 12;
+    for (int i = 0; i < sentenceLength; i++) {
+      written += fprintf(outfile, "%s%s", (i == 0) ? "" : " ", RandomWord(&seed));
+      if (i < sentenceLength - 1 && NextRandom(&seed) % 8 == 0)
+	written += fprintf(outfile, ",");
+    }
+    written += fprintf(outfile, (NextRandom(&seed) % 4 == 0) ? ".\n" : ". ");
+  }
+}
+
+/**
+ * Function: WriteHTMLCorpus
+ * -------------------------
+ * Writes roughly numBytes worth of markup that looks like the body of a
+ * downloaded news article: text runs interrupted by tags, comments and
+ * HTML escape sequences.
+ */
+
+static void WriteHTMLCorpus(FILE *outfile, long numBytes, unsigned long seed)
+{
+  long written = 0;
+  while (written < numBytes) {
+    switch (NextRandom(&seed) % 6) {
+      case 0: written += fprintf(outfile, "%s", kTags[NextRandom(&seed) % kNumTags]); break;
+      case 1: written += fprintf(outfile, "%s", kEscapes[NextRandom(&seed) % kNumEscapes]); break;
+      case 2: written += fprintf(outfile, "\n"); break;
+      default: written += fprintf(outfile, " %s", RandomWord(&seed)); break;
+    }
+  }
+}
+
+/**
+ * Function: WriteThesaurusCorpus
+ * ------------------------------
+ * Writes roughly numBytes worth of lines in the flat text thesaurus format
+ * understood by thesaurus-lookup:
+ *
+ *     cold,arctic,blustery,freezing,frigid,icy,nippy,polar
+ */
+
+static void WriteThesaurusCorpus(FILE *outfile, long numBytes, unsigned long seed)
+{
+  long written = 0;
+  while (written < numBytes) {
+    int numSynonyms = 1 + NextRandom(&seed) % 10;
+    written += fprintf(outfile, "%s", RandomWord(&seed));
+    for (int i = 0; i < numSynonyms; i++)
+      written += fprintf(outfile, ",%s", RandomWord(&seed));
+    written += fprintf(outfile, "\n");
+  }
+}
+
+typedef void (*CorpusWriter)(FILE *outfile, long numBytes, unsigned long seed);
+
+struct corpus {
+  const char *name;
+  CorpusWriter writer;
+};
+
+static const struct corpus kCorpora[] = {
+  { "prose", WriteProseCorpus },
+  { "html", WriteHTMLCorpus },
+  { "thesaurus", WriteThesaurusCorpus },
+};
+
+static const int kNumCorpora = sizeof(kCorpora) / sizeof(kCorpora[0]);
+
+static double CurrentTimeInSeconds(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Function: TimeTokenizer
+ * -----------------------
+ * Rewinds the corpus file and pulls every token out of it using
+ * a freshly initialized streamtokenizer, recording the number of
+ * tokens produced and returning the elapsed wall-clock time.
+ */
+
+static double TimeTokenizer(FILE *corpus, const char *delimiters, bool discardDelimiters, long *numTokens)
+{
+  streamtokenizer st;
+  char buffer[1024];
+  long count = 0;
+
+  rewind(corpus);
+  double start = CurrentTimeInSeconds();
+  STNew(&st, corpus, delimiters, discardDelimiters);
+  while (STNextToken(&st, buffer, sizeof(buffer)))
+    count++;
+  STDispose(&st);
+  double elapsed = CurrentTimeInSeconds() - start;
+
+  *numTokens = count;
+  return elapsed;
+}
+
+/**
+ * Function: BenchmarkCorpus
+ * -------------------------
+ * Runs every combination of delimiter set and discardDelimiters mode
+ * against the supplied corpus, keeping the fastest of numTrials runs
+ * so that a cold page cache or a noisy neighbor doesn't skew the numbers.
+ */
+
+static void BenchmarkCorpus(const char *corpusName, FILE *corpus, long corpusSize, int numTrials)
+{
+  for (int i = 0; i < kNumDelimiterSets; i++) {
+    for (int discard = 0; discard <= 1; discard++) {
+      double best = 0;
+      long numTokens = 0;
+      for (int trial = 0; trial < numTrials; trial++) {
+	double elapsed = TimeTokenizer(corpus, kDelimiterSets[i].delimiters, discard, &numTokens);
+	if (trial == 0 || elapsed < best) best = elapsed;
+      }
+
+      if (best <= 0) best = 1e-9;
+      printf("%-10s %-11s %-8s %10ld %10.2f %14.0f\n", corpusName, kDelimiterSets[i].name,
+	     discard ? "discard" : "keep", numTokens,
+	     corpusSize / (1024.0 * 1024.0) / best, numTokens / best);
+    }
+  }
+}
+
+static const long kDefaultCorpusKilobytes = 4096;
+static const int kDefaultNumTrials = 3;
+static const unsigned long kCorpusSeed = 107;
+
+/**
+ * Provides the entry point to the benchmark.  Usage:
+ *
+ *     tokenizer-bench [corpus-size-in-kilobytes] [number-of-trials]
+ *
+ * Each synthetic corpus is written to a temporary file (so that the
+ * streamtokenizer reads through a real FILE *, just like it does
+ * when layered over a urlconnection) and then tokenized repeatedly.
+ */
+
+int main(int argc, char *argv[])
+{
+  long corpusKilobytes = (argc > 1) ? atol(argv[1]) : kDefaultCorpusKilobytes;
+  int numTrials = (argc > 2) ? atoi(argv[2]) : kDefaultNumTrials;
+  if (corpusKilobytes <= 0 || numTrials <= 0) {
+    fprintf(stderr, "Usage: %s [corpus-size-in-kilobytes] [number-of-trials]\n", argv[0]);
+    return 1;
+  }
+
+  printf("%-10s %-11s %-8s %10s %10s %14s\n", "corpus", "delimiters", "mode", "tokens", "MB/s", "tokens/s");
+  for (int i = 0; i < kNumCorpora; i++) {
+    FILE *corpus = tmpfile();
+    assert(corpus != NULL);
+    kCorpora[i].writer(corpus, corpusKilobytes * 1024, kCorpusSeed + i);
+    fflush(corpus);
+    long corpusSize = ftell(corpus);
+    BenchmarkCorpus(kCorpora[i].name, corpus, corpusSize, numTrials);
+    fclose(corpus);
+  }
+
+  return 0;
+}